@@ -0,0 +1,74 @@
+#include "../test/map-helpers.h"
+#include "nanobench.h"
+#include "rw/pdata/atom.h"
+#include "rw/pdata/map.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Times lookups through a shared root while other threads read it and
+// one thread keeps replacing it
+template <class Load, class Swap>
+static void contended(ankerl::nanobench::Config& cfg, const char* name,
+        const std::vector<std::pair<uint64_t, uint64_t>>& pairs, Load load,
+        Swap swap)
+{
+    std::atomic<bool> done{false};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 3; i++) {
+        threads.emplace_back([&] {
+            uint64_t sum = 0;
+            for (std::size_t n = 0; !done.load(std::memory_order_relaxed); n++) {
+                sum += load()->find(pairs[n % pairs.size()].first).value_or(0);
+            }
+            ankerl::nanobench::doNotOptimizeAway(sum);
+        });
+    }
+    threads.emplace_back([&] {
+        for (uint64_t n = 0; !done.load(std::memory_order_relaxed); n++) {
+            swap(pairs[n % pairs.size()].first, n);
+        }
+    });
+
+    std::size_t n = 0;
+    uint64_t sum = 0;
+    cfg.run(name, [&] {
+           sum += load()->find(pairs[n++ % pairs.size()].first).value_or(0);
+       }).doNotOptimizeAway(&sum);
+
+    done = true;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void bench_atom(ankerl::nanobench::Config& cfg)
+{
+    using map_type = rw::pdata::persistent_map<uint64_t, uint64_t>;
+
+    auto pairs = randomPairs<uint64_t>(1000);
+    auto init = map_type::create(pairs.begin(), pairs.end());
+
+    rw::pdata::atom<map_type> a{init};
+    contended(
+            cfg, "atom load+find, 3 readers 1 writer", pairs,
+            [&] { return a.load(); },
+            [&](uint64_t key, uint64_t val) {
+                a.swap([&](const std::shared_ptr<map_type>& m) {
+                    return m->assoc(key, val);
+                });
+            });
+
+    // the same, through libstdc++'s atomic shared_ptr functions
+    auto shared = init;
+    contended(
+            cfg, "atomic_load+find, 3 readers 1 writer", pairs,
+            [&] { return std::atomic_load(&shared); },
+            [&](uint64_t key, uint64_t val) {
+                auto m = std::atomic_load(&shared);
+                while (!std::atomic_compare_exchange_weak(&shared, &m,
+                        m->assoc(key, val))) {
+                }
+            });
+}
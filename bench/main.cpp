@@ -10,6 +10,24 @@
 
 extern void bench_map_persistent(ankerl::nanobench::Config& cfg);
 extern void bench_map_transient(ankerl::nanobench::Config& cfg);
+extern void bench_map_local(ankerl::nanobench::Config& cfg);
+extern void bench_map_iteration(ankerl::nanobench::Config& cfg);
+extern void bench_map_reduce(ankerl::nanobench::Config& cfg);
+extern void bench_map_create(ankerl::nanobench::Config& cfg);
+extern void bench_map_merge(ankerl::nanobench::Config& cfg);
+extern void bench_map_diff(ankerl::nanobench::Config& cfg);
+extern void bench_map_assoc_many(ankerl::nanobench::Config& cfg);
+extern void bench_map_pool(ankerl::nanobench::Config& cfg);
+extern void bench_map_reclaim(ankerl::nanobench::Config& cfg);
+extern void bench_map_long_keys(ankerl::nanobench::Config& cfg);
+extern void bench_map_find_ptr(ankerl::nanobench::Config& cfg);
+extern void bench_map_update(ankerl::nanobench::Config& cfg);
+extern void bench_map_collisions(ankerl::nanobench::Config& cfg);
+extern void bench_map_snapshot(ankerl::nanobench::Config& cfg);
+extern void bench_sorted_map(ankerl::nanobench::Config& cfg);
+extern void bench_set_algebra(ankerl::nanobench::Config& cfg);
+extern void bench_vector(ankerl::nanobench::Config& cfg);
+extern void bench_atom(ankerl::nanobench::Config& cfg);
 extern void bench_utf8_encoding(ankerl::nanobench::Config& cfg);
 extern void bench_utf8_decoding(ankerl::nanobench::Config& cfg);
 
@@ -19,8 +37,27 @@ int main()
 
     auto cfg = ankerl::nanobench::Config();
 
+    // first, so its resident sizes aren't hidden by memory freed earlier
+    bench_map_pool(cfg);
+    bench_map_reclaim(cfg);
     bench_map_persistent(cfg);
     bench_map_transient(cfg);
+    bench_map_local(cfg);
+    bench_map_iteration(cfg);
+    bench_map_reduce(cfg);
+    bench_map_create(cfg);
+    bench_map_merge(cfg);
+    bench_map_diff(cfg);
+    bench_map_assoc_many(cfg);
+    bench_map_long_keys(cfg);
+    bench_map_find_ptr(cfg);
+    bench_map_update(cfg);
+    bench_map_collisions(cfg);
+    bench_map_snapshot(cfg);
+    bench_set_algebra(cfg);
+    bench_sorted_map(cfg);
+    bench_vector(cfg);
+    bench_atom(cfg);
     bench_utf8_encoding(cfg);
     bench_utf8_decoding(cfg);
 }
@@ -2,6 +2,13 @@
 #include "nanobench.h"
 #include "rw/pdata/map.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
 void bench_map_persistent(ankerl::nanobench::Config& cfg)
 {
     std::shared_ptr<rw::pdata::persistent_map<uint64_t, uint64_t>> m;
@@ -49,3 +56,432 @@ void bench_map_transient(ankerl::nanobench::Config& cfg)
            }).doNotOptimizeAway(&m);
     }
 }
+
+void bench_map_local(ankerl::nanobench::Config& cfg)
+{
+    using local_map = rw::pdata::persistent_map<uint64_t, uint64_t,
+            std::hash<uint64_t>, rw::pdata::local_policy>;
+    std::shared_ptr<local_map> m;
+
+    auto pairs = randomPairs<uint64_t>(1000);
+    cfg.run("persistent set 1000 (local)", [&] {
+           m = std::make_shared<local_map>();
+           m = fillPersistent(m, pairs);
+       }).doNotOptimizeAway(&m);
+
+    m.reset();
+    cfg.run("transient set 1000 (local)", [&] {
+           m = std::make_shared<local_map>();
+           m = fillTransient(m, pairs);
+       }).doNotOptimizeAway(&m);
+}
+
+void bench_map_iteration(ankerl::nanobench::Config& cfg)
+{
+    auto pairs = randomPairs<uint64_t>(100000);
+    auto m = fillTransient(
+            std::make_shared<rw::pdata::persistent_map<uint64_t, uint64_t>>(),
+            pairs);
+
+    uint64_t sum = 0;
+    cfg.batch(pairs.size()).unit("entry").run("persistent iterate 100000", [&] {
+           for (const auto& [key, val] : *m) {
+               sum += val;
+           }
+       }).doNotOptimizeAway(&sum);
+
+    auto c = fillTransient(
+            std::make_shared<rw::pdata::champ_map<uint64_t, uint64_t>>(),
+            pairs);
+
+    cfg.run("champ iterate 100000", [&] {
+           for (const auto& [key, val] : *c) {
+               sum += val;
+           }
+       }).doNotOptimizeAway(&sum);
+
+    // restore defaults for later benchmarks
+    cfg.batch(1).unit("op");
+}
+
+void bench_map_reduce(ankerl::nanobench::Config& cfg)
+{
+    using map_type = rw::pdata::persistent_map<uint64_t, uint64_t>;
+
+    auto pairs = randomPairs<uint64_t>(1000000);
+    auto m = map_type::create(pairs.begin(), pairs.end());
+
+    auto sum = [](uint64_t acc, uint64_t, uint64_t val) { return acc + val; };
+    auto plus = [](uint64_t a, uint64_t b) { return a + b; };
+
+    uint64_t result = 0;
+    cfg.batch(pairs.size()).unit("entry").run("persistent iterate 1000000", [&] {
+           uint64_t acc = 0;
+           for (const auto& [key, val] : *m) {
+               acc += val;
+           }
+           result = acc;
+       }).doNotOptimizeAway(&result);
+
+    cfg.run("persistent reduce 1000000", [&] {
+           result = m->reduce(uint64_t{0}, sum);
+       }).doNotOptimizeAway(&result);
+
+    cfg.run("persistent parallel_reduce 1000000", [&] {
+           result = m->parallel_reduce(uint64_t{0}, sum, plus);
+       }).doNotOptimizeAway(&result);
+
+    // restore defaults for later benchmarks
+    cfg.batch(1).unit("op");
+}
+
+void bench_map_create(ankerl::nanobench::Config& cfg)
+{
+    using map_type = rw::pdata::persistent_map<uint64_t, uint64_t>;
+    std::shared_ptr<map_type> m;
+
+    auto pairs = randomPairs<uint64_t>(100000);
+    cfg.minEpochIterations(5).run("transient set 100000", [&] {
+                                 m = fillTransient(std::make_shared<map_type>(), pairs);
+                             })
+            .doNotOptimizeAway(&m);
+
+    m.reset();
+    cfg.run("persistent create 100000", [&] {
+           m = map_type::create(pairs.begin(), pairs.end());
+       }).doNotOptimizeAway(&m);
+
+    m.reset();
+    cfg.run("persistent create_parallel 100000", [&] {
+           m = map_type::create_parallel(pairs.begin(), pairs.end());
+       }).doNotOptimizeAway(&m);
+}
+
+void bench_map_merge(ankerl::nanobench::Config& cfg)
+{
+    using map_type = rw::pdata::persistent_map<uint64_t, uint64_t>;
+
+    // defaults, and overrides derived from them
+    auto pairs = randomPairs<uint64_t>(10000);
+    auto defaults = map_type::create(pairs.begin(), pairs.end());
+    auto overrides = defaults;
+    for (int i = 0; i < 100; i++) {
+        overrides = overrides->assoc(pairs[i * 7].first, i);
+    }
+
+    std::shared_ptr<map_type> m;
+    cfg.run("persistent assoc all 10000", [&] {
+           m = defaults;
+           for (const auto& [key, val] : *overrides) {
+               m = m->assoc(key, val);
+           }
+       }).doNotOptimizeAway(&m);
+
+    cfg.run("persistent merge 10000", [&] {
+           m = defaults->merge(overrides);
+       }).doNotOptimizeAway(&m);
+}
+
+void bench_map_diff(ankerl::nanobench::Config& cfg)
+{
+    using map_type = rw::pdata::persistent_map<uint64_t, uint64_t>;
+
+    struct Counter
+    {
+        void added(uint64_t, uint64_t) { count++; }
+        void removed(uint64_t, uint64_t) { count++; }
+        void updated(uint64_t, uint64_t, uint64_t) { count++; }
+        std::size_t count = 0;
+    };
+
+    auto pairs = randomPairs<uint64_t>(1000000);
+    auto m = map_type::create(pairs.begin(), pairs.end());
+
+    // diff cost should follow the number of changes, not the map size
+    for (int changes : {1, 100, 10000}) {
+        auto t = m->transient();
+        for (int i = 0; i < changes; i++) {
+            t->assoc(pairs[i * 97].first, i);
+        }
+        auto changed = t->persistent();
+
+        Counter counter;
+        cfg.run(fmt::format("persistent diff 1000000, {} changed", changes), [&] {
+               diff(*m, *changed, counter);
+           }).doNotOptimizeAway(&counter);
+    }
+}
+
+void bench_map_assoc_many(ankerl::nanobench::Config& cfg)
+{
+    using map_type = rw::pdata::persistent_map<uint64_t, uint64_t>;
+
+    auto pairs = randomPairs<uint64_t>(100000);
+    auto base = map_type::create(pairs.begin(), pairs.end());
+
+    // a tick's worth of updates, half of them new keys
+    std::vector<std::pair<uint64_t, uint64_t>> updates;
+    for (uint64_t i = 0; i < 1000; i++) {
+        auto key = i % 2 ? pairs[i * 53].first : pairs[i * 53].first + 1;
+        updates.push_back({key, i});
+    }
+
+    std::shared_ptr<map_type> m;
+    cfg.run("persistent assoc 1000 into 100000", [&] {
+           m = fillPersistent(base, updates);
+       }).doNotOptimizeAway(&m);
+
+    cfg.run("persistent assoc_many 1000 into 100000", [&] {
+           m = base->assoc_many(updates.begin(), updates.end());
+       }).doNotOptimizeAway(&m);
+}
+
+// resident set size in bytes, from /proc on Linux; 0 elsewhere
+static std::size_t residentBytes()
+{
+    std::size_t pages = 0, resident = 0;
+    if (auto f = std::fopen("/proc/self/statm", "r")) {
+        if (std::fscanf(f, "%zu %zu", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        std::fclose(f);
+    }
+    return resident * std::size_t(sysconf(_SC_PAGESIZE));
+}
+
+template <class Map>
+static void benchPolicy(ankerl::nanobench::Config& cfg, const std::string& name)
+{
+    std::shared_ptr<Map> m;
+
+    auto pairs = randomPairs<uint64_t>(1000);
+    cfg.run(fmt::format("persistent set 1000 ({})", name), [&] {
+           m = fillPersistent(std::make_shared<Map>(), pairs);
+       }).doNotOptimizeAway(&m);
+
+    cfg.run(fmt::format("transient set 1000 ({})", name), [&] {
+           m = fillTransient(std::make_shared<Map>(), pairs);
+       }).doNotOptimizeAway(&m);
+
+    // many versions alive at once, sharing most of their nodes
+    auto many = randomPairs<uint64_t>(200000);
+    auto before = residentBytes();
+    m = fillTransient(std::make_shared<Map>(), many);
+    std::vector<std::shared_ptr<Map>> versions;
+    for (std::size_t i = 0; i < 20000; i++) {
+        m = m->assoc(many[i * 7].first, i);
+        versions.push_back(m);
+    }
+    fmt::print("{}: resident +{} KiB for 200000 entries and 20000 versions\n",
+            name, (residentBytes() - before) / 1024);
+}
+
+void bench_map_pool(ankerl::nanobench::Config& cfg)
+{
+    // run the pool first, so it doesn't reuse memory malloc has freed
+    benchPolicy<rw::pdata::persistent_map<uint64_t, uint64_t,
+            std::hash<uint64_t>, rw::pdata::pool_policy<>>>(cfg, "pool");
+    benchPolicy<rw::pdata::persistent_map<uint64_t, uint64_t>>(cfg, "new");
+}
+
+template <class Map>
+static void benchLongKeys(ankerl::nanobench::Config& cfg,
+        const std::vector<std::pair<std::string, uint64_t>>& pairs,
+        const std::vector<std::string>& missing, const std::string& name)
+{
+    std::shared_ptr<Map> m;
+    cfg.run(fmt::format("transient set 10000 long keys ({})", name), [&] {
+           auto t = std::make_shared<Map>()->transient();
+           for (const auto& [key, val] : pairs) {
+               t->assoc(key, val);
+           }
+           m = t->persistent();
+       }).doNotOptimizeAway(&m);
+
+    cfg.run(fmt::format("persistent set 10000 long keys ({})", name), [&] {
+           m = std::make_shared<Map>();
+           for (const auto& [key, val] : pairs) {
+               m = m->assoc(key, val);
+           }
+       }).doNotOptimizeAway(&m);
+
+    std::size_t found = 0;
+    cfg.run(fmt::format("persistent get 10000 long keys ({})", name), [&] {
+           for (const auto& [key, val] : pairs) {
+               found += bool(m->find(key));
+           }
+       }).doNotOptimizeAway(&found);
+
+    cfg.run(fmt::format("persistent get missing 10000 long keys ({})", name), [&] {
+           for (const auto& key : missing) {
+               found += bool(m->find(key));
+           }
+       }).doNotOptimizeAway(&found);
+}
+
+void bench_map_long_keys(ankerl::nanobench::Config& cfg)
+{
+    // paths of 100+ bytes, which share long prefixes, so comparing
+    // two of them usually reads most of both
+    auto prefix = std::string{"/srv/build/workspace/project/"} +
+                  std::string(60, 'x') + "/src/module/";
+    std::vector<std::pair<std::string, uint64_t>> pairs;
+    std::vector<std::string> missing;
+    for (uint64_t i = 0; i < 10000; i++) {
+        pairs.push_back({fmt::format("{}{}/source.cpp", prefix, i), i});
+        missing.push_back(fmt::format("{}{}/source.hpp", prefix, i));
+    }
+
+    benchLongKeys<rw::pdata::persistent_map<std::string, uint64_t>>(cfg,
+            pairs, missing, "default");
+    benchLongKeys<rw::pdata::persistent_map<std::string, uint64_t,
+            std::hash<std::string>, rw::pdata::memo_policy<>>>(cfg, pairs,
+            missing, "memo");
+}
+
+void bench_map_find_ptr(ankerl::nanobench::Config& cfg)
+{
+    using map_type = rw::pdata::persistent_map<uint64_t, std::string>;
+
+    auto pairs = randomPairs<uint64_t>(1000);
+    std::vector<std::pair<uint64_t, std::string>> values;
+    for (const auto& [key, val] : pairs) {
+        values.push_back({key, std::string(100, 'x')});
+    }
+    auto m = map_type::create(values.begin(), values.end());
+
+    // find copies the string out; find_ptr points at the one in the map
+    std::size_t sum = 0;
+    cfg.run("persistent find 1000 strings", [&] {
+           for (const auto& [key, val] : pairs) {
+               sum += m->find(key)->size();
+           }
+       }).doNotOptimizeAway(&sum);
+
+    cfg.run("persistent find_ptr 1000 strings", [&] {
+           for (const auto& [key, val] : pairs) {
+               sum += m->find_ptr(key)->size();
+           }
+       }).doNotOptimizeAway(&sum);
+}
+
+void bench_map_update(ankerl::nanobench::Config& cfg)
+{
+    using map_type = rw::pdata::persistent_map<uint64_t, uint64_t>;
+
+    // counters, incremented at random
+    auto pairs = randomPairs<uint64_t>(100000);
+    auto m = map_type::create(pairs.begin(), pairs.end());
+    std::vector<uint64_t> keys;
+    std::mt19937_64 gen(1234u);
+    for (std::size_t i = 0; i < 1000; i++) {
+        keys.push_back(pairs[gen() % pairs.size()].first);
+    }
+    auto inc = [](uint64_t n) { return n + 1; };
+
+    cfg.run("persistent find and assoc 1000", [&] {
+           for (auto key : keys) {
+               m = m->assoc(key, *m->find(key) + 1);
+           }
+       }).doNotOptimizeAway(&m);
+
+    cfg.run("persistent update 1000", [&] {
+           for (auto key : keys) {
+               m = m->update(key, inc);
+           }
+       }).doNotOptimizeAway(&m);
+
+    auto t = m->transient();
+    cfg.run("transient find and assoc 1000", [&] {
+           for (auto key : keys) {
+               t->assoc(key, *t->find(key) + 1);
+           }
+       }).doNotOptimizeAway(&t);
+
+    cfg.run("transient update 1000", [&] {
+           for (auto key : keys) {
+               t->update(key, inc);
+           }
+       }).doNotOptimizeAway(&t);
+}
+
+void bench_map_collisions(ankerl::nanobench::Config& cfg)
+{
+    // a poor hash, leaving around 40 long keys in each collision node
+    struct BucketHash
+    {
+        std::size_t operator()(const std::string& s) const noexcept
+        {
+            return std::hash<std::string>{}(s) % 256;
+        }
+    };
+    using map_type = rw::pdata::persistent_map<std::string, uint64_t,
+            BucketHash>;
+
+    auto prefix = std::string(40, 'p');
+    std::vector<std::pair<std::string, uint64_t>> pairs;
+    for (uint64_t i = 0; i < 10000; i++) {
+        pairs.push_back({fmt::format("{}/{:08}", prefix, i), i});
+    }
+    auto m = map_type::create(pairs.begin(), pairs.end());
+
+    std::size_t found = 0;
+    cfg.run("persistent get 10000 colliding keys", [&] {
+           for (const auto& [key, val] : pairs) {
+               found += m->find_ptr(key) != nullptr;
+           }
+       }).doNotOptimizeAway(&found);
+
+    cfg.run("transient set 10000 colliding keys", [&] {
+           auto t = std::make_shared<map_type>()->transient();
+           for (const auto& [key, val] : pairs) {
+               t->assoc(key, val);
+           }
+           m = t->persistent();
+       }).doNotOptimizeAway(&m);
+}
+
+// time the thread dropping the last reference to a map spends on it
+template <class Map>
+static void benchDrop(const std::vector<std::pair<uint64_t, uint64_t>>& pairs,
+        const std::string& name)
+{
+    std::chrono::nanoseconds worst{0}, total{0};
+    for (int i = 0; i < 10; i++) {
+        auto m = Map::create(pairs.begin(), pairs.end());
+        auto start = std::chrono::steady_clock::now();
+        m.reset();
+        auto took = std::chrono::steady_clock::now() - start;
+        worst = std::max(worst, took);
+        total += took;
+        rw::pdata::reclaim();
+    }
+    fmt::print("{}: dropping a map of {} takes {} us on average, {} us at "
+               "worst\n",
+            name, pairs.size(), total.count() / 10 / 1000,
+            worst.count() / 1000);
+}
+
+void bench_map_reclaim(ankerl::nanobench::Config& cfg)
+{
+    using deferred_map = rw::pdata::persistent_map<uint64_t, uint64_t,
+            std::hash<uint64_t>, rw::pdata::deferred_policy<>>;
+
+    auto pairs = randomPairs<uint64_t>(1000000);
+    benchDrop<rw::pdata::persistent_map<uint64_t, uint64_t>>(pairs, "new");
+    benchDrop<deferred_map>(pairs, "deferred");
+
+    // the cost of queueing on updates, which retire a path each
+    auto small = randomPairs<uint64_t>(1000);
+    std::shared_ptr<deferred_map> m;
+    cfg.run("persistent set 1000 (deferred)", [&] {
+           m = fillPersistent(std::make_shared<deferred_map>(), small);
+           rw::pdata::reclaim();
+       }).doNotOptimizeAway(&m);
+
+    // and reclaiming on a thread of its own
+    rw::pdata::background_reclaimer reclaimer;
+    cfg.run("persistent set 1000 (deferred, background)", [&] {
+           m = fillPersistent(std::make_shared<deferred_map>(), small);
+       }).doNotOptimizeAway(&m);
+}
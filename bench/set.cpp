@@ -0,0 +1,84 @@
+#include "nanobench.h"
+#include "rw/pdata/map.h"
+#include "rw/pdata/set.h"
+
+#include <memory>
+#include <random>
+#include <unordered_set>
+#include <vector>
+
+void bench_set_algebra(ankerl::nanobench::Config& cfg)
+{
+    using set_type = rw::pdata::persistent_set<uint64_t>;
+    using map_type = rw::pdata::persistent_map<uint64_t, bool>;
+
+    // constant seed for random
+    std::mt19937 gen(771203ull);
+    std::uniform_int_distribution<uint64_t> dis;
+
+    // permission sets for 100 roles, each a version of a common base
+    // set of 5000 with a few permissions added and removed
+    std::vector<uint64_t> common(5000);
+    for (auto& key : common) {
+        key = dis(gen);
+    }
+    auto base = set_type::create(common.begin(), common.end());
+
+    std::vector<std::shared_ptr<set_type>> roles;
+    std::vector<std::shared_ptr<map_type>> roleMaps;
+    std::vector<std::unordered_set<uint64_t>> roleSets;
+    for (int r = 0; r < 100; r++) {
+        auto t = base->transient();
+        std::unordered_set<uint64_t> keys(common.begin(), common.end());
+        for (int i = 0; i < 20; i++) {
+            auto added = dis(gen);
+            auto removed = common[dis(gen) % common.size()];
+            t->insert(added)->erase(removed);
+            keys.insert(added);
+            keys.erase(removed);
+        }
+        roles.push_back(t->persistent());
+
+        std::vector<std::pair<uint64_t, bool>> pairs;
+        for (auto key : keys) {
+            pairs.emplace_back(key, true);
+        }
+        roleMaps.push_back(map_type::create(pairs.begin(), pairs.end()));
+        roleSets.push_back(std::move(keys));
+    }
+
+    cfg.run("std::unordered_set union of 100 roles", [&] {
+           auto all = roleSets[0];
+           for (const auto& role : roleSets) {
+               all.insert(role.begin(), role.end());
+           }
+           ankerl::nanobench::doNotOptimizeAway(all);
+       });
+
+    // a map of flags, with maps created from the same keys rather than
+    // derived from each other, so they share no subtrees
+    std::shared_ptr<map_type> allMap;
+    cfg.run("persistent_map<K, bool> merge of 100 roles", [&] {
+           allMap = roleMaps[0];
+           for (const auto& role : roleMaps) {
+               allMap = allMap->merge(role);
+           }
+       }).doNotOptimizeAway(&allMap);
+
+    std::shared_ptr<set_type> all;
+    cfg.run("persistent_set union of 100 roles", [&] {
+           all = roles[0];
+           for (const auto& role : roles) {
+               all = all->set_union(role);
+           }
+       }).doNotOptimizeAway(&all);
+
+    std::shared_ptr<set_type> result;
+    cfg.run("persistent_set intersection of 2 roles", [&] {
+           result = roles[0]->set_intersection(roles[1]);
+       }).doNotOptimizeAway(&result);
+
+    cfg.run("persistent_set difference of 2 roles", [&] {
+           result = roles[0]->set_difference(roles[1]);
+       }).doNotOptimizeAway(&result);
+}
@@ -0,0 +1,102 @@
+#include "nanobench.h"
+#include "rw/pdata/map.h"
+#include "rw/pdata/snapshot.h"
+
+#include <cstring>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <vector>
+
+void bench_map_snapshot(ankerl::nanobench::Config& cfg)
+{
+    using map_type = rw::pdata::persistent_map<uint64_t, uint64_t>;
+    using snapshot_type = rw::pdata::map_snapshot<uint64_t, uint64_t>;
+
+    // constant seed for random
+    std::mt19937_64 gen(90210ull);
+
+    // a routing table, as it would be read at startup
+    std::vector<std::pair<uint64_t, uint64_t>> pairs(1000000);
+    for (auto& pair : pairs) {
+        pair = {gen(), gen()};
+    }
+    auto m = map_type::create(pairs.begin(), pairs.end());
+
+    std::ostringstream out;
+    rw::pdata::write_snapshot(*m, out);
+    auto bytes = out.str();
+    std::vector<uint64_t> buffer((bytes.size() + 7) / 8);
+    std::memcpy(buffer.data(), bytes.data(), bytes.size());
+
+    cfg.run("persistent_map write_snapshot of 1000000", [&] {
+           std::ostringstream out;
+           rw::pdata::write_snapshot(*m, out);
+           ankerl::nanobench::doNotOptimizeAway(out);
+       });
+
+    // startup, then 1000 lookups
+    cfg.run("persistent_map create 1000000 and find 1000", [&] {
+           auto loaded = map_type::create(pairs.begin(), pairs.end());
+           uint64_t sum = 0;
+           for (std::size_t i = 0; i < pairs.size(); i += 1000) {
+               sum += *loaded->find_ptr(pairs[i].first);
+           }
+           ankerl::nanobench::doNotOptimizeAway(sum);
+       });
+
+    cfg.run("map_snapshot view 1000000 and find 1000", [&] {
+           auto loaded = snapshot_type::view(buffer.data(), bytes.size());
+           uint64_t sum = 0;
+           for (std::size_t i = 0; i < pairs.size(); i += 1000) {
+               sum += *loaded->find_ptr(pairs[i].first);
+           }
+           ankerl::nanobench::doNotOptimizeAway(sum);
+       });
+
+    // lookups alone, in place against in memory
+    auto snapshot = snapshot_type::view(buffer.data(), bytes.size());
+    uint64_t result = 0;
+    cfg.run("persistent_map find 1000", [&] {
+           uint64_t sum = 0;
+           for (std::size_t i = 0; i < pairs.size(); i += 1000) {
+               sum += *m->find_ptr(pairs[i].first);
+           }
+           result = sum;
+       }).doNotOptimizeAway(&result);
+
+    cfg.run("map_snapshot find 1000", [&] {
+           uint64_t sum = 0;
+           for (std::size_t i = 0; i < pairs.size(); i += 1000) {
+               sum += *snapshot->find_ptr(pairs[i].first);
+           }
+           result = sum;
+       }).doNotOptimizeAway(&result);
+
+    // checkpoints of a map changing by 1000 keys between them
+    auto changed = [&](const std::shared_ptr<map_type>& from, uint64_t v) {
+        auto t = from->transient();
+        for (std::size_t i = 0; i < 1000; i++) {
+            t->assoc(pairs[gen() % pairs.size()].first, v);
+        }
+        return t->persistent();
+    };
+
+    std::ostringstream fullOut;
+    uint64_t v = 0;
+    cfg.run("persistent_map write_snapshot of 1000000 after 1000 changes", [&] {
+           m = changed(m, v++);
+           fullOut.str({});
+           rw::pdata::write_snapshot(*m, fullOut);
+       });
+
+    std::ostringstream journalOut;
+    rw::pdata::map_journal_writer<uint64_t, uint64_t> writer{journalOut};
+    writer.checkpoint(*m);
+    cfg.run("map_journal_writer checkpoint of 1000000 after 1000 changes", [&] {
+           m = changed(m, v++);
+           // only the last checkpoint is kept in memory
+           journalOut.str({});
+           writer.checkpoint(*m);
+       });
+}
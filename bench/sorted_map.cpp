@@ -0,0 +1,91 @@
+#include "nanobench.h"
+#include "rw/pdata/map.h"
+#include "rw/pdata/sorted_map.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <vector>
+
+void bench_sorted_map(ankerl::nanobench::Config& cfg)
+{
+    using sorted_type = rw::pdata::persistent_sorted_map<uint64_t, uint64_t>;
+    using map_type = rw::pdata::persistent_map<uint64_t, uint64_t>;
+
+    // a time series index: timestamps a few ticks apart
+    std::vector<std::pair<uint64_t, uint64_t>> pairs;
+    for (uint64_t i = 0; i < 100000; i++) {
+        pairs.emplace_back(i * 7 + i % 3, i);
+    }
+
+    cfg.run("std::map insert 100000 increasing keys", [&] {
+           std::map<uint64_t, uint64_t> m;
+           for (const auto& pair : pairs) {
+               m.emplace_hint(m.end(), pair);
+           }
+           ankerl::nanobench::doNotOptimizeAway(m);
+       });
+
+    std::shared_ptr<sorted_type> sorted;
+    cfg.run("transient_sorted_map assoc 100000 increasing keys", [&] {
+           auto t = std::make_shared<sorted_type>()->transient();
+           for (const auto& pair : pairs) {
+               t->assoc(pair.first, pair.second);
+           }
+           sorted = t->persistent();
+       }).doNotOptimizeAway(&sorted);
+
+    cfg.run("persistent_sorted_map assoc 10000 increasing keys", [&] {
+           auto m = std::make_shared<sorted_type>();
+           for (std::size_t i = 0; i < 10000; i++) {
+               m = m->assoc(pairs[i].first, pairs[i].second);
+           }
+           ankerl::nanobench::doNotOptimizeAway(m);
+       });
+
+    // sums of the values in 100 ranges of about 1000 keys each
+    std::map<uint64_t, uint64_t> stdMap(pairs.begin(), pairs.end());
+    uint64_t result = 0;
+    cfg.run("std::map 100 range scans", [&] {
+           uint64_t sum = 0;
+           for (uint64_t r = 0; r < 100; r++) {
+               auto last = stdMap.upper_bound(r * 6000 + 7000);
+               for (auto it = stdMap.lower_bound(r * 6000); it != last; ++it) {
+                   sum += it->second;
+               }
+           }
+           result = sum;
+       }).doNotOptimizeAway(&result);
+
+    cfg.run("persistent_sorted_map 100 range scans", [&] {
+           uint64_t sum = 0;
+           for (uint64_t r = 0; r < 100; r++) {
+               auto last = sorted->upper_bound(r * 6000 + 7000);
+               for (auto it = sorted->lower_bound(r * 6000); it != last; ++it) {
+                   sum += it->second;
+               }
+           }
+           result = sum;
+       }).doNotOptimizeAway(&result);
+
+    // the alternative without an ordered map: pick out and sort the
+    // keys in range
+    auto hashed = map_type::create(pairs.begin(), pairs.end());
+    cfg.run("persistent_map 100 range scans by filter and sort", [&] {
+           uint64_t sum = 0;
+           std::vector<std::pair<uint64_t, uint64_t>> range;
+           for (uint64_t r = 0; r < 100; r++) {
+               range.clear();
+               for (const auto& [key, val] : *hashed) {
+                   if (key >= r * 6000 && key <= r * 6000 + 7000) {
+                       range.emplace_back(key, val);
+                   }
+               }
+               std::sort(range.begin(), range.end());
+               for (const auto& pair : range) {
+                   sum += pair.second;
+               }
+           }
+           result = sum;
+       }).doNotOptimizeAway(&result);
+}
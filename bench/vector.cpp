@@ -0,0 +1,112 @@
+#include "nanobench.h"
+#include "rw/pdata/vector.h"
+
+#include <memory>
+#include <vector>
+
+void bench_vector(ankerl::nanobench::Config& cfg)
+{
+    using vector_type = rw::pdata::persistent_vector<uint64_t>;
+
+    cfg.run("std::vector push_back 10000", [&] {
+           std::vector<uint64_t> v;
+           for (uint64_t i = 0; i < 10000; i++) {
+               v.push_back(i);
+           }
+           ankerl::nanobench::doNotOptimizeAway(v);
+       });
+
+    std::shared_ptr<vector_type> v;
+    cfg.run("persistent_vector push_back 10000", [&] {
+           v = std::make_shared<vector_type>();
+           for (uint64_t i = 0; i < 10000; i++) {
+               v = v->push_back(i);
+           }
+       }).doNotOptimizeAway(&v);
+
+    cfg.run("transient_vector push_back 10000", [&] {
+           auto t = std::make_shared<vector_type>()->transient();
+           for (uint64_t i = 0; i < 10000; i++) {
+               t->push_back(i);
+           }
+           v = t->persistent();
+       }).doNotOptimizeAway(&v);
+
+    // an event log snapshotted after every 10 appends, copying the
+    // whole std::vector each time, against sharing the persistent one
+    std::vector<std::shared_ptr<const std::vector<uint64_t>>> copies;
+    cfg.run("std::vector copy-on-snapshot 10000, every 10", [&] {
+           copies.clear();
+           std::vector<uint64_t> log;
+           for (uint64_t i = 0; i < 10000; i++) {
+               log.push_back(i);
+               if (i % 10 == 9) {
+                   copies.push_back(
+                           std::make_shared<const std::vector<uint64_t>>(log));
+               }
+           }
+       }).doNotOptimizeAway(&copies);
+    copies.clear();
+
+    std::vector<std::shared_ptr<vector_type>> snapshots;
+    cfg.run("persistent_vector snapshot 10000, every 10", [&] {
+           snapshots.clear();
+           auto log = std::make_shared<vector_type>();
+           for (uint64_t i = 0; i < 10000; i += 10) {
+               auto t = log->transient();
+               for (uint64_t j = i; j < i + 10; j++) {
+                   t->push_back(j);
+               }
+               log = t->persistent();
+               snapshots.push_back(log);
+           }
+       }).doNotOptimizeAway(&snapshots);
+    snapshots.clear();
+
+    std::vector<uint64_t> values(100000);
+    for (uint64_t i = 0; i < values.size(); i++) {
+        values[i] = i * 7;
+    }
+    auto big = vector_type::create(values.begin(), values.end());
+
+    cfg.run("std::vector index 100000", [&] {
+           uint64_t sum = 0;
+           for (std::size_t i = 0; i < values.size(); i++) {
+               sum += values[i];
+           }
+           ankerl::nanobench::doNotOptimizeAway(sum);
+       });
+
+    cfg.run("persistent_vector index 100000", [&] {
+           uint64_t sum = 0;
+           for (std::size_t i = 0; i < big->size(); i++) {
+               sum += (*big)[i];
+           }
+           ankerl::nanobench::doNotOptimizeAway(sum);
+       });
+
+    cfg.run("persistent_vector iterate 100000", [&] {
+           uint64_t sum = 0;
+           for (auto val : *big) {
+               sum += val;
+           }
+           ankerl::nanobench::doNotOptimizeAway(sum);
+       });
+
+    cfg.run("std::vector concat 100000 + 100000", [&] {
+           std::vector<uint64_t> joined;
+           joined.reserve(2 * values.size());
+           joined.insert(joined.end(), values.begin(), values.end());
+           joined.insert(joined.end(), values.begin(), values.end());
+           ankerl::nanobench::doNotOptimizeAway(joined);
+       });
+
+    auto dropped = big->drop(12345);
+    cfg.run("persistent_vector concat 100000 + 87655", [&] {
+           v = big->concat(*dropped);
+       }).doNotOptimizeAway(&v);
+
+    cfg.run("persistent_vector slice 100000", [&] {
+           v = big->slice(12345, 87654);
+       }).doNotOptimizeAway(&v);
+}
@@ -0,0 +1,314 @@
+#ifndef RW_PDATA_ATOM_H
+#define RW_PDATA_ATOM_H
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace rw::pdata {
+
+// Hazard pointer reclamation. A reader publishes the pointer it's
+// about to use in a hazard slot, then checks it's still current;
+// retired objects are only deleted once no slot holds them. Readers
+// never lock or write to shared cache lines other than their own slot.
+//
+// This is the default reclaimer for atom. Other reclaimers provide
+// the same interface: a guard type, constructed on the reading thread,
+// whose protect(src) returns src's value and keeps it from being
+// deleted until the guard is reset or destroyed, and retire(p), which
+// deletes p once no guard protects it.
+class hazard_pointers
+{
+    struct record
+    {
+        std::atomic<const void*> ptr{nullptr};
+        std::atomic<bool> active{false};
+        record* next = nullptr;
+    };
+
+    struct retired
+    {
+        const void* ptr;
+        void (*destroy)(const void*);
+    };
+
+    struct domain
+    {
+        std::atomic<record*> head{nullptr};
+        std::atomic<std::size_t> records{0};
+
+        // retired objects, waiting for readers to move on
+        std::mutex mutex;
+        std::vector<retired> garbage;
+    };
+
+    // each thread keeps a record for its first guard, so taking a
+    // guard is usually just a store
+    struct thread_cache
+    {
+        ~thread_cache()
+        {
+            if (rec) {
+                release(rec);
+            }
+        }
+
+        record* rec = nullptr;
+        bool inUse = false;
+    };
+
+public:
+    class guard
+    {
+    public:
+        guard()
+        {
+            auto& cache = threadCache();
+            if (!cache.inUse) {
+                if (!cache.rec) {
+                    cache.rec = acquire();
+                }
+                cache.inUse = true;
+                cached = true;
+                rec = cache.rec;
+            } else {
+                rec = acquire();
+            }
+        }
+
+        ~guard()
+        {
+            reset();
+            if (cached) {
+                threadCache().inUse = false;
+            } else {
+                release(rec);
+            }
+        }
+
+        guard(const guard&) = delete;
+        guard& operator=(const guard&) = delete;
+
+        template <class T>
+        T* protect(const std::atomic<T*>& src) noexcept
+        {
+            auto p = src.load(std::memory_order_acquire);
+            for (;;) {
+                rec->ptr.store(p, std::memory_order_seq_cst);
+                auto current = src.load(std::memory_order_seq_cst);
+                if (current == p) {
+                    return p;
+                }
+                p = current;
+            }
+        }
+
+        void reset() noexcept { rec->ptr.store(nullptr, std::memory_order_release); }
+
+    private:
+        record* rec;
+        bool cached = false;
+    };
+
+    // deletes p once no guard protects it
+    template <class T>
+    static void retire(T* p)
+    {
+        auto& dom = instance();
+        std::vector<retired> unused;
+        {
+            std::lock_guard<std::mutex> lock{dom.mutex};
+            dom.garbage.push_back({p, [](const void* ptr) {
+                                       delete static_cast<const T*>(ptr);
+                                   }});
+            if (dom.garbage.size() < 2 * dom.records.load() + 16) {
+                return;
+            }
+            unused = scan(dom);
+        }
+
+        // deleted outside the lock, as it may free a lot
+        for (auto& r : unused) {
+            r.destroy(r.ptr);
+        }
+    }
+
+private:
+    static domain& instance()
+    {
+        // never destroyed, as atoms may be read or retired during
+        // static destruction
+        static auto dom = new domain;
+        return *dom;
+    }
+
+    static thread_cache& threadCache()
+    {
+        thread_local thread_cache cache;
+        return cache;
+    }
+
+    static record* acquire()
+    {
+        auto& dom = instance();
+        for (auto rec = dom.head.load(std::memory_order_acquire); rec;
+                rec = rec->next) {
+            bool inactive = false;
+            if (!rec->active.load(std::memory_order_relaxed) &&
+                    rec->active.compare_exchange_strong(inactive, true)) {
+                return rec;
+            }
+        }
+
+        auto rec = new record;
+        rec->active.store(true, std::memory_order_relaxed);
+        rec->next = dom.head.load(std::memory_order_relaxed);
+        while (!dom.head.compare_exchange_weak(rec->next, rec,
+                std::memory_order_release, std::memory_order_relaxed)) {
+        }
+        dom.records.fetch_add(1, std::memory_order_relaxed);
+        return rec;
+    }
+
+    static void release(record* rec) noexcept
+    {
+        rec->ptr.store(nullptr, std::memory_order_release);
+        rec->active.store(false, std::memory_order_release);
+    }
+
+    // Removes and returns the retired objects no guard protects.
+    // Called with the domain locked.
+    static std::vector<retired> scan(domain& dom)
+    {
+        std::vector<const void*> hazards;
+        for (auto rec = dom.head.load(std::memory_order_acquire); rec;
+                rec = rec->next) {
+            if (auto p = rec->ptr.load(std::memory_order_seq_cst)) {
+                hazards.push_back(p);
+            }
+        }
+        std::sort(hazards.begin(), hazards.end());
+
+        auto protectedEnd = std::partition(dom.garbage.begin(),
+                dom.garbage.end(), [&](const retired& r) {
+                    return std::binary_search(hazards.begin(), hazards.end(),
+                            r.ptr);
+                });
+
+        std::vector<retired> unused(protectedEnd, dom.garbage.end());
+        dom.garbage.erase(protectedEnd, dom.garbage.end());
+        return unused;
+    }
+};
+
+// Holds the current version of a persistent data structure, such as a
+// persistent_map, for sharing between threads. Readers load a snapshot
+// without locking, and writers replace it with compare and swap,
+// usually through swap(fn), which retries fn on the latest version
+// until it wins. Replaced versions are freed by the Reclaimer once no
+// reader is still looking at them.
+template <class Map, class Reclaimer = hazard_pointers>
+class atom
+{
+    // The shared_ptr can't be swapped atomically itself, so each
+    // version lives in a holder, and the holder pointer is swapped.
+    struct holder
+    {
+        std::shared_ptr<Map> value;
+    };
+
+public:
+    atom() :
+        atom(std::make_shared<Map>())
+    {}
+
+    explicit atom(std::shared_ptr<Map> init) :
+        current(new holder{std::move(init)})
+    {}
+
+    ~atom() { delete current.load(std::memory_order_acquire); }
+
+    atom(const atom&) = delete;
+    atom& operator=(const atom&) = delete;
+
+    // the current version
+    std::shared_ptr<Map> load() const
+    {
+        typename Reclaimer::guard guard;
+        return guard.protect(current)->value;
+    }
+
+    void store(std::shared_ptr<Map> desired)
+    {
+        auto old = current.exchange(new holder{std::move(desired)},
+                std::memory_order_seq_cst);
+        Reclaimer::retire(old);
+    }
+
+    // Replaces the current version with desired if it's expected. If
+    // not, returns false and sets expected to the current version.
+    bool compare_exchange(std::shared_ptr<Map>& expected,
+            std::shared_ptr<Map> desired)
+    {
+        typename Reclaimer::guard guard;
+        auto cur = guard.protect(current);
+        if (cur->value != expected) {
+            expected = cur->value;
+            return false;
+        }
+
+        // cur is protected, so its address can't be reused by a
+        // newer version while we swap
+        auto next = std::make_unique<holder>(holder{std::move(desired)});
+        if (!current.compare_exchange_strong(cur, next.get(),
+                    std::memory_order_seq_cst)) {
+            expected = load();
+            return false;
+        }
+
+        next.release();
+        Reclaimer::retire(cur);
+        return true;
+    }
+
+    // Replaces the current version with fn(current), retrying with the
+    // latest version if another thread got there first, so fn may run
+    // more than once and shouldn't have side effects. Returns the new
+    // version.
+    template <class Fn>
+    std::shared_ptr<Map> swap(Fn fn)
+    {
+        typename Reclaimer::guard guard;
+        std::unique_ptr<holder> next;
+        for (;;) {
+            auto cur = guard.protect(current);
+            std::shared_ptr<Map> updated = fn(cur->value);
+            if (updated == cur->value) {
+                return updated;
+            }
+
+            if (!next) {
+                next = std::make_unique<holder>();
+            }
+            // once it's published, next may be replaced and freed by
+            // another writer at any time, so don't touch it after
+            next->value = updated;
+            if (current.compare_exchange_strong(cur, next.get(),
+                        std::memory_order_seq_cst)) {
+                next.release();
+                Reclaimer::retire(cur);
+                return updated;
+            }
+        }
+    }
+
+private:
+    std::atomic<holder*> current;
+};
+
+} // namespace rw::pdata
+
+#endif // RW_PDATA_ATOM_H
@@ -0,0 +1,130 @@
+#ifndef RW_PDATA_HASH_H
+#define RW_PDATA_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace rw::pdata {
+
+// Transparent hash for string keys. Maps using it, such as
+// persistent_map<std::string, T, string_hash>, can be searched with a
+// std::string_view or C string without making a std::string. Hashes
+// match std::hash<std::string>.
+struct string_hash
+{
+    using is_transparent = void;
+
+    std::size_t operator()(std::string_view s) const noexcept
+    {
+        return std::hash<std::string_view>{}(s);
+    }
+};
+
+// A byte of a second hash of a key, independent of the map's Hash.
+// Keys whose full hashes collide share a hash_collision_node, which
+// keeps their fingerprints side by side and compares those before
+// comparing keys. Specialize it, with an operator() taking the key
+// (and any type it's looked up with), for other key types; without
+// one, collision nodes compare every key.
+template <class K, class = void>
+struct key_fingerprint
+{};
+
+template <class K>
+struct key_fingerprint<K, std::enable_if_t<std::is_integral_v<K>>>
+{
+    uint8_t operator()(K key) const noexcept
+    {
+        return uint8_t((uint64_t(key) * 0x9e3779b97f4a7c15ull) >> 56);
+    }
+};
+
+template <class K>
+struct key_fingerprint<K,
+        std::enable_if_t<std::is_convertible_v<const K&, std::string_view>>>
+{
+    // FNV-1a, folded to a byte
+    uint8_t operator()(std::string_view key) const noexcept
+    {
+        uint32_t h = 2166136261u;
+        for (unsigned char c : key) {
+            h = (h ^ c) * 16777619u;
+        }
+        return uint8_t(h ^ (h >> 8) ^ (h >> 16) ^ (h >> 24));
+    }
+};
+
+namespace detail {
+
+template <class K, class = void>
+inline constexpr bool has_fingerprint = false;
+
+template <class K>
+inline constexpr bool has_fingerprint<K,
+        std::void_t<decltype(key_fingerprint<K>{}(std::declval<const K&>()))>> =
+        true;
+
+// Finds the first i < count with prints[i] == print and match(i),
+// or returns -1. Sixteen (or with AVX2, 32) fingerprints are compared
+// at a time, so match, which compares keys, is mostly only called for
+// the right one.
+template <class Match>
+int scan_prints(const uint8_t* prints, std::size_t count, uint8_t print,
+        Match match)
+{
+    std::size_t i = 0;
+
+    // calls match for each set bit of a block's comparison mask
+    auto check = [&](uint32_t bits, std::size_t base) {
+        for (; bits; bits &= bits - 1) {
+            auto idx = base + __builtin_ctz(bits);
+            if (match(idx)) {
+                return int(idx);
+            }
+        }
+        return -1;
+    };
+
+#if defined(__AVX2__)
+    auto wide = _mm256_set1_epi8(char(print));
+    for (; i + 32 <= count; i += 32) {
+        auto block = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(prints + i));
+        auto bits = uint32_t(_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(block, wide)));
+        if (auto idx = check(bits, i); idx != -1) {
+            return idx;
+        }
+    }
+#endif
+#if defined(__SSE2__) || defined(__AVX2__)
+    auto narrow = _mm_set1_epi8(char(print));
+    for (; i + 16 <= count; i += 16) {
+        auto block = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(prints + i));
+        auto bits = uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(block, narrow)));
+        if (auto idx = check(bits, i); idx != -1) {
+            return idx;
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        if (prints[i] == print && match(i)) {
+            return int(i);
+        }
+    }
+    return -1;
+}
+
+} // namespace detail
+} // namespace rw::pdata
+
+#endif // RW_PDATA_HASH_H
@@ -2,13 +2,23 @@
 #define RW_PDATA_MAP_DETAIL_H
 
 #include "fmt/core.h"
-
+#include "rw/pdata/hash.h"
+#include "rw/pdata/policy.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <optional>
 #include <thread>
-#include <variant>
+#include <unordered_set>
+#include <vector>
 
 namespace rw::pdata::detail {
 
-using edit_type = std::weak_ptr<std::thread::id>;
 using hash_type = std::size_t;
 
 inline uint32_t mask(hash_type hash, uint32_t shift)
@@ -27,23 +37,106 @@ inline uint32_t popcount(uint32_t x)
     return __builtin_popcount(x);
 }
 
-inline bool sameEdit(const edit_type& a, const edit_type& b)
+// T for sets, which are maps whose nodes hold keys alone. All
+// set_values are equal, so a key's value never changes.
+struct set_value
 {
-    // a valid?
-    if (auto pa = a.lock()) {
-        if (auto pb = b.lock()) {
-            // both valid...compare
-            return *pa == *pb;
-        } else {
-            // a valid, b null
-            return false;
-        }
-    } else {
-        // return true only if b is null too
-        return !b.lock();
+    friend bool operator==(set_value, set_value) noexcept { return true; }
+    friend bool operator!=(set_value, set_value) noexcept { return false; }
+};
+
+// How nodes store an entry: as a key/value pair, or for sets, as the
+// key alone
+template <class K, class T>
+struct entry_traits
+{
+    using type = std::pair<K, T>;
+
+    static const K& key(const type& e) noexcept { return e.first; }
+    static const T& val(const type& e) noexcept { return e.second; }
+    static void setVal(type& e, const T& val) { e.second = val; }
+    static type make(const K& key, T val) { return {key, std::move(val)}; }
+
+    template <class Buffer>
+    static void dump(Buffer& msg, std::size_t i, const type& e)
+    {
+        fmt::format_to(msg, "{}: {}->{}\n", i, e.first, e.second);
+    }
+};
+
+template <class K>
+struct entry_traits<K, set_value>
+{
+    using type = K;
+
+    static const K& key(const K& e) noexcept { return e; }
+    static set_value val(const K&) noexcept { return {}; }
+    static void setVal(K&, set_value) noexcept {}
+    static K make(const K& key, set_value) { return key; }
+
+    template <class Buffer>
+    static void dump(Buffer& msg, std::size_t i, const K& e)
+    {
+        fmt::format_to(msg, "{}: {}\n", i, e);
     }
+};
+
+// Rearranges a hash's 5 bit slot numbers so the first level's is the
+// most significant. Sorting hashes by this groups them by subtree,
+// from the root down.
+inline hash_type trie_order(hash_type hash) noexcept
+{
+    constexpr uint32_t bits = sizeof(hash_type) * 8;
+
+    hash_type order = 0;
+    for (uint32_t shift = 0; shift < bits; shift += 5) {
+        auto width = std::min<uint32_t>(5, bits - shift);
+        order = (order << width) | ((hash >> shift) & ((hash_type{1} << width) - 1));
+    }
+    return order;
+}
+
+// an item of a batch, with the hash of its key
+template <class E>
+struct hashed_item
+{
+    hash_type order;
+    hash_type hash;
+    const E* item;
+};
+
+// Hashes a batch of items, returning them in trie order. Items with
+// the same hash stay in the order they were given.
+template <class Hash, class E, class KeyOf>
+std::vector<hashed_item<E>> trie_sorted(const std::vector<E>& items,
+        KeyOf keyOf)
+{
+    std::vector<hashed_item<E>> sorted;
+    sorted.reserve(items.size());
+    for (const auto& item : items) {
+        auto hash = Hash{}(keyOf(item));
+        sorted.push_back({trie_order(hash), hash, &item});
+    }
+
+    std::sort(sorted.begin(), sorted.end(),
+            [](const hashed_item<E>& a, const hashed_item<E>& b) {
+                return a.order < b.order ||
+                       (a.order == b.order && a.item < b.item);
+            });
+    return sorted;
 }
 
+// contiguous range of entries in a node
+template <class E>
+struct span
+{
+    E* first;
+    E* last;
+    E* begin() const noexcept { return first; }
+    E* end() const noexcept { return last; }
+    std::size_t size() const noexcept { return last - first; }
+};
+
 template <class A, class T>
 A setDup(const A& arr, std::size_t idx, const T& val)
 {
@@ -52,498 +145,1103 @@ A setDup(const A& arr, std::size_t idx, const T& val)
     return dup;
 }
 
-template <class K, class T, class Hash>
-class node : public std::enable_shared_from_this<node<K, T, Hash>>
+enum class node_kind : uint8_t
+{
+    bitmap_indexed,
+    array,
+    hash_collision
+};
+
+template <class K, class T, class Hash, class Policy>
+struct trie_lookup;
+
+// The new value for a key being updated in place: its old value
+// changed, or if it isn't there, its initial value, or none to leave
+// it out
+template <class T>
+class value_updater
+{
+public:
+    virtual T updated(const T& old) = 0;
+    virtual const T* initial() const noexcept = 0;
+
+protected:
+    ~value_updater() = default;
+};
+
+// value_updater calling fn(old), for the maps' update() and upsert()
+template <class T, class F>
+class fn_updater final : public value_updater<T>
+{
+public:
+    fn_updater(F& fn, const T* init) noexcept :
+        fn(fn),
+        init(init)
+    {}
+
+    T updated(const T& old) override { return fn(old); }
+    const T* initial() const noexcept override { return init; }
+
+private:
+    F& fn;
+    const T* init;
+};
+
+template <class N, class... Args>
+ref_ptr<N> make_node(Args&&... args)
+{
+    void* mem = N::allocate(sizeof(N));
+    try {
+        return ref_ptr<N>{new (mem) N(std::forward<Args>(args)...)};
+    } catch (...) {
+        N::deallocate(mem, sizeof(N));
+        throw;
+    }
+}
+
+template <class K, class T, class Hash, class Policy = shared_policy>
+class node
 {
 public:
-    using value_type = std::pair<K, T>;
-    using shared_node = std::shared_ptr<node>;
-    using entry_type = std::variant<value_type, shared_node>;
+    using traits = entry_traits<K, T>;
+    using value_type = typename traits::type;
+    using node_ptr = ref_ptr<node>;
 
     virtual ~node() = default;
 
-    virtual shared_node assoc(uint32_t shift, hash_type hash,
-            const entry_type& newEntry, bool& addedLeaf) = 0;
-    virtual shared_node without(uint32_t shift, hash_type hash,
+    node_kind kind() const noexcept { return m_kind; }
+
+    void retain() const noexcept { refs.inc(); }
+    void release() const noexcept
+    {
+        if (refs.dec()) {
+            Policy::reclaimer_type::retire(const_cast<node*>(this),
+                    &node::reclaim);
+        }
+    }
+
+    // references to the node, for a holder of one to tell whether it's
+    // the last
+    uint32_t use_count() const noexcept { return refs.use_count(); }
+
+    // node memory comes from the policy's allocator
+    static void* allocate(std::size_t size)
+    {
+        return Policy::allocator_type::allocate(size);
+    }
+
+    static void deallocate(void* p, std::size_t size) noexcept
+    {
+        Policy::allocator_type::deallocate(p, size);
+    }
+
+    virtual node_ptr assoc(uint32_t shift, hash_type hash,
+            const value_type& newValue, bool& addedLeaf) = 0;
+    virtual node_ptr without(uint32_t shift, hash_type hash,
             const K& key) = 0;
 
-    virtual std::optional<entry_type> find(uint32_t shift, hash_type hash,
-            const K& key) const = 0;
+    // Replaces key's value with updater's, in the same descent that
+    // finds it, so the key is hashed and its path copied once
+    virtual node_ptr update(uint32_t shift, hash_type hash, const K& key,
+            value_updater<T>& updater, bool& addedLeaf) = 0;
 
     // transient funcs
-    virtual shared_node assoc(const edit_type& edit, uint32_t shift, hash_type hash,
-            const entry_type& newEntry, bool& addedLeaf) = 0;
-    virtual shared_node without(const edit_type& edit, uint32_t shift, hash_type hash,
+    virtual node_ptr assoc(edit_type edit, uint32_t shift, hash_type hash,
+            const value_type& newValue, bool& addedLeaf) = 0;
+    virtual node_ptr without(edit_type edit, uint32_t shift, hash_type hash,
             const K& key, bool& removedLeaf) = 0;
-
-    // todo: iterator(handler iterHandler) atom.SeqIterator
+    virtual node_ptr update(edit_type edit, uint32_t shift, hash_type hash,
+            const K& key, value_updater<T>& updater, bool& addedLeaf) = 0;
+
+    // Compares this subtree with other, for maps of equal size. With
+    // the canonical encoding equal maps have equal tries, so other is
+    // the node at the same position and the shapes are compared
+    // directly. Otherwise, this checks that every value here is also
+    // in other, a node at otherShift on the path to this position.
+    // Either way, shared subtrees are skipped.
+    virtual bool equiv(const node* other, uint32_t shift,
+            uint32_t otherShift) const = 0;
+
+    // subtree at slot idx, or null if it's empty or holds a value
+    virtual const node* child(uint32_t idx) const noexcept = 0;
+
+    // The node's values, and its subtrees (which may include nulls),
+    // used by iterators
+    virtual span<const value_type> data() const noexcept = 0;
+    virtual span<const node_ptr> nodes() const noexcept = 0;
 
     virtual std::string dump(int indent) const = 0;
 
+    // Bytes allocated for the node, including any arrays it owns, but
+    // not its subtrees or anything its values allocate themselves
+    virtual std::size_t allocated() const noexcept = 0;
+
 protected:
-    template <typename Derived>
-    std::shared_ptr<Derived> shared_from_base()
+    explicit node(node_kind kind, uint32_t refs = 0) noexcept :
+        refs(refs),
+        m_kind(kind)
+    {}
+
+    // update() on a node where key would go but isn't: adds it with its
+    // initial value, if any
+    node_ptr updateMissing(uint32_t shift, hash_type hash, const K& key,
+            value_updater<T>& updater, bool& addedLeaf)
+    {
+        auto initial = updater.initial();
+        if (!initial) {
+            return this;
+        }
+        return assoc(shift, hash, traits::make(key, *initial), addedLeaf);
+    }
+
+    node_ptr updateMissing(edit_type edit, uint32_t shift, hash_type hash,
+            const K& key, value_updater<T>& updater, bool& addedLeaf)
+    {
+        auto initial = updater.initial();
+        if (!initial) {
+            return this;
+        }
+        return assoc(edit, shift, hash, traits::make(key, *initial),
+                addedLeaf);
+    }
+
+    static bool containsValue(const node* other, uint32_t otherShift,
+            hash_type hash, const value_type& value)
+    {
+        auto found = trie_lookup<K, T, Hash, Policy>::find(other, otherShift,
+                hash, traits::key(value));
+        return found && traits::val(*found) == traits::val(value);
+    }
+
+    // the node to compare a child at slot idx of a node at shift with
+    static std::pair<const node*, uint32_t> counterpart(const node* other,
+            uint32_t otherShift, uint32_t shift, uint32_t idx) noexcept
+    {
+        if (otherShift == shift) {
+            if (auto sub = other->child(idx)) {
+                return {sub, shift + 5};
+            }
+        }
+        return {other, otherShift};
+    }
+
+    // Destroys and frees the node once the last reference is gone.
+    // Each node type knows the size it was allocated with.
+    virtual void destroy() noexcept = 0;
+
+    // destroys a node the policy's reclaimer was given by release()
+    static void reclaim(void* n) noexcept
     {
-        return std::static_pointer_cast<Derived>(this->shared_from_this());
+        static_cast<node*>(n)->destroy();
     }
+
+private:
+    // the count is embedded in the node, so each node is a single
+    // allocation, and whether it's atomic is up to the policy
+    mutable typename Policy::refcount_type refs;
+    const node_kind m_kind;
 };
 
 // forwards
-template <class K, class T, class Hash>
+template <class K, class T, class Hash, class Policy = shared_policy>
 class array_node;
-template <class K, class T, class Hash>
+template <class K, class T, class Hash, class Policy = shared_policy>
 class hash_collision_node;
+template <class K, class T, class Hash, class Policy = shared_policy>
+class trie_builder;
+template <class K, class T, class Hash, class Policy, class Resolve>
+class trie_merger;
+template <class K, class T, class Hash, class Policy>
+class trie_filter;
+
+// What's in one slot of a bitmap_indexed_node or array_node: a value,
+// a subtree, or neither
+template <class K, class T, class Hash, class Policy>
+struct node_slot
+{
+    const typename node<K, T, Hash, Policy>::value_type* value = nullptr;
+    const typename node<K, T, Hash, Policy>::node_ptr* child = nullptr;
+
+    // the value's hash, if the policy memoizes them
+    const hash_type* memo = nullptr;
+
+    hash_type hash() const
+    {
+        return memo ? *memo
+                    : Hash{}(entry_traits<K, T>::key(*value));
+    }
+};
 
-template <class K, class T, class Hash>
-class bitmap_indexed_node final : public node<K, T, Hash>
+template <class K, class T, class Hash, class Policy>
+node_slot<K, T, Hash, Policy> slot_at(const node<K, T, Hash, Policy>* n,
+        uint32_t idx) noexcept;
+
+template <class K, class T, class Hash, class Policy>
+ref_ptr<node<K, T, Hash, Policy>> assemble_node(
+        const std::array<node_slot<K, T, Hash, Policy>, 32>& vals,
+        std::array<ref_ptr<node<K, T, Hash, Policy>>, 32>& kids,
+        uint32_t shift);
+
+template <class K, class T, class Hash, class Policy = shared_policy>
+class bitmap_indexed_node final : public node<K, T, Hash, Policy>
 {
-    using Base = node<K, T, Hash>;
-    using hcn_node = hash_collision_node<K, T, Hash>;
-    using arr_node = array_node<K, T, Hash>;
+    using Base = node<K, T, Hash, Policy>;
+    using traits = typename Base::traits;
+    using hcn_node = hash_collision_node<K, T, Hash, Policy>;
+    using arr_node = array_node<K, T, Hash, Policy>;
+
+    struct pinned_tag
+    {};
 
 public:
     using value_type = typename Base::value_type;
-    using shared_node = typename Base::shared_node;
-    using entry_type = typename Base::entry_type;
+    using node_ptr = typename Base::node_ptr;
+    using bin_ptr = ref_ptr<bitmap_indexed_node>;
 
-    using array_type = std::vector<entry_type>;
+    static_assert(alignof(value_type) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__,
+            "over-aligned values are not supported");
 
-    bitmap_indexed_node(const edit_type& edit) :
+    bitmap_indexed_node(edit_type edit) :
+        Base(node_kind::bitmap_indexed),
         edit(edit)
     {}
 
-    bitmap_indexed_node(const edit_type& edit, uint32_t bitmap, array_type&& array) :
-        edit(edit),
-        bitmap(bitmap),
-        array(std::move(array))
-    {}
+    ~bitmap_indexed_node()
+    {
+        std::destroy_n(values(), popcount(datamap));
+        std::destroy_n(children(), popcount(nodemap));
+    }
 
-    shared_node assoc(uint32_t shift, hash_type hash,
-            const entry_type& newEntry, bool& addedLeaf)
+    node_ptr assoc(uint32_t shift, hash_type hash,
+            const value_type& newValue, bool& addedLeaf)
     {
         auto bit = bitpos(hash, shift);
-        auto idx = index(bit);
 
         // is it maybe already present?
-        if (bitmap & bit) {
-            auto entry = array[idx];
-            if (auto node = std::get_if<shared_node>(&entry)) {
-                auto n = (*node)->assoc(shift + 5, hash, newEntry, addedLeaf);
-                if (n == *node) {
-                    return this->shared_from_this();
+        if (datamap & bit) {
+            auto idx = dataIndex(bit);
+            const auto& value = values()[idx];
+
+            // same key?
+            if (keyAt(idx, hash, traits::key(newValue))) {
+                if (traits::val(value) == traits::val(newValue)) {
+                    return this;
                 }
 
-                // make a new bitmap_indexed_node, setting the new node in the array
-                return std::make_shared<bitmap_indexed_node>(edit_type{}, bitmap,
-                        setDup(array, idx, n));
-            } else {
-                auto value = std::get<value_type>(entry);
-                auto newValue = std::get<value_type>(newEntry);
+                // make a new bitmap_indexed_node, setting the item's val
+                auto dup = copy(edit_type{}, 0, 0);
+                traits::setVal(dup->values()[idx], traits::val(newValue));
+                return dup;
+            }
 
-                // same key?
-                if (value.first == newValue.first) {
-                    if (value.second == newValue.second) {
-                        return this->shared_from_this();
-                    }
+            // new item, rather than a replacement; push both down a level
+            addedLeaf = true;
+            auto child = createNode(shift + 5, hashAt(idx), value, hash,
+                    newValue);
+            auto dup = copy(edit_type{}, 0, 1);
+            dup->migrateToNode(bit, std::move(child));
+            return dup;
+        } else if (nodemap & bit) {
+            auto idx = nodeIndex(bit);
+            const auto& child = children()[idx];
+            auto n = child->assoc(shift + 5, hash, newValue, addedLeaf);
+            if (n == child) {
+                return this;
+            }
 
-                    // make a new bitmap_indexed_node, setting the item in the array
-                    return std::make_shared<bitmap_indexed_node>(edit_type{},
-                            bitmap, setDup(array, idx, newEntry));
-                }
+            // make a new bitmap_indexed_node, setting the new node
+            auto dup = copy(edit_type{}, 0, 0);
+            dup->children()[idx] = std::move(n);
+            return dup;
+        }
 
-                // new item, rather than a replacement
-                addedLeaf = true;
-                return std::make_shared<bitmap_indexed_node>(edit_type{}, bitmap,
-                        setDup(array, idx, createNode(shift + 5, value, hash, newValue)));
-            }
-        } else {
-            // not present
-
-            // if we have 16 or more values, promote the node to an array_node
-            // containing new bitmap_indexed_node wrapping each value
-            auto n = popcount(bitmap);
-            if (n >= 16) {
-                auto jdx = mask(hash, shift);
-                typename arr_node::array_type newArray;
-                newArray[jdx] = emptyBin.assoc(shift + 5, hash, newEntry,
-                        addedLeaf);
-
-                auto src = array.cbegin();
-                for (uint32_t i = 0; i < 32; i++) {
-                    if ((bitmap >> i) & 1) {
-                        if (auto node = std::get_if<shared_node>(&*src)) {
-                            newArray[i] = *node;
-                        } else {
-                            auto value = std::get<value_type>(*src);
-                            newArray[i] = emptyBin.assoc(shift + 5,
-                                    Hash{}(value.first), value,
-                                    addedLeaf);
-                        }
-                        src++;
-                    }
-                }
+        // not present
 
-                return std::make_shared<arr_node>(edit_type{}, n + 1,
-                        std::move(newArray));
-            } else {
-                // insert at idx
-                addedLeaf = true;
-                // todo...optimize?
-                array_type newArray{array};
-                newArray.insert(newArray.cbegin() + idx, newEntry);
-                return std::make_shared<bitmap_indexed_node>(edit_type{},
-                        bitmap | bit, std::move(newArray));
-            }
+        // if we have 16 or more entries, promote the node to an array_node,
+        // unless using the canonical encoding
+        if (!Policy::canonical && node_count() >= 16) {
+            return promote(edit_type{}, shift, hash, newValue, addedLeaf);
         }
+
+        addedLeaf = true;
+        auto dup = copy(edit_type{}, 1, 0);
+        dup->insertValue(bit, hash, newValue);
+        return dup;
     }
 
-    shared_node without(uint32_t shift, hash_type hash, const K& key)
+    node_ptr update(uint32_t shift, hash_type hash, const K& key,
+            value_updater<T>& updater, bool& addedLeaf)
     {
         auto bit = bitpos(hash, shift);
-        if (!(bitmap & bit)) {
-            return this->shared_from_this();
-        }
-
-        auto idx = index(bit);
-        auto entry = array[idx];
-        if (auto node = std::get_if<shared_node>(&entry)) {
-            auto n = (*node)->without(shift + 5, hash, key);
-            if (n == *node) {
-                return this->shared_from_this();
-            } else if (*node) {
-                // make a new bitmap_indexed_node, setting the new node in the array
-                return std::make_shared<bitmap_indexed_node>(edit_type{}, bitmap,
-                        setDup(array, idx, n));
-            } else if (bitmap == bit) {
-                return {};
-            } else {
-                // remove element
-                array_type newArray(array.size() - 1);
-                auto abegin = array.cbegin();
-                std::copy_n(abegin, idx, newArray.begin());
-                std::copy(abegin + idx + 1, array.cend(), newArray.begin() + idx);
-                return std::make_shared<bitmap_indexed_node>(edit_type{},
-                        bitmap ^ bit, std::move(newArray));
-            }
-        } else {
-            auto value = std::get<value_type>(entry);
-            if (value.first == key) {
-                if (bitmap == bit) {
-                    return {};
+        if (datamap & bit) {
+            auto idx = dataIndex(bit);
+            if (keyAt(idx, hash, key)) {
+                const auto& old = traits::val(values()[idx]);
+                auto val = updater.updated(old);
+                if (val == old) {
+                    return this;
                 }
 
-                // remove element
-                array_type newArray(array.size() - 1);
-                auto abegin = array.cbegin();
-                std::copy_n(abegin, idx, newArray.begin());
-                std::copy(abegin + idx + 1, array.cend(), newArray.begin() + idx);
-                return std::make_shared<bitmap_indexed_node>(edit_type{},
-                        bitmap ^ bit, std::move(newArray));
+                auto dup = copy(edit_type{}, 0, 0);
+                traits::setVal(dup->values()[idx], val);
+                return dup;
+            }
+        } else if (nodemap & bit) {
+            auto idx = nodeIndex(bit);
+            const auto& child = children()[idx];
+            auto n = child->update(shift + 5, hash, key, updater, addedLeaf);
+            if (n == child) {
+                return this;
             }
 
-            return this->shared_from_this();
+            auto dup = copy(edit_type{}, 0, 0);
+            dup->children()[idx] = std::move(n);
+            return dup;
         }
+
+        return this->updateMissing(shift, hash, key, updater, addedLeaf);
     }
 
-    std::optional<entry_type> find(uint32_t shift, hash_type hash,
-            const K& key) const
+    node_ptr without(uint32_t shift, hash_type hash, const K& key)
     {
         auto bit = bitpos(hash, shift);
-        if (bitmap & bit) {
-            auto idx = index(bit);
-            const auto& entry = array[idx];
+        if (datamap & bit) {
+            if (!keyAt(dataIndex(bit), hash, key)) {
+                return this;
+            }
+            if (datamap == bit && !nodemap) {
+                return {};
+            }
 
-            if (auto node = std::get_if<shared_node>(&entry)) {
-                return (*node)->find(shift + 5, hash, key);
-            } else {
-                auto value = std::get<value_type>(entry);
-                if (key == value.first) {
-                    return entry;
+            // remove element
+            auto dup = copy(edit_type{}, 0, 0);
+            dup->eraseValue(bit);
+            return dup->canonical(shift);
+        } else if (nodemap & bit) {
+            auto idx = nodeIndex(bit);
+            const auto& child = children()[idx];
+            auto n = child->without(shift + 5, hash, key);
+            if (n == child) {
+                return this;
+            } else if (n) {
+                if (auto single = singleValue(n)) {
+                    // pull the child's last value up into this node
+                    auto dup = copy(edit_type{}, 1, 0);
+                    dup->migrateToData(bit, *single);
+                    return dup;
                 }
+
+                // make a new bitmap_indexed_node, setting the new node
+                auto dup = copy(edit_type{}, 0, 0);
+                dup->children()[idx] = std::move(n);
+                return dup->canonical(shift);
+            } else if (nodemap == bit && !datamap) {
+                return {};
             }
+
+            // remove element
+            auto dup = copy(edit_type{}, 0, 0);
+            dup->eraseChild(bit);
+            return dup->canonical(shift);
         }
 
-        return std::nullopt;
+        return this;
     }
 
-    shared_node assoc(const edit_type& edit, uint32_t shift, hash_type hash,
-            const entry_type& newEntry, bool& addedLeaf)
+    node_ptr assoc(edit_type edit, uint32_t shift, hash_type hash,
+            const value_type& newValue, bool& addedLeaf)
     {
         auto bit = bitpos(hash, shift);
-        auto idx = index(bit);
 
         // is it maybe already present?
-        if (bitmap & bit) {
-            auto entry = array[idx];
-            if (auto node = std::get_if<shared_node>(&entry)) {
-                auto n = (*node)->assoc(edit, shift + 5, hash, newEntry, addedLeaf);
-                if (n == *node) {
-                    return this->shared_from_this();
+        if (datamap & bit) {
+            auto idx = dataIndex(bit);
+            const auto& value = values()[idx];
+
+            // same key?
+            if (keyAt(idx, hash, traits::key(newValue))) {
+                if (traits::val(value) == traits::val(newValue)) {
+                    return this;
                 }
 
-                auto editable = ensureEditable(edit);
-                editable->array[idx] = n;
+                auto editable = ensureEditable(edit, 0, 0);
+                traits::setVal(editable->values()[idx],
+                        traits::val(newValue));
                 return editable;
-            } else {
-                auto value = std::get<value_type>(entry);
-                auto newValue = std::get<value_type>(newEntry);
+            }
 
-                // same key?
-                if (value.first == newValue.first) {
-                    if (value.second == newValue.second) {
-                        return this->shared_from_this();
-                    }
+            // new item, rather than a replacement
+            addedLeaf = true;
+            auto child = createNode(edit, shift + 5, hashAt(idx), value, hash,
+                    newValue);
+            auto editable = ensureEditable(edit, 0, 1);
+            editable->migrateToNode(bit, std::move(child));
+            return editable;
+        } else if (nodemap & bit) {
+            auto idx = nodeIndex(bit);
+            const auto& child = children()[idx];
+            auto n = child->assoc(edit, shift + 5, hash, newValue, addedLeaf);
+            if (n == child) {
+                return this;
+            }
 
-                    auto editable = ensureEditable(edit);
-                    editable->array[idx] = newValue;
-                    return editable;
+            auto editable = ensureEditable(edit, 0, 0);
+            editable->children()[idx] = std::move(n);
+            return editable;
+        }
+
+        // not present
+
+        // if we have 16 or more entries, promote the node to an array_node,
+        // unless using the canonical encoding
+        if (!Policy::canonical && node_count() >= 16) {
+            return promote(edit, shift, hash, newValue, addedLeaf);
+        }
+
+        addedLeaf = true;
+        auto editable = ensureEditable(edit, 1, 0);
+        editable->insertValue(bit, hash, newValue);
+        return editable;
+    }
+
+    node_ptr update(edit_type edit, uint32_t shift, hash_type hash,
+            const K& key, value_updater<T>& updater, bool& addedLeaf)
+    {
+        auto bit = bitpos(hash, shift);
+        if (datamap & bit) {
+            auto idx = dataIndex(bit);
+            if (keyAt(idx, hash, key)) {
+                const auto& old = traits::val(values()[idx]);
+                auto val = updater.updated(old);
+                if (val == old) {
+                    return this;
                 }
 
-                // new item, rather than a replacement
-                addedLeaf = true;
-                auto editable = ensureEditable(edit);
-                editable->array[idx] = createNode(edit, shift + 5,
-                        value, hash, newValue);
+                auto editable = ensureEditable(edit, 0, 0);
+                traits::setVal(editable->values()[idx], val);
                 return editable;
             }
-        } else {
-            // not present
+        } else if (nodemap & bit) {
+            auto idx = nodeIndex(bit);
+            const auto& child = children()[idx];
+            auto n = child->update(edit, shift + 5, hash, key, updater,
+                    addedLeaf);
+            if (n == child) {
+                return this;
+            }
 
-            auto n = popcount(bitmap);
+            auto editable = ensureEditable(edit, 0, 0);
+            editable->children()[idx] = std::move(n);
+            return editable;
+        }
 
-            // does array have space for this item, or do we have
-            // less than 16 elements?
-            if (n < array.capacity() || n < 16) {
-                auto editable = ensureEditable(edit);
+        return this->updateMissing(edit, shift, hash, key, updater,
+                addedLeaf);
+    }
 
-                // insert at idx
-                addedLeaf = true;
-                editable->array.insert(editable->array.cbegin() + idx, newEntry);
-                editable->bitmap |= bit;
-                return editable;
-            } else {
-                // we have 16 or more values, promote the node to an array_node
-                // containing a new bitmapIndexedNode with the val in it
-                auto jdx = mask(hash, shift);
-                typename arr_node::array_type newArray;
-                newArray[jdx] = emptyBin.assoc(edit, shift + 5, hash, newEntry,
-                        addedLeaf);
-
-                auto src = array.begin();
-                for (uint32_t i = 0; i < 32; i++) {
-                    if ((bitmap >> i) & 1) {
-                        if (auto node = std::get_if<shared_node>(&*src)) {
-                            newArray[i] = *node;
-                        } else {
-                            auto value = std::get<value_type>(*src);
-                            newArray[i] = emptyBin.assoc(edit, shift + 5,
-                                    Hash{}(value.first), value,
-                                    addedLeaf);
-                        }
-                        src++;
-                    }
+    node_ptr without(edit_type edit, uint32_t shift, hash_type hash,
+            const K& key, bool& removedLeaf)
+    {
+        auto bit = bitpos(hash, shift);
+        if (datamap & bit) {
+            if (!keyAt(dataIndex(bit), hash, key)) {
+                return this;
+            }
+
+            removedLeaf = true;
+            if (datamap == bit && !nodemap) {
+                return {};
+            }
+
+            // remove element
+            auto editable = ensureEditable(edit, 0, 0);
+            editable->eraseValue(bit);
+            return editable->canonical(shift);
+        } else if (nodemap & bit) {
+            auto idx = nodeIndex(bit);
+            const auto& child = children()[idx];
+            auto n = child->without(edit, shift + 5, hash, key, removedLeaf);
+            if (n == child && !singleValue(n)) {
+                // unchanged, or edited in place
+                return this;
+            } else if (n) {
+                if (auto single = singleValue(n)) {
+                    // pull the child's last value up into this node
+                    auto editable = ensureEditable(edit, 1, 0);
+                    editable->migrateToData(bit, *single);
+                    return editable;
                 }
 
-                return std::make_shared<arr_node>(edit, n + 1,
-                        std::move(newArray));
+                auto editable = ensureEditable(edit, 0, 0);
+                editable->children()[idx] = std::move(n);
+                return editable->canonical(shift);
+            } else if (nodemap == bit && !datamap) {
+                return {};
             }
+
+            // remove element
+            auto editable = ensureEditable(edit, 0, 0);
+            editable->eraseChild(bit);
+            return editable->canonical(shift);
         }
+
+        return this;
     }
 
-    shared_node without(const edit_type& edit, uint32_t shift, hash_type hash,
-            const K& key, bool& removedLeaf)
+    bool equiv(const Base* other, uint32_t shift, uint32_t otherShift) const
     {
-        auto bit = bitpos(hash, shift);
-        if (!(bitmap & bit)) {
-            return this->shared_from_this();
+        if (this == other) {
+            return true;
         }
 
-        auto idx = index(bit);
-        auto entry = array[idx];
-        if (auto node = std::get_if<shared_node>(&entry)) {
-            auto n = (*node)->without(edit, shift + 5, hash, key, removedLeaf);
-            if (n == *node) {
-                return this->shared_from_this();
-            } else if (*node) {
-                auto editable = ensureEditable(edit);
-                editable->array[idx] = n;
-                return editable;
-            } else if (bitmap == bit) {
-                return {};
-            } else {
-                // remove element
-                auto editable = ensureEditable(edit);
-                editable->bitmap ^= bit;
-                editable->array.erase(editable->array.cbegin() + idx);
-                return editable;
+        if constexpr (Policy::canonical) {
+            if (other->kind() != node_kind::bitmap_indexed) {
+                return false;
+            }
+
+            auto o = static_cast<const bitmap_indexed_node*>(other);
+            if (datamap != o->datamap || nodemap != o->nodemap) {
+                return false;
+            }
+
+            auto ovalue = o->values();
+            for (const auto& value : data()) {
+                if (!(traits::key(value) == traits::key(*ovalue) &&
+                            traits::val(value) == traits::val(*ovalue))) {
+                    return false;
+                }
+                ovalue++;
+            }
+
+            auto ochild = o->children();
+            for (const auto& child : nodes()) {
+                if (!child->equiv(ochild->get(), shift + 5, shift + 5)) {
+                    return false;
+                }
+                ochild++;
             }
         } else {
-            auto value = std::get<value_type>(entry);
-            if (value.first == key) {
-                // remove element
-                removedLeaf = true;
-                auto editable = ensureEditable(edit);
-                editable->bitmap ^= bit;
-                editable->array.erase(editable->array.cbegin() + idx);
-                return editable;
-            } else {
-                return this->shared_from_this();
+            auto len = popcount(datamap);
+            for (uint32_t idx = 0; idx < len; idx++) {
+                if (!Base::containsValue(other, otherShift, hashAt(idx),
+                            values()[idx])) {
+                    return false;
+                }
+            }
+
+            auto kid = children();
+            for (uint32_t i = 0; i < 32; i++) {
+                if (nodemap & (1u << i)) {
+                    auto [o, oshift] = Base::counterpart(other, otherShift,
+                            shift, i);
+                    if (!(*kid++)->equiv(o, shift + 5, oshift)) {
+                        return false;
+                    }
+                }
             }
         }
+
+        return true;
+    }
+
+    span<const value_type> data() const noexcept
+    {
+        return {values(), values() + popcount(datamap)};
     }
 
-    // todo: iterator(handler iterHandler) atom.SeqIterator
+    span<const node_ptr> nodes() const noexcept
+    {
+        return {children(), children() + popcount(nodemap)};
+    }
+
+    const Base* child(uint32_t idx) const noexcept
+    {
+        uint32_t bit = 1u << idx;
+        return nodemap & bit ? children()[nodeIndex(bit)].get() : nullptr;
+    }
+
+    std::size_t allocated() const noexcept
+    {
+        return allocSize(dataCap, nodeCap);
+    }
 
     std::string dump(int indent) const
     {
         fmt::memory_buffer msg;
 
         fmt::format_to(msg, "bin\n");
-        for (std::size_t i = 0; i < array.size(); i++) {
-            const auto& entry = array[i];
+        int i = 0;
+        for (const auto& value : data()) {
             for (int idt = 0; idt < indent; idt++) {
                 fmt::format_to(msg, " ");
             }
-            if (auto node = std::get_if<shared_node>(&entry)) {
-                fmt::format_to(msg, "{}: {}", i,
-                        (*node)->dump(indent + 1));
-            } else {
-                auto value = std::get<value_type>(entry);
-                fmt::format_to(msg, "{}: {}->{}\n", i, value.first, value.second);
+            traits::dump(msg, i++, value);
+        }
+        for (const auto& child : nodes()) {
+            for (int idt = 0; idt < indent; idt++) {
+                fmt::format_to(msg, " ");
             }
+            fmt::format_to(msg, "{}: {}", i++, child->dump(indent + 1));
         }
 
         return fmt::to_string(msg);
     }
 
-    int node_count() const noexcept { return popcount(bitmap); }
+    int node_count() const noexcept { return popcount(datamap | nodemap); }
 
     // Empty bitmap_indexed_node, used to create subsequent nodes.
     // This saves creating a new node every time; as changes are
     // made to this node, copies are returned rather than modifying
-    // this node itself. The edit is a null id, so it doesn't
-    // match any actual thread
-    inline static bitmap_indexed_node emptyBin{edit_type{}};
+    // this node itself. The edit is zero, so it doesn't
+    // match any transient. It starts with a reference held,
+    // so it is never freed.
+    inline static bitmap_indexed_node emptyBin{pinned_tag{}};
 
 private:
-    int index(uint32_t bit) const noexcept
+    friend arr_node;
+    friend hcn_node;
+    friend trie_builder<K, T, Hash, Policy>;
+    template <class, class, class, class, class>
+    friend class trie_merger;
+    friend trie_filter<K, T, Hash, Policy>;
+    friend trie_lookup<K, T, Hash, Policy>;
+    friend node_slot<K, T, Hash, Policy> slot_at<>(const Base* n,
+            uint32_t idx) noexcept;
+    friend ref_ptr<Base> assemble_node<>(
+            const std::array<node_slot<K, T, Hash, Policy>, 32>& vals,
+            std::array<node_ptr, 32>& kids, uint32_t shift);
+
+    // Values and children live in the same allocation as the node,
+    // values first, then children, each in bit order, then the
+    // values' hashes if the policy memoizes them. Capacities are
+    // rounded to a size class, so a transient can usually add to a
+    // node in place, and allocations come in a few sizes.
+
+    explicit bitmap_indexed_node(pinned_tag) :
+        Base(node_kind::bitmap_indexed, 1)
+    {}
+
+    bitmap_indexed_node(edit_type edit, uint32_t dataCap,
+            uint32_t nodeCap) :
+        Base(node_kind::bitmap_indexed),
+        edit(edit),
+        dataCap(dataCap),
+        nodeCap(nodeCap)
+    {}
+
+    // Allocates an empty node with room for at least dataCap values
+    // and nodeCap children
+    static bin_ptr create(edit_type edit, uint32_t dataCap,
+            uint32_t nodeCap)
     {
-        return popcount(bitmap & (bit - 1));
+        dataCap = sizeClass(dataCap);
+        nodeCap = sizeClass(nodeCap);
+
+        auto size = allocSize(dataCap, nodeCap);
+        void* mem = Base::allocate(size);
+        return bin_ptr{new (mem) bitmap_indexed_node(edit, dataCap, nodeCap)};
     }
 
-    auto ensureEditable(const edit_type& edit)
+    void destroy() noexcept
     {
-        if (sameEdit(this->edit, edit)) {
-            return this->template shared_from_base<bitmap_indexed_node>();
-        }
+        auto size = allocSize(dataCap, nodeCap);
+        this->~bitmap_indexed_node();
+        Base::deallocate(this, size);
+    }
 
-        auto n = popcount(bitmap);
-        int count;
-        if (n >= 0) {
-            // make room for next assoc
-            count = n + 1;
-        } else {
-            // make room for first two assocs
-            count = 2;
+    // slot counts rounded to 0-4, 6, 8, 12, 16, 24, 32
+    static uint32_t sizeClass(uint32_t n) noexcept
+    {
+        if (n <= 4) {
+            return n;
         }
+        uint32_t p = 1u << (32 - __builtin_clz(n - 1));
+        return n <= p - p / 4 ? p - p / 4 : p;
+    }
 
-        auto newArray = array_type(count);
-        std::copy(array.cbegin(), array.cend(), newArray.begin());
-        return std::make_shared<bitmap_indexed_node>(edit, bitmap,
-                std::move(newArray));
+    static constexpr std::size_t alignUp(std::size_t n, std::size_t align)
+    {
+        return (n + align - 1) & ~(align - 1);
     }
 
-    shared_node createNode(uint32_t shift, value_type e1,
-            hash_type key2hash, value_type e2) const
+    static constexpr std::size_t valuesOffset()
     {
-        hash_type key1hash = Hash{}(e1.first);
-        if (key1hash == key2hash) {
-            typename hcn_node::array_type newArray{e1, e2};
-            return std::make_shared<hcn_node>(
-                    edit_type{}, key1hash, 2, std::move(newArray));
-        }
+        return alignUp(sizeof(bitmap_indexed_node), alignof(value_type));
+    }
 
-        bool addedLeaf = false;
-        return emptyBin
-                .assoc(shift, key1hash, e1, addedLeaf)
-                ->assoc(shift, key2hash, e2, addedLeaf);
+    static constexpr std::size_t childrenOffset(uint32_t dataCap)
+    {
+        return alignUp(valuesOffset() + dataCap * sizeof(value_type),
+                alignof(node_ptr));
     }
 
-    shared_node createNode(const edit_type& edit,
-            uint32_t shift, value_type e1,
-            hash_type key2hash, value_type e2) const
+    static constexpr std::size_t hashesOffset(uint32_t dataCap,
+            uint32_t nodeCap)
     {
-        hash_type key1hash = Hash{}(e1.first);
-        if (key1hash == key2hash) {
-            typename hcn_node::array_type newArray{
-                    e1, e2};
-            return std::make_shared<hcn_node>(
-                    edit, key1hash, 2, std::move(newArray));
+        return alignUp(childrenOffset(dataCap) + nodeCap * sizeof(node_ptr),
+                alignof(hash_type));
+    }
+
+    static constexpr std::size_t allocSize(uint32_t dataCap, uint32_t nodeCap)
+    {
+        if (!dataCap && !nodeCap) {
+            return sizeof(bitmap_indexed_node);
+        } else if (Policy::memoize_hash) {
+            return hashesOffset(dataCap, nodeCap) + dataCap * sizeof(hash_type);
         }
+        return childrenOffset(dataCap) + nodeCap * sizeof(node_ptr);
+    }
 
-        bool addedLeaf = false;
-        return emptyBin
-                .assoc(edit, shift, key1hash, e1, addedLeaf)
-                ->assoc(edit, shift, key2hash, e2, addedLeaf);
+    value_type* values() const noexcept
+    {
+        auto base = reinterpret_cast<const char*>(this) + valuesOffset();
+        return reinterpret_cast<value_type*>(const_cast<char*>(base));
     }
 
-    edit_type edit;
-    uint32_t bitmap = 0;
-    array_type array;
-};
+    node_ptr* children() const noexcept
+    {
+        auto base = reinterpret_cast<const char*>(this) + childrenOffset(dataCap);
+        return reinterpret_cast<node_ptr*>(const_cast<char*>(base));
+    }
 
-template <class K, class T, class Hash>
-class array_node final : public node<K, T, Hash>
+    // only there when the policy memoizes hashes
+    hash_type* hashes() const noexcept
+    {
+        auto base = reinterpret_cast<const char*>(this) +
+                    hashesOffset(dataCap, nodeCap);
+        return reinterpret_cast<hash_type*>(const_cast<char*>(base));
+    }
+
+    // hash of the value at idx
+    hash_type hashAt(uint32_t idx) const
+    {
+        if constexpr (Policy::memoize_hash) {
+            return hashes()[idx];
+        }
+        return Hash{}(traits::key(values()[idx]));
+    }
+
+    // whether the value at idx has the given key, which has the given
+    // hash; memoized hashes rule most other keys out without comparing
+    template <class Key>
+    bool keyAt(uint32_t idx, hash_type hash, const Key& key) const
+    {
+        if constexpr (Policy::memoize_hash) {
+            if (hashes()[idx] != hash) {
+                return false;
+            }
+        }
+        return traits::key(values()[idx]) == key;
+    }
+
+    uint32_t dataIndex(uint32_t bit) const noexcept
+    {
+        return popcount(datamap & (bit - 1));
+    }
+
+    uint32_t nodeIndex(uint32_t bit) const noexcept
+    {
+        return popcount(nodemap & (bit - 1));
+    }
+
+    // The in-place edits below are only valid on a node that nobody
+    // else can see yet, and assume there is capacity for them.
+
+    // the hash is only kept if the policy memoizes hashes
+    template <class V>
+    void insertValue(uint32_t bit, hash_type hash, V&& value)
+    {
+        auto len = popcount(datamap);
+        auto idx = dataIndex(bit);
+        auto vals = values();
+        if constexpr (Policy::memoize_hash) {
+            auto h = hashes();
+            std::copy_backward(h + idx, h + len, h + len + 1);
+            h[idx] = hash;
+        }
+        if (idx == len) {
+            new (vals + len) value_type(std::forward<V>(value));
+            datamap |= bit;
+        } else {
+            new (vals + len) value_type(std::move(vals[len - 1]));
+            datamap |= bit;
+            std::move_backward(vals + idx, vals + len - 1, vals + len);
+            vals[idx] = std::forward<V>(value);
+        }
+    }
+
+    void eraseValue(uint32_t bit)
+    {
+        auto len = popcount(datamap);
+        auto vals = values();
+        if constexpr (Policy::memoize_hash) {
+            auto h = hashes();
+            std::copy(h + dataIndex(bit) + 1, h + len, h + dataIndex(bit));
+        }
+        std::move(vals + dataIndex(bit) + 1, vals + len, vals + dataIndex(bit));
+        std::destroy_at(vals + len - 1);
+        datamap ^= bit;
+    }
+
+    void insertChild(uint32_t bit, node_ptr child)
+    {
+        auto len = popcount(nodemap);
+        auto idx = nodeIndex(bit);
+        auto kids = children();
+        new (kids + len) node_ptr();
+        nodemap |= bit;
+        std::move_backward(kids + idx, kids + len, kids + len + 1);
+        kids[idx] = std::move(child);
+    }
+
+    void eraseChild(uint32_t bit)
+    {
+        auto len = popcount(nodemap);
+        auto kids = children();
+        std::move(kids + nodeIndex(bit) + 1, kids + len, kids + nodeIndex(bit));
+        std::destroy_at(kids + len - 1);
+        nodemap ^= bit;
+    }
+
+    // replace the value at bit with a child node
+    void migrateToNode(uint32_t bit, node_ptr child)
+    {
+        eraseValue(bit);
+        insertChild(bit, std::move(child));
+    }
+
+    // replace the child at bit with from's only value
+    void migrateToData(uint32_t bit, const bitmap_indexed_node& from)
+    {
+        eraseChild(bit);
+        insertValue(bit, Policy::memoize_hash ? from.hashes()[0] : 0,
+                from.values()[0]);
+    }
+
+    // For the canonical encoding, a child that has shrunk to a single
+    // value, so the parent can inline it; null otherwise, or for the
+    // default encoding.
+    static const bitmap_indexed_node* singleValue(const node_ptr& n) noexcept
+    {
+        if constexpr (Policy::canonical) {
+            if (n->kind() == node_kind::bitmap_indexed) {
+                auto bin = static_cast<const bitmap_indexed_node*>(n.get());
+                if (!bin->nodemap && popcount(bin->datamap) == 1) {
+                    return bin;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    // For the canonical encoding, a node below the root holding only
+    // a hash_collision_node is replaced by that node, so collisions
+    // always sit directly under the last level where hashes differ.
+    node_ptr canonical(uint32_t shift)
+    {
+        if constexpr (Policy::canonical) {
+            if (shift > 0 && !datamap && popcount(nodemap) == 1 &&
+                    children()[0]->kind() == node_kind::hash_collision) {
+                return children()[0];
+            }
+        }
+        return this;
+    }
+
+    // Copy of this node, with room for the given number of extra
+    // values and children
+    bin_ptr copy(edit_type edit, uint32_t extraData,
+            uint32_t extraNodes) const
+    {
+        auto dataLen = popcount(datamap);
+        auto nodeLen = popcount(nodemap);
+
+        auto dup = create(edit, dataLen + extraData, nodeLen + extraNodes);
+        std::uninitialized_copy_n(values(), dataLen, dup->values());
+        if constexpr (Policy::memoize_hash) {
+            std::copy_n(hashes(), dataLen, dup->hashes());
+        }
+        dup->datamap = datamap;
+        std::uninitialized_copy_n(children(), nodeLen, dup->children());
+        dup->nodemap = nodemap;
+        return dup;
+    }
+
+    bin_ptr ensureEditable(edit_type edit, uint32_t extraData,
+            uint32_t extraNodes)
+    {
+        auto dataLen = popcount(datamap);
+        auto nodeLen = popcount(nodemap);
+
+        if (!sameEdit(this->edit, edit)) {
+            // make room for next assoc, too
+            return copy(edit, extraData + 1, extraNodes);
+        }
+
+        if (dataLen + extraData <= dataCap && nodeLen + extraNodes <= nodeCap) {
+            return bin_ptr{this};
+        }
+
+        // this node is ours but it's full; entries can be moved,
+        // as this node is about to be replaced in its parent
+        auto dup = create(edit, dataLen + extraData, nodeLen + extraNodes);
+        std::uninitialized_move_n(values(), dataLen, dup->values());
+        if constexpr (Policy::memoize_hash) {
+            std::copy_n(hashes(), dataLen, dup->hashes());
+        }
+        dup->datamap = datamap;
+        std::uninitialized_move_n(children(), nodeLen, dup->children());
+        dup->nodemap = nodemap;
+        return dup;
+    }
+
+    // new node holding a single value
+    static bin_ptr single(edit_type edit, uint32_t shift,
+            hash_type hash, const value_type& value)
+    {
+        auto n = create(edit, 1, 0);
+        n->insertValue(bitpos(hash, shift), hash, value);
+        return n;
+    }
+
+    node_ptr promote(edit_type edit, uint32_t shift, hash_type hash,
+            const value_type& newValue, bool& addedLeaf)
+    {
+        // promote the node to an array_node containing a new
+        // bitmap_indexed_node wrapping each value
+        addedLeaf = true;
+        typename arr_node::array_type newArray;
+        newArray[mask(hash, shift)] = single(edit, shift + 5, hash, newValue);
+
+        uint32_t src = 0;
+        auto kid = children();
+        for (uint32_t i = 0; i < 32; i++) {
+            uint32_t bit = 1u << i;
+            if (datamap & bit) {
+                newArray[i] = single(edit, shift + 5, hashAt(src),
+                        values()[src]);
+                src++;
+            } else if (nodemap & bit) {
+                newArray[i] = *kid++;
+            }
+        }
+
+        return make_node<arr_node>(edit, node_count() + 1,
+                std::move(newArray));
+    }
+
+    node_ptr createNode(uint32_t shift, hash_type key1hash,
+            const value_type& e1, hash_type key2hash,
+            const value_type& e2) const
+    {
+        if (key1hash == key2hash) {
+            typename hcn_node::array_type newArray{e1, e2};
+            return make_node<hcn_node>(
+                    edit_type{}, key1hash, 2, std::move(newArray));
+        }
+
+        bool addedLeaf = false;
+        return emptyBin
+                .assoc(shift, key1hash, e1, addedLeaf)
+                ->assoc(shift, key2hash, e2, addedLeaf);
+    }
+
+    node_ptr createNode(edit_type edit, uint32_t shift,
+            hash_type key1hash, const value_type& e1, hash_type key2hash,
+            const value_type& e2) const
+    {
+        if (key1hash == key2hash) {
+            typename hcn_node::array_type newArray{
+                    e1, e2};
+            return make_node<hcn_node>(
+                    edit, key1hash, 2, std::move(newArray));
+        }
+
+        bool addedLeaf = false;
+        return emptyBin
+                .assoc(edit, shift, key1hash, e1, addedLeaf)
+                ->assoc(edit, shift, key2hash, e2, addedLeaf);
+    }
+
+    edit_type edit;
+    uint32_t datamap = 0;
+    uint32_t nodemap = 0;
+    uint8_t dataCap = 0;
+    uint8_t nodeCap = 0;
+};
+
+template <class K, class T, class Hash, class Policy>
+class array_node final : public node<K, T, Hash, Policy>
 {
-    using Base = node<K, T, Hash>;
-    using bin_node = bitmap_indexed_node<K, T, Hash>;
+    using Base = node<K, T, Hash, Policy>;
+    using traits = typename Base::traits;
+    using bin_node = bitmap_indexed_node<K, T, Hash, Policy>;
 
 public:
     using value_type = typename Base::value_type;
-    using shared_node = typename Base::shared_node;
-    using entry_type = typename Base::entry_type;
+    using node_ptr = typename Base::node_ptr;
 
-    using array_type = std::array<shared_node, 32>;
+    using array_type = std::array<node_ptr, 32>;
 
-    array_node(const edit_type& edit, int count, array_type&& array) :
+    array_node(edit_type edit, int count, array_type&& array) :
+        Base(node_kind::array),
         edit(edit),
         count(count),
         array(std::move(array))
     {}
 
-    shared_node assoc(uint32_t shift, hash_type hash,
-            const entry_type& newEntry, bool& addedLeaf)
+    node_ptr assoc(uint32_t shift, hash_type hash,
+            const value_type& newValue, bool& addedLeaf)
     {
         auto idx = mask(hash, shift);
-        auto node = array[idx];
+        const auto& node = array[idx];
 
         // add node with new value if not found
         if (!node) {
-            return std::make_shared<array_node>(edit_type{}, count + 1,
-                    setDup(array, idx, bin_node::emptyBin.assoc(shift + 5, hash, newEntry, addedLeaf)));
+            addedLeaf = true;
+            return make_node<array_node>(edit_type{}, count + 1,
+                    setDup(array, idx, bin_node::single(edit_type{}, shift + 5, hash, newValue)));
         }
 
         // otherwise, add the value to the node
-        auto n = node->assoc(shift + 5, hash, newEntry, addedLeaf);
+        auto n = node->assoc(shift + 5, hash, newValue, addedLeaf);
+        if (n == node) {
+            return this;
+        }
+
+        return make_node<array_node>(edit_type{}, count,
+                setDup(array, idx, n));
+    }
+
+    node_ptr update(uint32_t shift, hash_type hash, const K& key,
+            value_updater<T>& updater, bool& addedLeaf)
+    {
+        auto idx = mask(hash, shift);
+        const auto& node = array[idx];
+        if (!node) {
+            return this->updateMissing(shift, hash, key, updater, addedLeaf);
+        }
+
+        auto n = node->update(shift + 5, hash, key, updater, addedLeaf);
         if (n == node) {
-            return this->shared_from_this();
+            return this;
         }
 
-        return std::make_shared<array_node>(edit_type{}, count,
+        return make_node<array_node>(edit_type{}, count,
                 setDup(array, idx, n));
     }
 
-    shared_node without(uint32_t shift, hash_type hash, const K& key)
+    node_ptr without(uint32_t shift, hash_type hash, const K& key)
     {
         auto idx = mask(hash, shift);
-        auto node = array[idx];
+        const auto& node = array[idx];
         if (!node) {
-            return this->shared_from_this();
+            return this;
         }
 
         auto n = node->without(shift + 5, hash, key);
         if (n == node) {
-            return this->shared_from_this();
+            return this;
         }
         if (!n) {
             if (count <= 8) {
@@ -551,44 +1249,55 @@ public:
                 return pack(edit_type{}, int(idx));
             }
 
-            return std::make_shared<array_node>(edit_type{}, count - 1,
+            return make_node<array_node>(edit_type{}, count - 1,
                     setDup(array, idx, n));
         } else {
-            return std::make_shared<array_node>(edit_type{}, count,
+            return make_node<array_node>(edit_type{}, count,
                     setDup(array, idx, n));
         }
     }
 
-    std::optional<entry_type> find(uint32_t shift, hash_type hash,
-            const K& key) const
-    {
-        auto idx = mask(hash, shift);
-        auto node = array[idx];
-        if (node) {
-            return node->find(shift + 5, hash, key);
-        }
-        return std::nullopt;
-    }
-
-    shared_node assoc(const edit_type& edit, uint32_t shift, hash_type hash,
-            const entry_type& newEntry, bool& addedLeaf)
+    node_ptr assoc(edit_type edit, uint32_t shift, hash_type hash,
+            const value_type& newValue, bool& addedLeaf)
     {
         auto idx = mask(hash, shift);
-        auto node = array[idx];
+        const auto& node = array[idx];
 
         // add node with new value if not found
         if (!node) {
+            addedLeaf = true;
             auto editable = ensureEditable(edit);
-            editable->array[idx] = bin_node::emptyBin.assoc(edit, shift + 5,
-                    hash, newEntry, addedLeaf);
+            editable->array[idx] = bin_node::single(edit, shift + 5,
+                    hash, newValue);
             editable->count++;
             return editable;
         }
 
         // otherwise, add the value to the node
-        auto n = node->assoc(edit, shift + 5, hash, newEntry, addedLeaf);
+        auto n = node->assoc(edit, shift + 5, hash, newValue, addedLeaf);
+        if (n == node) {
+            return this;
+        }
+
+        auto editable = ensureEditable(edit);
+        editable->array[idx] = n;
+        return editable;
+    }
+
+    node_ptr update(edit_type edit, uint32_t shift, hash_type hash,
+            const K& key, value_updater<T>& updater, bool& addedLeaf)
+    {
+        auto idx = mask(hash, shift);
+        const auto& node = array[idx];
+        if (!node) {
+            return this->updateMissing(edit, shift, hash, key, updater,
+                    addedLeaf);
+        }
+
+        auto n = node->update(edit, shift + 5, hash, key, updater,
+                addedLeaf);
         if (n == node) {
-            return this->shared_from_this();
+            return this;
         }
 
         auto editable = ensureEditable(edit);
@@ -596,17 +1305,17 @@ public:
         return editable;
     }
 
-    shared_node without(const edit_type& edit, uint32_t shift, hash_type hash,
+    node_ptr without(edit_type edit, uint32_t shift, hash_type hash,
             const K& key, bool& removedLeaf)
     {
         auto idx = mask(hash, shift);
-        auto node = array[idx];
+        const auto& node = array[idx];
         if (!node) {
-            return this->shared_from_this();
+            return this;
         }
         auto n = node->without(edit, shift + 5, hash, key, removedLeaf);
         if (n == node) {
-            return this->shared_from_this();
+            return this;
         }
         if (!n) {
             if (count <= 8) {
@@ -623,7 +1332,41 @@ public:
         return editable;
     }
 
-    // todo: iterator(handler iterHandler) atom.SeqIterator
+    bool equiv(const Base* other, uint32_t shift, uint32_t otherShift) const
+    {
+        if (this == other) {
+            return true;
+        }
+
+        for (uint32_t i = 0; i < array.size(); i++) {
+            if (array[i]) {
+                auto [o, oshift] = Base::counterpart(other, otherShift,
+                        shift, i);
+                if (!array[i]->equiv(o, shift + 5, oshift)) {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    span<const value_type> data() const noexcept
+    {
+        return {};
+    }
+
+    span<const node_ptr> nodes() const noexcept
+    {
+        return {array.data(), array.data() + array.size()};
+    }
+
+    const Base* child(uint32_t idx) const noexcept
+    {
+        return array[idx].get();
+    }
+
+    std::size_t allocated() const noexcept { return sizeof(array_node); }
 
     std::string dump(int indent) const
     {
@@ -649,37 +1392,34 @@ public:
     int node_count() const noexcept { return count; }
 
 private:
-    auto ensureEditable(const edit_type& edit)
+    friend trie_lookup<K, T, Hash, Policy>;
+
+    auto ensureEditable(edit_type edit)
     {
         if (sameEdit(this->edit, edit)) {
-            return this->template shared_from_base<array_node>();
+            return ref_ptr<array_node>{this};
         }
 
         auto newArray{array};
-        return std::make_shared<array_node>(edit, count, std::move(newArray));
+        return make_node<array_node>(edit, count, std::move(newArray));
     }
 
-    auto pack(const edit_type& edit, int idx) const
+    auto pack(edit_type edit, uint32_t idx) const
     {
-        typename bin_node::array_type newArray(count - 1);
-        auto dest = newArray.begin() + 1;
-
-        uint32_t bitmap = 0;
-        for (int i = 0; i < idx; i++) {
-            if (array[i]) {
-                *dest++ = array[i];
-                bitmap |= 1 << i;
+        auto bin = bin_node::create(edit, 0, count - 1);
+        for (uint32_t i = 0; i < array.size(); i++) {
+            if (i != idx && array[i]) {
+                bin->insertChild(1u << i, array[i]);
             }
         }
 
-        for (std::size_t i = idx + 1; i < array.size(); i++) {
-            if (array[i]) {
-                *dest++ = array[i];
-                bitmap |= 1 << i;
-            }
-        }
+        return bin;
+    }
 
-        return std::make_shared<bin_node>(edit, bitmap, std::move(newArray));
+    void destroy() noexcept
+    {
+        this->~array_node();
+        Base::deallocate(this, sizeof(array_node));
     }
 
     edit_type edit;
@@ -687,150 +1427,299 @@ private:
     array_type array;
 };
 
-template <class K, class T, class Hash>
-class hash_collision_node final : public node<K, T, Hash>
+template <class K, class T, class Hash, class Policy>
+node_slot<K, T, Hash, Policy> slot_at(const node<K, T, Hash, Policy>* n,
+        uint32_t idx) noexcept
+{
+    if (n->kind() == node_kind::array) {
+        const auto& kid = n->nodes().first[idx];
+        return {nullptr, kid ? &kid : nullptr};
+    }
+
+    auto bin = static_cast<const bitmap_indexed_node<K, T, Hash, Policy>*>(n);
+    uint32_t bit = 1u << idx;
+    if (bin->datamap & bit) {
+        auto idx = bin->dataIndex(bit);
+        if constexpr (Policy::memoize_hash) {
+            return {bin->values() + idx, nullptr, bin->hashes() + idx};
+        }
+        return {bin->values() + idx, nullptr};
+    } else if (bin->nodemap & bit) {
+        return {nullptr, bin->children() + bin->nodeIndex(bit)};
+    }
+    return {};
+}
+
+template <class K, class T, class Hash, class Policy>
+class hash_collision_node final : public node<K, T, Hash, Policy>
 {
-    using Base = node<K, T, Hash>;
-    using bin_node = bitmap_indexed_node<K, T, Hash>;
+    using Base = node<K, T, Hash, Policy>;
+    using traits = typename Base::traits;
+    using bin_node = bitmap_indexed_node<K, T, Hash, Policy>;
 
 public:
     using value_type = typename Base::value_type;
-    using shared_node = typename Base::shared_node;
-    using entry_type = typename Base::entry_type;
+    using node_ptr = typename Base::node_ptr;
 
     using array_type = std::vector<value_type>;
 
-    hash_collision_node(const edit_type& edit, hash_type hash,
+    // a fingerprint per value, if K has them, or empty
+    using print_array = std::vector<uint8_t>;
+
+    hash_collision_node(edit_type edit, hash_type hash,
             typename array_type::size_type count, array_type newArray) :
+        Base(node_kind::hash_collision),
         edit(edit),
         hash(hash),
         count(count),
         array(std::move(newArray))
+    {
+        if constexpr (has_fingerprint<K>) {
+            prints.reserve(array.size());
+            for (const auto& value : array) {
+                prints.push_back(fingerprint(traits::key(value)));
+            }
+        }
+    }
+
+    hash_collision_node(edit_type edit, hash_type hash,
+            typename array_type::size_type count, array_type newArray,
+            print_array newPrints) :
+        Base(node_kind::hash_collision),
+        edit(edit),
+        hash(hash),
+        count(count),
+        array(std::move(newArray)),
+        prints(std::move(newPrints))
     {}
 
-    shared_node assoc(uint32_t shift, hash_type hash,
-            const entry_type& newEntry, bool& addedLeaf)
+    node_ptr assoc(uint32_t shift, hash_type hash,
+            const value_type& newValue, bool& addedLeaf)
     {
         // check the hash; if same, we can add it to a hcn
         if (this->hash == hash) {
-            auto entry = std::get<value_type>(newEntry);
-            auto idx = indexof(entry.first);
+            auto print = fingerprint(traits::key(newValue));
+            auto idx = indexof(traits::key(newValue), print);
 
             // if we found the key, replace its val
             if (idx != -1) {
-                if (array[idx].second == entry.second) {
-                    return this->shared_from_this();
+                if (traits::val(array[idx]) == traits::val(newValue)) {
+                    return this;
                 }
 
                 auto dup{array};
-                dup[idx].second = entry.second;
-                return std::make_shared<hash_collision_node>(edit_type{}, hash,
-                        count, std::move(dup));
+                traits::setVal(dup[idx], traits::val(newValue));
+                return make_node<hash_collision_node>(edit_type{}, hash,
+                        count, std::move(dup), prints);
             }
 
             addedLeaf = true;
 
             auto newArray = array_type(count + 1);
             std::copy(array.cbegin(), array.cend(), newArray.begin());
-            newArray[count] = entry;
-            return std::make_shared<hash_collision_node>(edit, hash,
-                    count + 1, std::move(newArray));
+            newArray[count] = newValue;
+            auto newPrints = prints;
+            if constexpr (has_fingerprint<K>) {
+                newPrints.push_back(print);
+            }
+            return make_node<hash_collision_node>(edit_type{}, hash,
+                    count + 1, std::move(newArray), std::move(newPrints));
         }
 
         // nest it in a bitmap node
-        typename bin_node::array_type selfArray{this->shared_from_this()};
-        auto bin = std::make_shared<bin_node>(edit_type{},
-                bitpos(this->hash, shift), std::move(selfArray));
-        return bin->assoc(shift, hash, newEntry, addedLeaf);
+        auto bin = bin_node::create(edit_type{}, 0, 1);
+        bin->insertChild(bitpos(this->hash, shift), this);
+        return bin->assoc(shift, hash, newValue, addedLeaf);
+    }
+
+    node_ptr update(uint32_t shift, hash_type hash, const K& key,
+            value_updater<T>& updater, bool& addedLeaf)
+    {
+        auto idx = this->hash == hash ? indexof(key) : -1;
+        if (idx == -1) {
+            return this->updateMissing(shift, hash, key, updater, addedLeaf);
+        }
+
+        const auto& old = traits::val(array[idx]);
+        auto val = updater.updated(old);
+        if (val == old) {
+            return this;
+        }
+
+        auto dup{array};
+        traits::setVal(dup[idx], val);
+        return make_node<hash_collision_node>(edit_type{}, hash, count,
+                std::move(dup), prints);
     }
 
-    shared_node without(uint32_t shift, hash_type hash, const K& key)
+    node_ptr without(uint32_t shift, hash_type hash, const K& key)
     {
         auto idx = indexof(key);
         if (idx == -1) {
-            return this->shared_from_this();
+            return this;
         } else if (count == 1) {
             return {};
+        } else if (Policy::canonical && count == 2) {
+            // the canonical encoding never keeps a single value here
+            return bin_node::single(edit_type{}, shift, hash, array[1 - idx]);
         } else {
             array_type newArray(count - 1);
             auto abegin = array.cbegin();
             std::copy_n(abegin, idx, newArray.begin());
             std::copy(abegin + idx + 1, array.cend(), newArray.begin() + idx);
 
-            return std::make_shared<hash_collision_node>(edit_type{}, hash,
-                    count - 1, std::move(newArray));
-        }
-    }
-
-    std::optional<entry_type> find(uint32_t shift, hash_type hash,
-            const K& key) const
-    {
-        auto idx = indexof(key);
-        if (idx != -1) {
-            return array[idx];
+            auto newPrints = prints;
+            if constexpr (has_fingerprint<K>) {
+                newPrints.erase(newPrints.begin() + idx);
+            }
+            return make_node<hash_collision_node>(edit_type{}, hash,
+                    count - 1, std::move(newArray), std::move(newPrints));
         }
-        return std::nullopt;
     }
 
-    shared_node assoc(const edit_type& edit, uint32_t shift, hash_type hash,
-            const entry_type& newEntry, bool& addedLeaf)
+    node_ptr assoc(edit_type edit, uint32_t shift, hash_type hash,
+            const value_type& newValue, bool& addedLeaf)
     {
         // check the hash; if same, we can add it to a hcn
         if (this->hash == hash) {
-            auto entry = std::get<value_type>(newEntry);
-            auto idx = indexof(entry.first);
+            auto print = fingerprint(traits::key(newValue));
+            auto idx = indexof(traits::key(newValue), print);
 
             // if we found the key, replace its val
             if (idx != -1) {
-                if (array[idx].second == entry.second) {
-                    return this->shared_from_this();
+                if (traits::val(array[idx]) == traits::val(newValue)) {
+                    return this;
                 }
                 auto editable = ensureEditable(edit);
-                editable->array[idx].second = entry.second;
+                traits::setVal(editable->array[idx], traits::val(newValue));
                 return editable;
             }
 
             addedLeaf = true;
             auto editable = ensureEditable(edit);
             if (array.size() > count) {
-                editable->array[count] = entry;
+                editable->array[count] = newValue;
             } else {
-                editable->array.push_back(entry);
+                editable->array.push_back(newValue);
+            }
+            if constexpr (has_fingerprint<K>) {
+                if (editable->prints.size() > count) {
+                    editable->prints[count] = print;
+                } else {
+                    editable->prints.push_back(print);
+                }
             }
             editable->count++;
             return editable;
         }
 
         // nest it in a bitmap node with an extra space
-        typename bin_node::array_type selfArray{
-                this->shared_from_this(), {}};
+        auto bin = bin_node::create(edit, 1, 1);
+        bin->insertChild(bitpos(this->hash, shift), this);
+        return bin->assoc(edit, shift, hash, newValue, addedLeaf);
+    }
+
+    node_ptr update(edit_type edit, uint32_t shift, hash_type hash,
+            const K& key, value_updater<T>& updater, bool& addedLeaf)
+    {
+        auto idx = this->hash == hash ? indexof(key) : -1;
+        if (idx == -1) {
+            return this->updateMissing(edit, shift, hash, key, updater,
+                    addedLeaf);
+        }
 
-        auto bin = std::make_shared<bin_node>(edit, bitpos(this->hash, shift),
-                std::move(selfArray));
-        return bin->assoc(edit, shift, hash, newEntry, addedLeaf);
+        const auto& old = traits::val(array[idx]);
+        auto val = updater.updated(old);
+        if (val == old) {
+            return this;
+        }
+
+        auto editable = ensureEditable(edit);
+        traits::setVal(editable->array[idx], val);
+        return editable;
     }
 
-    shared_node without(const edit_type& edit, uint32_t shift, hash_type hash,
+    node_ptr without(edit_type edit, uint32_t shift, hash_type hash,
             const K& key, bool& removedLeaf)
     {
         auto idx = indexof(key);
         if (idx == -1) {
-            return this->shared_from_this();
+            return this;
         }
 
         removedLeaf = true;
         if (count == 1) {
             return {};
+        } else if (Policy::canonical && count == 2) {
+            // the canonical encoding never keeps a single value here
+            return bin_node::single(edit, shift, hash, array[1 - idx]);
         }
 
         auto editable = ensureEditable(edit);
         editable->array[idx] = editable->array.back();
         editable->array.pop_back();
+        if constexpr (has_fingerprint<K>) {
+            editable->prints[idx] = editable->prints.back();
+            editable->prints.pop_back();
+        }
         editable->count--;
         return editable;
     }
 
-    // todo: iterator(handler iterHandler) atom.SeqIterator
+    bool equiv(const Base* other, uint32_t /*shift*/, uint32_t otherShift) const
+    {
+        if (this == other) {
+            return true;
+        }
+
+        if constexpr (Policy::canonical) {
+            if (other->kind() != node_kind::hash_collision) {
+                return false;
+            }
+
+            // same values, but maybe not in the same order
+            auto o = static_cast<const hash_collision_node*>(other);
+            if (hash != o->hash || count != o->count) {
+                return false;
+            }
+            for (decltype(count) i = 0; i < count; i++) {
+                auto idx = o->indexof(traits::key(array[i]));
+                if (idx == -1 ||
+                        !(traits::val(array[i]) == traits::val(o->array[idx]))) {
+                    return false;
+                }
+            }
+        } else {
+            for (decltype(count) i = 0; i < count; i++) {
+                if (!Base::containsValue(other, otherShift, hash, array[i])) {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    span<const value_type> data() const noexcept
+    {
+        return {array.data(), array.data() + count};
+    }
+
+    span<const node_ptr> nodes() const noexcept
+    {
+        return {};
+    }
+
+    const Base* child(uint32_t) const noexcept
+    {
+        return nullptr;
+    }
+
+    std::size_t allocated() const noexcept
+    {
+        return sizeof(hash_collision_node) +
+               array.capacity() * sizeof(value_type) + prints.capacity();
+    }
 
     std::string dump(int indent) const
     {
@@ -842,7 +1731,7 @@ public:
             for (int idt = 0; idt < indent; idt++) {
                 fmt::format_to(msg, " ");
             }
-            fmt::format_to(msg, "{}: {}->{}\n", i, entry.first, entry.second);
+            traits::dump(msg, i, entry);
         }
 
         return fmt::to_string(msg);
@@ -851,31 +1740,1180 @@ public:
     int node_count() const noexcept { return count; }
 
 private:
-    int indexof(K key) const
+    friend trie_lookup<K, T, Hash, Policy>;
+
+    // the key's fingerprint, or 0 if K doesn't have them
+    template <class Key>
+    static uint8_t fingerprint(const Key& key)
     {
+        if constexpr (has_fingerprint<K>) {
+            return key_fingerprint<K>{}(key);
+        }
+        return 0;
+    }
+
+    // index of the value with key, which has the given fingerprint,
+    // or -1
+    template <class Key>
+    int indexof(const Key& key, uint8_t print) const
+    {
+        if constexpr (has_fingerprint<K>) {
+            return scan_prints(prints.data(), count, print,
+                    [&](std::size_t i) { return traits::key(array[i]) == key; });
+        }
+
         for (decltype(count) i = 0; i < count; i++) {
-            if (key == array[i].first) {
+            if (traits::key(array[i]) == key) {
                 return i;
             }
         }
         return -1;
     }
 
-    auto ensureEditable(const edit_type& edit)
+    template <class Key>
+    int indexof(const Key& key) const
+    {
+        return indexof(key, fingerprint(key));
+    }
+
+    auto ensureEditable(edit_type edit)
     {
         if (sameEdit(this->edit, edit)) {
-            return this->template shared_from_base<hash_collision_node>();
+            return ref_ptr<hash_collision_node>{this};
         }
 
         auto newArray{array};
-        return std::make_shared<hash_collision_node>(edit, hash,
-                count, std::move(newArray));
+        return make_node<hash_collision_node>(edit, hash,
+                count, std::move(newArray), prints);
+    }
+
+    void destroy() noexcept
+    {
+        this->~hash_collision_node();
+        Base::deallocate(this, sizeof(hash_collision_node));
     }
 
     edit_type edit;
     hash_type hash;
     typename array_type::size_type count;
     array_type array;
+    print_array prints;
+};
+
+// Finds values without going through node's virtual find, walking
+// down the trie in a loop and returning a pointer into the node that
+// holds the value. The key may be of any type that compares equal to
+// K, and hashes the same with Hash, so transparent lookups don't need
+// to make a K.
+template <class K, class T, class Hash, class Policy>
+struct trie_lookup
+{
+    using node_type = node<K, T, Hash, Policy>;
+    using traits = typename node_type::traits;
+    using bin_node = bitmap_indexed_node<K, T, Hash, Policy>;
+    using arr_node = array_node<K, T, Hash, Policy>;
+    using hcn_node = hash_collision_node<K, T, Hash, Policy>;
+    using value_type = typename node_type::value_type;
+
+    // the value for key, which has the given hash, under n, a node at
+    // shift (or null), or null if there isn't one
+    template <class Key>
+    static const value_type* find(const node_type* n, uint32_t shift,
+            hash_type hash, const Key& key)
+    {
+        for (; n; shift += 5) {
+            switch (n->kind()) {
+            case node_kind::bitmap_indexed: {
+                auto bin = static_cast<const bin_node*>(n);
+                auto bit = bitpos(hash, shift);
+                if (bin->datamap & bit) {
+                    auto idx = bin->dataIndex(bit);
+                    return bin->keyAt(idx, hash, key) ? bin->values() + idx
+                                                      : nullptr;
+                } else if (!(bin->nodemap & bit)) {
+                    return nullptr;
+                }
+                n = bin->children()[bin->nodeIndex(bit)].get();
+                break;
+            }
+            case node_kind::array:
+                n = static_cast<const arr_node*>(n)->array[mask(hash, shift)].get();
+                break;
+            case node_kind::hash_collision: {
+                auto hcn = static_cast<const hcn_node*>(n);
+                if (hcn->hash != hash) {
+                    return nullptr;
+                }
+                auto idx = hcn->indexof(key);
+                return idx != -1 ? &hcn->array[idx] : nullptr;
+            }
+            }
+        }
+        return nullptr;
+    }
+};
+
+// Runs fn(0) to fn(threads - 1) at once, on new threads and this
+// one, rethrowing the first exception any of them threw
+template <class Fn>
+void run_parallel(unsigned threads, Fn fn)
+{
+    std::vector<std::exception_ptr> errors(threads);
+    auto run = [&](unsigned t) {
+        try {
+            fn(t);
+        } catch (...) {
+            errors[t] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    try {
+        for (unsigned t = 1; t < threads; t++) {
+            workers.emplace_back(run, t);
+        }
+    } catch (...) {
+        // couldn't start them all; do the rest here
+        for (auto t = workers.size() + 1; t < threads; t++) {
+            run(t);
+        }
+    }
+    run(0);
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    for (auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+// Builds a trie bottom-up from a batch of values, for bulk loading.
+// Each level radix sorts its run of values by slot, so every subtree
+// is a run of adjacent values, and each node is allocated once, at its
+// final size. The sorts are stable, so when a key is given more than
+// once, its last value wins.
+//
+// The subtrees under the root's 32 slots are independent, so they can
+// be built on separate threads, then joined under the root.
+template <class K, class T, class Hash, class Policy>
+class trie_builder
+{
+    using node_type = node<K, T, Hash, Policy>;
+    using traits = typename node_type::traits;
+    using bin_node = bitmap_indexed_node<K, T, Hash, Policy>;
+    using arr_node = array_node<K, T, Hash, Policy>;
+    using hcn_node = hash_collision_node<K, T, Hash, Policy>;
+
+public:
+    using value_type = typename node_type::value_type;
+    using node_ptr = typename node_type::node_ptr;
+
+    // Returns the root of a trie holding values, or null if there
+    // are none, using up to the given number of threads. The values
+    // are moved into the trie.
+    node_ptr build(std::vector<value_type>& values, unsigned threads = 1)
+    {
+        count = 0;
+        if (values.empty()) {
+            return {};
+        }
+
+        // not worth a thread unless it has plenty to do
+        threads = std::min<std::size_t>({threads, 32,
+                values.size() / min_per_thread + 1});
+
+        std::vector<entry> entries(values.size());
+        std::vector<entry> scratch(values.size());
+        if (threads <= 1) {
+            for (std::size_t i = 0; i < values.size(); i++) {
+                entries[i] = {Hash{}(traits::key(values[i])), &values[i]};
+            }
+            return build(entries.data(), entries.data() + entries.size(),
+                    scratch.data(), 0);
+        }
+
+        // each thread hashes a chunk of the values, and counts them by
+        // slot, then copies them to their slot's run in scratch. The
+        // runs are laid out by slot, then chunk, so the sort is stable.
+        auto chunk = (values.size() + threads - 1) / threads;
+        auto chunkRange = [&](unsigned t) {
+            auto first = std::min(values.size(), t * chunk);
+            auto last = std::min(values.size(), first + chunk);
+            return std::make_pair(first, last);
+        };
+
+        std::vector<std::array<std::size_t, 32>> starts(threads);
+        run_parallel(threads, [&](unsigned t) {
+            auto [first, last] = chunkRange(t);
+            starts[t] = {};
+            for (auto i = first; i < last; i++) {
+                entries[i] = {Hash{}(traits::key(values[i])), &values[i]};
+                starts[t][mask(entries[i].hash, 0)]++;
+            }
+        });
+
+        std::array<std::size_t, 33> offsets{};
+        std::size_t pos = 0;
+        for (uint32_t i = 0; i < 32; i++) {
+            offsets[i] = pos;
+            for (auto& start : starts) {
+                pos += std::exchange(start[i], pos);
+            }
+        }
+        offsets[32] = pos;
+
+        run_parallel(threads, [&](unsigned t) {
+            auto [first, last] = chunkRange(t);
+            for (auto i = first; i < last; i++) {
+                scratch[starts[t][mask(entries[i].hash, 0)]++] = entries[i];
+            }
+        });
+
+        // then the threads take slots in turn, building their subtrees
+        std::array<entry*, 32> vals{};
+        std::array<node_ptr, 32> kids;
+        std::vector<std::size_t> counts(threads);
+        std::atomic<uint32_t> next{0};
+        run_parallel(threads, [&](unsigned t) {
+            trie_builder sub;
+            for (uint32_t i; (i = next.fetch_add(1)) < 32;) {
+                sub.place(scratch.data() + offsets[i],
+                        scratch.data() + offsets[i + 1],
+                        entries.data() + offsets[i], 5, vals[i], kids[i]);
+            }
+            counts[t] = sub.count;
+        });
+
+        for (auto n : counts) {
+            count += n;
+        }
+        return assemble(vals, kids, 0);
+    }
+
+    // number of distinct keys in the last trie built
+    std::size_t size() const noexcept { return count; }
+
+private:
+    static constexpr std::size_t min_per_thread = 16384;
+
+    struct entry
+    {
+        hash_type hash;
+        value_type* value;
+    };
+
+    // Builds the node at shift for a run of entries whose hashes share
+    // a prefix. scratch has room for the run, and the run is left in
+    // an unspecified order.
+    node_ptr build(entry* first, entry* last, entry* scratch, uint32_t shift)
+    {
+        // sort the run by slot into scratch
+        std::array<uint32_t, 33> offsets{};
+        for (auto it = first; it != last; ++it) {
+            offsets[mask(it->hash, shift) + 1]++;
+        }
+        for (uint32_t i = 1; i <= 32; i++) {
+            offsets[i] += offsets[i - 1];
+        }
+        auto ends = offsets;
+        for (auto it = first; it != last; ++it) {
+            scratch[ends[mask(it->hash, shift)]++] = *it;
+        }
+
+        // the run's old place in the input is free for use as scratch
+        // space by the subtrees
+        std::array<entry*, 32> vals{};
+        std::array<node_ptr, 32> kids;
+        for (uint32_t i = 0; i < 32; i++) {
+            place(scratch + offsets[i], scratch + offsets[i + 1],
+                    first + offsets[i], shift + 5, vals[i], kids[i]);
+        }
+
+        return assemble(vals, kids, shift);
+    }
+
+    // Sorts out what goes in a slot, given the run of entries that
+    // fall in it: nothing, a value, a collision node, or a subtree
+    // for a node at shift
+    void place(entry* first, entry* last, entry* scratch, uint32_t shift,
+            entry*& val, node_ptr& kid)
+    {
+        if (first == last) {
+            return;
+        }
+
+        auto hash = first->hash;
+        if (std::any_of(first + 1, last,
+                    [&](const entry& e) { return e.hash != hash; })) {
+            // hashes differ further down
+            kid = build(first, last, scratch, shift);
+        } else if (auto kept = unique(first, last); last - kept == 1) {
+            val = kept;
+            count++;
+        } else {
+            kid = collision(kept, last);
+        }
+    }
+
+    // makes the node at shift holding the given values and children
+    node_ptr assemble(std::array<entry*, 32>& vals,
+            std::array<node_ptr, 32>& kids, uint32_t shift)
+    {
+        uint32_t dataLen = 0;
+        uint32_t nodeLen = 0;
+        for (uint32_t i = 0; i < 32; i++) {
+            dataLen += vals[i] != nullptr;
+            nodeLen += kids[i] != nullptr;
+        }
+
+        if (!Policy::canonical && dataLen + nodeLen > 16) {
+            // wide enough that assoc would have promoted it
+            typename arr_node::array_type array;
+            for (uint32_t i = 0; i < 32; i++) {
+                if (vals[i]) {
+                    auto bin = bin_node::create(edit_type{}, 1, 0);
+                    bin->insertValue(bitpos(vals[i]->hash, shift + 5),
+                            vals[i]->hash, std::move(*vals[i]->value));
+                    array[i] = std::move(bin);
+                } else {
+                    array[i] = std::move(kids[i]);
+                }
+            }
+            return make_node<arr_node>(edit_type{}, dataLen + nodeLen,
+                    std::move(array));
+        }
+
+        auto bin = bin_node::create(edit_type{}, dataLen, nodeLen);
+        for (uint32_t i = 0; i < 32; i++) {
+            if (vals[i]) {
+                bin->insertValue(1u << i, vals[i]->hash,
+                        std::move(*vals[i]->value));
+            } else if (kids[i]) {
+                bin->insertChild(1u << i, std::move(kids[i]));
+            }
+        }
+        return bin;
+    }
+
+    // Drops all but the last entry for each key from a run of entries
+    // with the same hash, returning the start of what's left
+    static entry* unique(entry* first, entry* last)
+    {
+        auto kept = last;
+        for (auto it = last; it != first;) {
+            --it;
+            auto dup = std::find_if(kept, last, [&](const entry& e) {
+                return traits::key(*e.value) == traits::key(*it->value);
+            });
+            if (dup == last) {
+                *--kept = *it;
+            }
+        }
+        return kept;
+    }
+
+    node_ptr collision(entry* first, entry* last)
+    {
+        typename hcn_node::array_type array;
+        array.reserve(last - first);
+        for (auto it = first; it != last; ++it) {
+            array.push_back(std::move(*it->value));
+        }
+
+        count += array.size();
+        auto hash = first->hash;
+        auto len = array.size();
+        return make_node<hcn_node>(edit_type{}, hash, len, std::move(array));
+    }
+
+    std::size_t count = 0;
+};
+
+// Folds the values in a trie into an accumulator, calling
+// f(acc, key, val) in iteration order. The parallel version splits the
+// trie into tasks at its top two levels, up to 32 * 32 subtrees, which
+// threads take in turn so none waits on another's larger share. Each
+// task folds from init, and the results are combined in order.
+template <class K, class T, class Hash, class Policy>
+class trie_reducer
+{
+    using node_type = node<K, T, Hash, Policy>;
+    using traits = typename node_type::traits;
+
+public:
+    template <class Acc, class F>
+    static Acc reduce(const node_type* n, Acc acc, F& f)
+    {
+        if (!n) {
+            return acc;
+        }
+        acc = reduceValues(n, std::move(acc), f);
+        for (const auto& child : n->nodes()) {
+            acc = reduce(child.get(), std::move(acc), f);
+        }
+        return acc;
+    }
+
+    template <class Acc, class F, class Combine>
+    static Acc parallelReduce(const node_type* root, std::size_t count,
+            const Acc& init, F& f, Combine& combine, unsigned threads)
+    {
+        // not worth a thread unless it has plenty to do
+        threads = std::min<std::size_t>(threads,
+                count / min_per_thread + 1);
+        if (threads <= 1) {
+            return reduce(root, init, f);
+        }
+
+        // a node's own values, or its whole subtree
+        struct task
+        {
+            const node_type* n;
+            bool subtree;
+        };
+
+        std::vector<task> tasks{{root, false}};
+        for (const auto& child : root->nodes()) {
+            if (!child) {
+                continue;
+            }
+            tasks.push_back({child.get(), false});
+            for (const auto& grandchild : child->nodes()) {
+                if (grandchild) {
+                    tasks.push_back({grandchild.get(), true});
+                }
+            }
+        }
+
+        std::vector<std::optional<Acc>> results(tasks.size());
+        std::atomic<std::size_t> next{0};
+        run_parallel(threads, [&](unsigned) {
+            for (std::size_t i; (i = next.fetch_add(1)) < tasks.size();) {
+                auto [n, subtree] = tasks[i];
+                results[i].emplace(subtree ? reduce(n, init, f)
+                                           : reduceValues(n, init, f));
+            }
+        });
+
+        auto acc = std::move(*results[0]);
+        for (std::size_t i = 1; i < results.size(); i++) {
+            acc = combine(std::move(acc), std::move(*results[i]));
+        }
+        return acc;
+    }
+
+private:
+    static constexpr std::size_t min_per_thread = 16384;
+
+    template <class Acc, class F>
+    static Acc reduceValues(const node_type* n, Acc acc, F& f)
+    {
+        for (const auto& value : n->data()) {
+            acc = f(std::move(acc), traits::key(value), traits::val(value));
+        }
+        return acc;
+    }
+};
+
+// Forward iterator over the values in a trie. It walks the trie
+// with an explicit stack rather than recursing, and never allocates;
+// each node's values are visited before its subtrees. Iterators stay
+// valid as long as the map version they came from.
+template <class K, class T, class Hash, class Policy>
+class map_iterator
+{
+    using node_type = node<K, T, Hash, Policy>;
+    using node_ptr = typename node_type::node_ptr;
+
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = typename node_type::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
+    map_iterator() = default;
+
+    explicit map_iterator(const node_type* root)
+    {
+        if (root) {
+            push(root);
+            advance();
+        }
+    }
+
+    reference operator*() const noexcept { return *cur; }
+    pointer operator->() const noexcept { return cur; }
+
+    map_iterator& operator++()
+    {
+        advance();
+        return *this;
+    }
+
+    map_iterator operator++(int)
+    {
+        auto it = *this;
+        advance();
+        return it;
+    }
+
+    friend bool operator==(const map_iterator& a, const map_iterator& b) noexcept
+    {
+        return a.cur == b.cur;
+    }
+
+    friend bool operator!=(const map_iterator& a, const map_iterator& b) noexcept
+    {
+        return a.cur != b.cur;
+    }
+
+private:
+    // 5 bits of hash per level, plus a level for a collision node
+    static constexpr int max_depth = (sizeof(hash_type) * 8 + 4) / 5 + 1;
+
+    struct frame
+    {
+        const value_type* value;
+        const value_type* valueEnd;
+        const node_ptr* child;
+        const node_ptr* childEnd;
+    };
+
+    void push(const node_type* n) noexcept
+    {
+        auto values = n->data();
+        auto children = n->nodes();
+        stack[depth++] = {values.begin(), values.end(),
+                children.begin(), children.end()};
+    }
+
+    void advance() noexcept
+    {
+        while (depth > 0) {
+            auto& top = stack[depth - 1];
+            if (top.value != top.valueEnd) {
+                cur = top.value++;
+                return;
+            } else if (top.child != top.childEnd) {
+                if (auto n = (top.child++)->get()) {
+                    push(n);
+                }
+            } else {
+                depth--;
+            }
+        }
+
+        cur = nullptr;
+    }
+
+    std::array<frame, max_depth> stack;
+    int depth = 0;
+    const value_type* cur = nullptr;
+};
+
+// number of values in the subtree n
+template <class K, class T, class Hash, class Policy>
+std::size_t count_values(const node<K, T, Hash, Policy>* n) noexcept
+{
+    auto total = n->data().size();
+    for (const auto& kid : n->nodes()) {
+        if (kid) {
+            total += count_values(kid.get());
+        }
+    }
+    return total;
+}
+
+// Makes the node at shift holding the given values and children (moved
+// from), or null if there are none. A value's slot may also hold the
+// node it came from, to keep it alive. For the canonical encoding, a
+// lone hash_collision_node below the root is returned as it is.
+template <class K, class T, class Hash, class Policy>
+ref_ptr<node<K, T, Hash, Policy>> assemble_node(
+        const std::array<node_slot<K, T, Hash, Policy>, 32>& vals,
+        std::array<ref_ptr<node<K, T, Hash, Policy>>, 32>& kids,
+        uint32_t shift)
+{
+    using bin_node = bitmap_indexed_node<K, T, Hash, Policy>;
+    using arr_node = array_node<K, T, Hash, Policy>;
+
+    uint32_t dataLen = 0;
+    uint32_t nodeLen = 0;
+    for (uint32_t i = 0; i < 32; i++) {
+        dataLen += vals[i].value != nullptr;
+        nodeLen += !vals[i].value && kids[i];
+    }
+
+    if (dataLen + nodeLen == 0) {
+        return {};
+    } else if (Policy::canonical && shift > 0 && dataLen == 0 &&
+               nodeLen == 1) {
+        for (auto& kid : kids) {
+            if (kid && kid->kind() == node_kind::hash_collision) {
+                return std::move(kid);
+            }
+        }
+    }
+
+    if (!Policy::canonical && dataLen + nodeLen > 16) {
+        typename arr_node::array_type array;
+        for (uint32_t i = 0; i < 32; i++) {
+            if (vals[i].value) {
+                array[i] = bin_node::single(edit_type{}, shift + 5,
+                        vals[i].hash(), *vals[i].value);
+            } else {
+                array[i] = std::move(kids[i]);
+            }
+        }
+        return make_node<arr_node>(edit_type{}, dataLen + nodeLen,
+                std::move(array));
+    }
+
+    auto bin = bin_node::create(edit_type{}, dataLen, nodeLen);
+    for (uint32_t i = 0; i < 32; i++) {
+        if (vals[i].value) {
+            bin->insertValue(1u << i,
+                    Policy::memoize_hash ? vals[i].hash() : 0,
+                    *vals[i].value);
+        } else if (kids[i]) {
+            bin->insertChild(1u << i, std::move(kids[i]));
+        }
+    }
+    return bin;
+}
+
+// Merges two tries, recursing over both at once. Subtrees the tries
+// share, or that only one of them has, are reused as they are, so new
+// nodes are only made along paths where the tries differ. A key in
+// both with different values gets the value resolve(a's, b's).
+template <class K, class T, class Hash, class Policy, class Resolve>
+class trie_merger
+{
+    using node_type = node<K, T, Hash, Policy>;
+    using traits = typename node_type::traits;
+    using bin_node = bitmap_indexed_node<K, T, Hash, Policy>;
+    using arr_node = array_node<K, T, Hash, Policy>;
+    using iterator = map_iterator<K, T, Hash, Policy>;
+    using slot = node_slot<K, T, Hash, Policy>;
+
+public:
+    using value_type = typename node_type::value_type;
+    using node_ptr = typename node_type::node_ptr;
+
+    explicit trie_merger(Resolve resolve) :
+        resolve(std::move(resolve))
+    {}
+
+    // Merges a and b, nodes at the same position at shift
+    node_ptr merge(const node_ptr& a, const node_ptr& b, uint32_t shift)
+    {
+        if (a == b) {
+            return a;
+        }
+
+        if (a->kind() == node_kind::hash_collision ||
+                b->kind() == node_kind::hash_collision) {
+            // collisions are rare; add b's values one by one
+            auto n = a;
+            for (auto it = iterator{b.get()}; it != iterator{}; ++it) {
+                bool found = false;
+                n = put(n, shift, Hash{}(traits::key(*it)), *it, false,
+                        found);
+                added += !found;
+            }
+            return n;
+        }
+
+        std::array<slot, 32> vals{};
+        std::array<node_ptr, 32> kids;
+        std::array<std::optional<value_type>, 32> resolved;
+        bool sameAsA = true;
+        bool sameAsB = true;
+
+        for (uint32_t i = 0; i < 32; i++) {
+            auto sa = slot_at(a.get(), i);
+            auto sb = slot_at(b.get(), i);
+
+            if (!sb.value && !sb.child) {
+                vals[i] = sa;
+                if (sa.child) {
+                    kids[i] = *sa.child;
+                }
+                sameAsB &= !sa.value && !sa.child;
+            } else if (!sa.value && !sa.child) {
+                vals[i] = sb;
+                if (sb.child) {
+                    kids[i] = *sb.child;
+                }
+                added += sb.value ? 1 : count_values(sb.child->get());
+                sameAsA = false;
+            } else if (sa.value && sb.value) {
+                if (!(traits::key(*sa.value) == traits::key(*sb.value))) {
+                    // push both down a level
+                    kids[i] = bin_node::emptyBin.createNode(shift + 5,
+                            sa.hash(), *sa.value, sb.hash(), *sb.value);
+                    added++;
+                    sameAsA = sameAsB = false;
+                } else if (traits::val(*sa.value) == traits::val(*sb.value)) {
+                    vals[i] = sa;
+                } else {
+                    auto val = resolve(traits::val(*sa.value),
+                            traits::val(*sb.value));
+                    if (val == traits::val(*sb.value)) {
+                        vals[i] = sb;
+                        sameAsA = false;
+                    } else if (val == traits::val(*sa.value)) {
+                        vals[i] = sa;
+                        sameAsB = false;
+                    } else {
+                        resolved[i].emplace(traits::make(
+                                traits::key(*sa.value), std::move(val)));
+                        vals[i] = {&*resolved[i], nullptr, sa.memo};
+                        sameAsA = sameAsB = false;
+                    }
+                }
+            } else if (sa.value) {
+                bool found = false;
+                kids[i] = put(*sb.child, shift + 5, sa.hash(), *sa.value,
+                        true, found);
+                added += count_values(sb.child->get()) - found;
+                sameAsA = false;
+                sameAsB &= kids[i] == *sb.child;
+            } else if (sb.value) {
+                bool found = false;
+                kids[i] = put(*sa.child, shift + 5, sb.hash(), *sb.value,
+                        false, found);
+                added += !found;
+                sameAsA &= kids[i] == *sa.child;
+                sameAsB = false;
+            } else {
+                kids[i] = merge(*sa.child, *sb.child, shift + 5);
+                sameAsA &= kids[i] == *sa.child;
+                sameAsB &= kids[i] == *sb.child;
+            }
+        }
+
+        if (sameAsA) {
+            return a;
+        } else if (sameAsB) {
+            return b;
+        }
+        return assemble_node(vals, kids, shift);
+    }
+
+    // number of keys in the merged trie that weren't in a
+    std::size_t size() const noexcept { return added; }
+
+private:
+    // Adds value, with the given hash, to the subtree n at shift,
+    // setting found if the key was already there. The value is a's if
+    // fromA, otherwise b's.
+    node_ptr put(const node_ptr& n, uint32_t shift, hash_type hash,
+            const value_type& value, bool fromA, bool& found)
+    {
+        bool addedLeaf = false;
+
+        auto old = trie_lookup<K, T, Hash, Policy>::find(n.get(), shift, hash,
+                traits::key(value));
+        found = old != nullptr;
+        if (!old) {
+            return n->assoc(shift, hash, value, addedLeaf);
+        } else if (traits::val(*old) == traits::val(value)) {
+            return n;
+        }
+
+        auto val = fromA ? resolve(traits::val(value), traits::val(*old))
+                         : resolve(traits::val(*old), traits::val(value));
+        if (val == traits::val(*old)) {
+            return n;
+        }
+        return n->assoc(shift, hash,
+                traits::make(traits::key(value), std::move(val)),
+                addedLeaf);
+    }
+
+    Resolve resolve;
+    std::size_t added = 0;
+};
+
+// Keeps the values of trie a whose keys are in trie b, or for a
+// difference, aren't, recursing over both at once. Subtrees of a that
+// are kept whole, such as those it shares with b in an intersection,
+// are reused as they are, so new nodes are only made along paths
+// where values were dropped.
+template <class K, class T, class Hash, class Policy>
+class trie_filter
+{
+    using node_type = node<K, T, Hash, Policy>;
+    using traits = typename node_type::traits;
+    using bin_node = bitmap_indexed_node<K, T, Hash, Policy>;
+    using hcn_node = hash_collision_node<K, T, Hash, Policy>;
+    using lookup = trie_lookup<K, T, Hash, Policy>;
+    using slot = node_slot<K, T, Hash, Policy>;
+
+public:
+    using value_type = typename node_type::value_type;
+    using node_ptr = typename node_type::node_ptr;
+
+    // keeps the keys in both tries if common, otherwise those only in a
+    explicit trie_filter(bool common) :
+        common(common)
+    {}
+
+    // Filters a by b, nodes at the same position at shift, returning
+    // null if nothing is left
+    node_ptr filter(const node_ptr& a, const node_ptr& b, uint32_t shift)
+    {
+        if (a == b) {
+            if (common) {
+                return a;
+            }
+            removed += count_values(a.get());
+            return {};
+        }
+
+        // collisions are rare; look their values up one by one
+        if (a->kind() == node_kind::hash_collision) {
+            typename hcn_node::array_type kept;
+            for (const auto& value : a->data()) {
+                const auto& key = traits::key(value);
+                auto found = lookup::find(b.get(), shift, Hash{}(key), key);
+                if ((found != nullptr) == common) {
+                    kept.push_back(value);
+                }
+            }
+            if (kept.size() == a->data().size()) {
+                return a;
+            }
+            return collision(shift, std::move(kept), a->data().size());
+        } else if (b->kind() == node_kind::hash_collision) {
+            if (common) {
+                typename hcn_node::array_type kept;
+                for (const auto& value : b->data()) {
+                    const auto& key = traits::key(value);
+                    if (auto found = lookup::find(a.get(), shift, Hash{}(key),
+                                key)) {
+                        kept.push_back(*found);
+                    }
+                }
+                return collision(shift, std::move(kept),
+                        count_values(a.get()));
+            }
+
+            auto n = a;
+            for (const auto& value : b->data()) {
+                const auto& key = traits::key(value);
+                auto next = n->without(shift, Hash{}(key), key);
+                removed += next != n;
+                n = std::move(next);
+                if (!n) {
+                    break;
+                }
+            }
+            return n;
+        }
+
+        std::array<slot, 32> vals{};
+        std::array<node_ptr, 32> kids;
+        bool sameAsA = true;
+
+        for (uint32_t i = 0; i < 32; i++) {
+            auto sa = slot_at(a.get(), i);
+            auto sb = slot_at(b.get(), i);
+
+            if (!sa.value && !sa.child) {
+                continue;
+            } else if (!sb.value && !sb.child) {
+                if (common) {
+                    removed += sa.value ? 1 : count_values(sa.child->get());
+                    sameAsA = false;
+                } else {
+                    vals[i] = sa;
+                    if (sa.child) {
+                        kids[i] = *sa.child;
+                    }
+                }
+            } else if (sa.value) {
+                const auto& key = traits::key(*sa.value);
+                bool inB = sb.value
+                                   ? traits::key(*sb.value) == key
+                                   : lookup::find(sb.child->get(), shift + 5,
+                                             sa.hash(), key) != nullptr;
+                if (inB == common) {
+                    vals[i] = sa;
+                } else {
+                    removed++;
+                    sameAsA = false;
+                }
+            } else if (sb.value) {
+                const auto& child = *sa.child;
+                const auto& key = traits::key(*sb.value);
+                if (common) {
+                    // at most b's one value is left
+                    auto found = lookup::find(child.get(), shift + 5,
+                            sb.hash(), key);
+                    removed += count_values(child.get()) - (found != nullptr);
+                    if (found) {
+                        vals[i] = {found, nullptr, sb.memo};
+                    }
+                    sameAsA = false;
+                } else {
+                    auto n = child->without(shift + 5, sb.hash(), key);
+                    removed += n != child;
+                    sameAsA &= n == child;
+                    setChild(vals, kids, i, std::move(n), child);
+                }
+            } else {
+                auto n = filter(*sa.child, *sb.child, shift + 5);
+                sameAsA &= n == *sa.child;
+                setChild(vals, kids, i, std::move(n), *sa.child);
+            }
+        }
+
+        if (sameAsA) {
+            return a;
+        }
+        return assemble_node(vals, kids, shift);
+    }
+
+    // number of a's values that were dropped
+    std::size_t size() const noexcept { return removed; }
+
+private:
+    // Puts subtree n, which replaced old, in slot i. If it's been left
+    // with a single value, the value is pulled up into the slot.
+    static void setChild(std::array<slot, 32>& vals,
+            std::array<node_ptr, 32>& kids, uint32_t i, node_ptr n,
+            const node_ptr& old)
+    {
+        if (n && n != old && n->kind() == node_kind::bitmap_indexed) {
+            auto bin = static_cast<const bin_node*>(n.get());
+            if (!bin->nodemap && popcount(bin->datamap) == 1) {
+                vals[i] = {bin->values(), nullptr,
+                        Policy::memoize_hash ? bin->hashes() : nullptr};
+            }
+        }
+
+        // also keeps a pulled up value's node alive
+        kids[i] = std::move(n);
+    }
+
+    // the values kept from a collision that held total
+    node_ptr collision(uint32_t shift, typename hcn_node::array_type kept,
+            std::size_t total)
+    {
+        removed += total - kept.size();
+        if (kept.empty()) {
+            return {};
+        }
+
+        auto hash = Hash{}(traits::key(kept[0]));
+        if (kept.size() == 1) {
+            return bin_node::single(edit_type{}, shift, hash, kept[0]);
+        }
+        auto len = kept.size();
+        return make_node<hcn_node>(edit_type{}, hash, len, std::move(kept));
+    }
+
+    bool common;
+    std::size_t removed = 0;
+};
+
+// Adds up the nodes of a trie, and the memory they take, into a
+// map_stats. Nodes also in a reference trie count as shared, and so
+// does everything under them.
+template <class K, class T, class Hash, class Policy>
+class trie_stats
+{
+    using node_type = node<K, T, Hash, Policy>;
+
+public:
+    // notes the nodes of the reference trie
+    void reference(const node_type* n)
+    {
+        refNodes.insert(n);
+        for (const auto& child : n->nodes()) {
+            if (child) {
+                reference(child.get());
+            }
+        }
+    }
+
+    template <class Stats>
+    void collect(const node_type* n, uint32_t depth, bool shared,
+            Stats& stats) const
+    {
+        shared = shared || refNodes.count(n);
+
+        auto bytes = n->allocated();
+        stats.bytes += bytes;
+        if (shared) {
+            stats.shared_bytes += bytes;
+        }
+
+        switch (n->kind()) {
+        case node_kind::bitmap_indexed:
+            stats.bitmap_nodes++;
+            break;
+        case node_kind::array:
+            stats.array_nodes++;
+            break;
+        case node_kind::hash_collision:
+            stats.collision_nodes++;
+            break;
+        }
+
+        if (auto values = n->data().size()) {
+            if (stats.depths.size() <= depth) {
+                stats.depths.resize(depth + 1);
+            }
+            stats.depths[depth] += values;
+        }
+
+        for (const auto& child : n->nodes()) {
+            if (child) {
+                collect(child.get(), depth + 1, shared, stats);
+            }
+        }
+    }
+
+private:
+    std::unordered_set<const node_type*> refNodes;
+};
+
+// Walks two tries, reporting each key added, removed, or updated
+// going from a to b to a visitor. Subtrees the tries share are
+// skipped, so the cost follows the size of the changes rather than
+// the size of the tries.
+template <class K, class T, class Hash, class Policy, class Visitor>
+class trie_differ
+{
+    using node_type = node<K, T, Hash, Policy>;
+    using iterator = map_iterator<K, T, Hash, Policy>;
+    using lookup = trie_lookup<K, T, Hash, Policy>;
+
+public:
+    using value_type = typename node_type::value_type;
+
+    explicit trie_differ(Visitor& visitor) :
+        visitor(visitor)
+    {}
+
+    // Diffs a and b, nodes at the same position at shift; either may
+    // be null
+    void diff(const node_type* a, const node_type* b, uint32_t shift)
+    {
+        if (a == b) {
+            return;
+        } else if (!a) {
+            for (auto it = iterator{b}; it != iterator{}; ++it) {
+                visitor.added(it->first, it->second);
+            }
+            return;
+        } else if (!b) {
+            for (auto it = iterator{a}; it != iterator{}; ++it) {
+                visitor.removed(it->first, it->second);
+            }
+            return;
+        }
+
+        if (a->kind() == node_kind::hash_collision ||
+                b->kind() == node_kind::hash_collision) {
+            byLookup(a, b, shift);
+            return;
+        }
+
+        for (uint32_t i = 0; i < 32; i++) {
+            auto sa = slot_at(a, i);
+            auto sb = slot_at(b, i);
+
+            if (sa.value && sb.value) {
+                if (!(sa.value->first == sb.value->first)) {
+                    visitor.removed(sa.value->first, sa.value->second);
+                    visitor.added(sb.value->first, sb.value->second);
+                } else if (!(sa.value->second == sb.value->second)) {
+                    visitor.updated(sa.value->first, sa.value->second,
+                            sb.value->second);
+                }
+            } else if (sa.value && sb.child) {
+                valueToNode(*sa.value, sb.child->get());
+            } else if (sa.child && sb.value) {
+                nodeToValue(sa.child->get(), *sb.value);
+            } else if (sa.value) {
+                visitor.removed(sa.value->first, sa.value->second);
+            } else if (sb.value) {
+                visitor.added(sb.value->first, sb.value->second);
+            } else {
+                diff(sa.child ? sa.child->get() : nullptr,
+                        sb.child ? sb.child->get() : nullptr, shift + 5);
+            }
+        }
+    }
+
+private:
+    // a slot holding value became the subtree b
+    void valueToNode(const value_type& value, const node_type* b)
+    {
+        bool found = false;
+        for (auto it = iterator{b}; it != iterator{}; ++it) {
+            if (!(it->first == value.first)) {
+                visitor.added(it->first, it->second);
+            } else {
+                found = true;
+                if (!(it->second == value.second)) {
+                    visitor.updated(value.first, value.second, it->second);
+                }
+            }
+        }
+        if (!found) {
+            visitor.removed(value.first, value.second);
+        }
+    }
+
+    // the subtree a became a slot holding value
+    void nodeToValue(const node_type* a, const value_type& value)
+    {
+        bool found = false;
+        for (auto it = iterator{a}; it != iterator{}; ++it) {
+            if (!(it->first == value.first)) {
+                visitor.removed(it->first, it->second);
+            } else {
+                found = true;
+                if (!(it->second == value.second)) {
+                    visitor.updated(value.first, it->second, value.second);
+                }
+            }
+        }
+        if (!found) {
+            visitor.added(value.first, value.second);
+        }
+    }
+
+    // For collisions, which are rare, looks up each value on the
+    // other side
+    void byLookup(const node_type* a, const node_type* b, uint32_t shift)
+    {
+        for (auto it = iterator{a}; it != iterator{}; ++it) {
+            auto found = lookup::find(b, shift, Hash{}(it->first), it->first);
+            if (!found) {
+                visitor.removed(it->first, it->second);
+            } else if (!(found->second == it->second)) {
+                visitor.updated(it->first, it->second, found->second);
+            }
+        }
+        for (auto it = iterator{b}; it != iterator{}; ++it) {
+            if (!lookup::find(a, shift, Hash{}(it->first), it->first)) {
+                visitor.added(it->first, it->second);
+            }
+        }
+    }
+
+    Visitor& visitor;
 };
 
 } // namespace rw::pdata::detail
@@ -2,11 +2,47 @@
 #define RW_PDATA_MAP_H
 
 #include "fmt/format.h"
+#include "rw/pdata/hash.h"
 #include "rw/pdata/map-detail.h"
+#include "rw/pdata/policy.h"
+
+#include <initializer_list>
+#include <iosfwd>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 namespace rw::pdata {
 using namespace std::literals;
 
+// The nodes making up a version of a persistent_map, and the memory
+// they take, from persistent_map::stats()
+struct map_stats
+{
+    // nodes of each kind
+    std::size_t bitmap_nodes = 0;
+    std::size_t array_nodes = 0;
+    std::size_t collision_nodes = 0;
+
+    // Number of values at each depth, the root's at 0. Values much
+    // deeper than log32 of the map's size, or many in collision nodes,
+    // point to a poor hash.
+    std::vector<std::size_t> depths;
+
+    // bytes allocated for nodes, not counting what values allocate
+    // themselves
+    std::size_t bytes = 0;
+
+    // of those, the bytes in nodes shared with the reference version
+    // given to stats(), which this version costs nothing more to keep
+    std::size_t shared_bytes = 0;
+
+    std::size_t unique_bytes() const noexcept { return bytes - shared_bytes; }
+};
+
 template <class K, class T>
 class map_base : public std::enable_shared_from_this<map_base<K, T>>
 {
@@ -27,26 +63,39 @@ protected:
     }
 };
 
-template <class K, class T, class Hash>
+template <class K, class T, class Hash, class Policy>
 class persistent_map;
 
-template <class K, class T, class Hash = std::hash<K>>
+template <class K, class T, class Hash = std::hash<K>,
+        class Policy = shared_policy>
 class transient_map : public map_base<K, T>
 {
-    using node_type = detail::node<K, T, Hash>;
-    using bin_node = detail::bitmap_indexed_node<K, T, Hash>;
+    using node_type = detail::node<K, T, Hash, Policy>;
+    using bin_node = detail::bitmap_indexed_node<K, T, Hash, Policy>;
+    using node_ptr = typename node_type::node_ptr;
 
 public:
+    using value_type = typename node_type::value_type;
+    using const_iterator = detail::map_iterator<K, T, Hash, Policy>;
+    using iterator = const_iterator;
+
     transient_map() :
-        edit(std::make_shared<std::thread::id>(std::this_thread::get_id()))
+        edit(detail::newEdit())
     {}
 
     std::size_t size() const noexcept { return count; }
 
+    const_iterator begin() const
+    {
+        ensureEditable();
+        return const_iterator{root.get()};
+    }
+
+    const_iterator end() const { return {}; }
+
     std::shared_ptr<transient_map> assoc(const K& key, T val)
     {
-        // todo: check whether edit is invalid before reset here...
-        // if so, transient used after persistent
+        ensureEditable();
 
         typename node_type::value_type entry{key, val};
 
@@ -74,8 +123,7 @@ public:
 
     std::shared_ptr<transient_map> without(const K& key)
     {
-        // todo: check whether edit is invalid before reset here...
-        // if so, transient used after persistent
+        ensureEditable();
 
         if (!root) {
             return this->template shared_from_base<transient_map>();
@@ -95,21 +143,91 @@ public:
         return this->template shared_from_base<transient_map>();
     }
 
+    // Replaces key's value with fn(value), if key is there, finding and
+    // changing it in one pass, rather than a find() and an assoc()
+    template <class F>
+    std::shared_ptr<transient_map> update(const K& key, F fn)
+    {
+        detail::fn_updater<T, F> updater{fn, nullptr};
+        return updateWith(key, updater);
+    }
+
+    // Same as update(), but adds key with value init if it isn't there
+    template <class F>
+    std::shared_ptr<transient_map> upsert(const K& key, const T& init, F fn)
+    {
+        detail::fn_updater<T, F> updater{fn, &init};
+        return updateWith(key, updater);
+    }
+
+    // Removes key, which may be of any type comparable with K if Hash
+    // is transparent. The stored key is copied to remove it, so this
+    // only saves making a K when the key isn't there.
+    template <class Key, class H = Hash, class = typename H::is_transparent>
+    std::shared_ptr<transient_map> without(const Key& key)
+    {
+        ensureEditable();
+
+        if (auto found = lookup(key)) {
+            K stored = found->first;
+            return without(stored);
+        }
+        return this->template shared_from_base<transient_map>();
+    }
+
     std::optional<T> find(const K& key) const
     {
-        // todo: check whether edit is invalid before reset here...
-        // if so, transient used after persistent
+        ensureEditable();
 
-        if (root) {
-            auto entry = root->find(0, Hash{}(key), key);
-            if (entry) {
-                return std::get<typename node_type::value_type>(*entry).second;
-            }
+        if (auto found = lookup(key)) {
+            return found->second;
         }
+        return std::nullopt;
+    }
 
+    // find with any key type comparable with K, if Hash is transparent
+    template <class Key, class H = Hash, class = typename H::is_transparent>
+    std::optional<T> find(const Key& key) const
+    {
+        ensureEditable();
+
+        if (auto found = lookup(key)) {
+            return found->second;
+        }
         return std::nullopt;
     }
 
+    bool contains(const K& key) const
+    {
+        ensureEditable();
+        return lookup(key) != nullptr;
+    }
+
+    template <class Key, class H = Hash, class = typename H::is_transparent>
+    bool contains(const Key& key) const
+    {
+        ensureEditable();
+        return lookup(key) != nullptr;
+    }
+
+    // Like find(), but returns a pointer to the value in the map, or
+    // null, rather than a copy. It's only valid until the transient
+    // is next changed.
+    const T* find_ptr(const K& key) const
+    {
+        ensureEditable();
+        auto found = lookup(key);
+        return found ? &found->second : nullptr;
+    }
+
+    template <class Key, class H = Hash, class = typename H::is_transparent>
+    const T* find_ptr(const Key& key) const
+    {
+        ensureEditable();
+        auto found = lookup(key);
+        return found ? &found->second : nullptr;
+    }
+
     std::string dump(int indent) const
     {
         fmt::memory_buffer msg;
@@ -128,49 +246,153 @@ public:
         return fmt::to_string(msg);
     }
 
-    std::shared_ptr<persistent_map<K, T, Hash>> persistent()
+    std::shared_ptr<persistent_map<K, T, Hash, Policy>> persistent()
     {
-        // todo: check whether edit is invalid before reset here...
-        // if so, transient used after persistent
+        ensureEditable();
 
-        edit.reset();
+        // nodes made by this transient keep its id, which no other
+        // edit will match, so they can't change once shared
+        edit = 0;
 
-        // struct to allow creation using make_shared and a private ctor
-        struct pm_maker : public persistent_map<K, T, Hash>
-        {
-            pm_maker(int count, std::shared_ptr<node_type> root) :
-                persistent_map<K, T, Hash>(count, root)
-            {}
-        };
-
-        return std::make_shared<pm_maker>(count, root);
+        return persistent_map<K, T, Hash, Policy>::make(count, root);
     }
 
 private:
-    friend class persistent_map<K, T, Hash>;
+    friend class persistent_map<K, T, Hash, Policy>;
 
-    transient_map(int count, std::shared_ptr<node_type> root) :
-        edit(std::make_shared<std::thread::id>(std::this_thread::get_id())),
+    transient_map(int count, node_ptr root) :
+        edit(detail::newEdit()),
         count(count),
         root(root)
     {}
 
-    std::shared_ptr<std::thread::id> edit;
+    template <class Key>
+    const value_type* lookup(const Key& key) const
+    {
+        return detail::trie_lookup<K, T, Hash, Policy>::find(root.get(), 0,
+                Hash{}(key), key);
+    }
+
+    std::shared_ptr<transient_map> updateWith(const K& key,
+            detail::value_updater<T>& updater)
+    {
+        ensureEditable();
+
+        if (!root && !updater.initial()) {
+            return this->template shared_from_base<transient_map>();
+        }
+
+        bool addedLeaf = false;
+        auto hash = Hash{}(key);
+        decltype(root) newroot{};
+        if (!root) {
+            newroot = bin_node::emptyBin.assoc(edit, 0, hash,
+                    {key, *updater.initial()}, addedLeaf);
+        } else {
+            newroot = root->update(edit, 0, hash, key, updater, addedLeaf);
+        }
+
+        if (newroot != root) {
+            root = newroot;
+        }
+
+        if (addedLeaf) {
+            count++;
+        }
+
+        return this->template shared_from_base<transient_map>();
+    }
+
+    // throws if persistent() has already been called
+    void ensureEditable() const
+    {
+        if (!edit) {
+            throw std::logic_error("transient_map used after persistent()");
+        }
+    }
+
+    detail::edit_type edit;
     int count = 0;
-    std::shared_ptr<node_type> root;
+    node_ptr root;
 };
 
-template <class K, class T, class Hash = std::hash<K>>
+template <class K, class T, class Hash = std::hash<K>,
+        class Policy = shared_policy>
 class persistent_map : public map_base<K, T>
 {
-    using node_type = detail::node<K, T, Hash>;
-    using bin_node = detail::bitmap_indexed_node<K, T, Hash>;
+    using node_type = detail::node<K, T, Hash, Policy>;
+    using bin_node = detail::bitmap_indexed_node<K, T, Hash, Policy>;
+    using node_ptr = typename node_type::node_ptr;
 
 public:
+    using value_type = typename node_type::value_type;
+    using const_iterator = detail::map_iterator<K, T, Hash, Policy>;
+    using iterator = const_iterator;
+
     persistent_map() = default;
 
+    // Builds a map from a range of key/value pairs all at once, which
+    // is much faster than assoc'ing them one by one. If a key appears
+    // more than once, its last value is kept.
+    template <class InputIt>
+    static std::shared_ptr<persistent_map> create(InputIt first, InputIt last)
+    {
+        std::vector<value_type> values(first, last);
+
+        detail::trie_builder<K, T, Hash, Policy> builder;
+        auto root = builder.build(values);
+        return make(builder.size(), std::move(root));
+    }
+
+    static std::shared_ptr<persistent_map> create(
+            std::initializer_list<value_type> values)
+    {
+        return create(values.begin(), values.end());
+    }
+
+    // Same as create(), but builds the subtrees under the root on up
+    // to the given number of threads. Small inputs use fewer threads.
+    template <class InputIt>
+    static std::shared_ptr<persistent_map> create_parallel(InputIt first,
+            InputIt last,
+            unsigned threads = std::thread::hardware_concurrency())
+    {
+        std::vector<value_type> values(first, last);
+
+        detail::trie_builder<K, T, Hash, Policy> builder;
+        auto root = builder.build(values, threads);
+        return make(builder.size(), std::move(root));
+    }
+
     std::size_t size() const noexcept { return count; }
 
+    const_iterator begin() const { return const_iterator{root.get()}; }
+    const_iterator end() const { return {}; }
+
+    // Folds the map into init, as acc = f(std::move(acc), key, val) for
+    // each value in iteration order. It recurses over the trie node by
+    // node, which is quicker than iterating.
+    template <class Acc, class F>
+    Acc reduce(Acc init, F f) const
+    {
+        return detail::trie_reducer<K, T, Hash, Policy>::reduce(root.get(),
+                std::move(init), f);
+    }
+
+    // Same as reduce(), but folds the subtrees on up to the given number
+    // of threads, each from a copy of init, and joins their results with
+    // combine(std::move(a), std::move(b)). The results are combined in
+    // iteration order, so combine need only be associative, and init
+    // must be its identity. f and combine are called concurrently.
+    // Small maps use fewer threads.
+    template <class Acc, class F, class Combine>
+    Acc parallel_reduce(Acc init, F f, Combine combine,
+            unsigned threads = std::thread::hardware_concurrency()) const
+    {
+        return detail::trie_reducer<K, T, Hash, Policy>::parallelReduce(
+                root.get(), count, init, f, combine, threads);
+    }
+
     // Returns a new persistent_map, adding or replacing a value in the map.
     std::shared_ptr<persistent_map> assoc(const K& key, T val)
     {
@@ -197,15 +419,26 @@ public:
             cnt++;
         }
 
-        // struct to allow creation using make_shared and a private ctor
-        struct pm_maker : public persistent_map
-        {
-            pm_maker(int count, std::shared_ptr<node_type> root) :
-                persistent_map(count, root)
-            {}
-        };
+        return make(cnt, newroot);
+    }
 
-        return std::make_shared<pm_maker>(cnt, newroot);
+    // Returns a new persistent_map with key's value replaced by
+    // fn(value), if key is there. It's found and replaced in one
+    // descent, so the key is hashed and its path copied once, rather
+    // than a find() then an assoc().
+    template <class F>
+    std::shared_ptr<persistent_map> update(const K& key, F fn)
+    {
+        detail::fn_updater<T, F> updater{fn, nullptr};
+        return updateWith(key, updater);
+    }
+
+    // Same as update(), but adds key with value init if it isn't there
+    template <class F>
+    std::shared_ptr<persistent_map> upsert(const K& key, const T& init, F fn)
+    {
+        detail::fn_updater<T, F> updater{fn, &init};
+        return updateWith(key, updater);
     }
 
     std::shared_ptr<persistent_map> without(const K& key)
@@ -222,29 +455,176 @@ public:
             return this->template shared_from_base<persistent_map>();
         }
 
-        // struct to allow creation using make_shared and a private ctor
-        struct pm_maker : public persistent_map
-        {
-            pm_maker(int count, std::shared_ptr<node_type> root) :
-                persistent_map(count, root)
-            {}
-        };
+        return make(count - 1, newroot);
+    }
+
+    // without for any key type comparable with K, if Hash is transparent
+    template <class Key, class H = Hash, class = typename H::is_transparent>
+    std::shared_ptr<persistent_map> without(const Key& key)
+    {
+        auto hash = Hash{}(key);
+        auto found = detail::trie_lookup<K, T, Hash, Policy>::find(root.get(), 0,
+                hash, key);
+        if (!found) {
+            return this->template shared_from_base<persistent_map>();
+        }
 
-        return std::make_shared<pm_maker>(count - 1, newroot);
+        // the stored key stays alive with this map's nodes, which
+        // without() doesn't change
+        return make(count - 1, root->without(0, hash, found->first));
     }
 
-    std::optional<T> find(const K& key) const
+    // Returns a new persistent_map with each of a range of key/value
+    // pairs added or replaced, as if assoc'd in order. The updates are
+    // applied together, in trie order, under a single edit like a
+    // transient's, so each node they touch is copied once, and only
+    // one new map is made.
+    template <class InputIt>
+    std::shared_ptr<persistent_map> assoc_many(InputIt first, InputIt last)
     {
-        if (root) {
-            auto entry = root->find(0, Hash{}(key), key);
-            if (entry) {
-                return std::get<typename node_type::value_type>(*entry).second;
+        std::vector<value_type> values(first, last);
+        auto updates = detail::trie_sorted<Hash>(values,
+                [](const value_type& value) -> const K& { return value.first; });
+
+        auto edit = detail::newEdit();
+
+        auto newroot = root;
+        auto cnt = count;
+        for (const auto& update : updates) {
+            bool addedLeaf = false;
+            if (!newroot) {
+                newroot = bin_node::emptyBin.assoc(edit, 0, update.hash,
+                        *update.item, addedLeaf);
+            } else {
+                newroot = newroot->assoc(edit, 0, update.hash, *update.item,
+                        addedLeaf);
+            }
+
+            if (addedLeaf) {
+                cnt++;
             }
         }
 
+        if (newroot == root) {
+            return this->template shared_from_base<persistent_map>();
+        }
+        return make(cnt, std::move(newroot));
+    }
+
+    // Returns a new persistent_map without any of a range of keys,
+    // removing them all at once, like assoc_many
+    template <class InputIt>
+    std::shared_ptr<persistent_map> without_many(InputIt first, InputIt last)
+    {
+        if (!root) {
+            return this->template shared_from_base<persistent_map>();
+        }
+
+        std::vector<K> keys(first, last);
+        auto updates = detail::trie_sorted<Hash>(keys,
+                [](const K& key) -> const K& { return key; });
+
+        auto edit = detail::newEdit();
+
+        auto newroot = root;
+        auto cnt = count;
+        for (const auto& update : updates) {
+            if (!newroot) {
+                break;
+            }
+
+            bool removedLeaf = false;
+            newroot = newroot->without(edit, 0, update.hash, *update.item,
+                    removedLeaf);
+
+            if (removedLeaf) {
+                cnt--;
+            }
+        }
+
+        if (newroot == root) {
+            return this->template shared_from_base<persistent_map>();
+        }
+        return make(cnt, std::move(newroot));
+    }
+
+    // Returns a map with the keys of both maps. Where a key is in both
+    // with different values, its value is resolve(ours, theirs). The
+    // maps are merged node by node: subtrees they share, or that only
+    // one of them has, are reused rather than copied.
+    template <class Resolve>
+    std::shared_ptr<persistent_map> merge(
+            const std::shared_ptr<persistent_map>& other, Resolve resolve)
+    {
+        if (!other->root || other->root == root) {
+            return this->template shared_from_base<persistent_map>();
+        } else if (!root) {
+            return other;
+        }
+
+        detail::trie_merger<K, T, Hash, Policy, Resolve> merger{
+                std::move(resolve)};
+        auto newroot = merger.merge(root, other->root, 0);
+
+        if (newroot == root) {
+            return this->template shared_from_base<persistent_map>();
+        } else if (newroot == other->root) {
+            return other;
+        }
+        return make(count + merger.size(), newroot);
+    }
+
+    // Same as above, with other's values taking precedence
+    std::shared_ptr<persistent_map> merge(
+            const std::shared_ptr<persistent_map>& other)
+    {
+        return merge(other, [](const T&, const T& theirs) { return theirs; });
+    }
+
+    std::optional<T> find(const K& key) const
+    {
+        if (auto found = lookup(key)) {
+            return found->second;
+        }
+        return std::nullopt;
+    }
+
+    // Lookups with any key type comparable with K, if Hash is
+    // transparent (defines is_transparent), like string_hash, so
+    // string keyed maps can be searched with a string_view
+    template <class Key, class H = Hash, class = typename H::is_transparent>
+    std::optional<T> find(const Key& key) const
+    {
+        if (auto found = lookup(key)) {
+            return found->second;
+        }
         return std::nullopt;
     }
 
+    bool contains(const K& key) const { return lookup(key) != nullptr; }
+
+    template <class Key, class H = Hash, class = typename H::is_transparent>
+    bool contains(const Key& key) const
+    {
+        return lookup(key) != nullptr;
+    }
+
+    // Like find(), but returns a pointer to the value in the map, or
+    // null, rather than a copy. It stays valid for as long as this map
+    // does.
+    const T* find_ptr(const K& key) const
+    {
+        auto found = lookup(key);
+        return found ? &found->second : nullptr;
+    }
+
+    template <class Key, class H = Hash, class = typename H::is_transparent>
+    const T* find_ptr(const Key& key) const
+    {
+        auto found = lookup(key);
+        return found ? &found->second : nullptr;
+    }
+
     std::string dump(int indent) const
     {
         fmt::memory_buffer msg;
@@ -263,13 +643,59 @@ public:
         return fmt::to_string(msg);
     }
 
-    std::shared_ptr<transient_map<K, T, Hash>> transient()
+    // Reports the nodes making up this version of the map, and the
+    // memory they take
+    map_stats stats() const
+    {
+        map_stats stats;
+        if (root) {
+            detail::trie_stats<K, T, Hash, Policy>{}.collect(root.get(), 0,
+                    false, stats);
+        }
+        return stats;
+    }
+
+    // Same, also counting the bytes in nodes shared with reference,
+    // such as an earlier version of the map
+    map_stats stats(const persistent_map& reference) const
+    {
+        map_stats stats;
+        if (root) {
+            detail::trie_stats<K, T, Hash, Policy> collector;
+            if (reference.root) {
+                collector.reference(reference.root.get());
+            }
+            collector.collect(root.get(), 0, false, stats);
+        }
+        return stats;
+    }
+
+    // Maps are equal if they hold the same keys with equal values.
+    // Subtrees shared by both are skipped, so comparing versions
+    // of a map costs roughly the size of their differences.
+    friend bool operator==(const persistent_map& a, const persistent_map& b)
+    {
+        if (a.count != b.count) {
+            return false;
+        } else if (a.root == b.root || a.count == 0) {
+            return true;
+        }
+
+        return a.root->equiv(b.root.get(), 0, 0);
+    }
+
+    friend bool operator!=(const persistent_map& a, const persistent_map& b)
+    {
+        return !(a == b);
+    }
+
+    std::shared_ptr<transient_map<K, T, Hash, Policy>> transient()
     {
         // struct to allow creation using make_shared and a private ctor
-        struct tm_maker : public transient_map<K, T, Hash>
+        struct tm_maker : public transient_map<K, T, Hash, Policy>
         {
-            tm_maker(int count, std::shared_ptr<node_type> root) :
-                transient_map<K, T, Hash>(count, root)
+            tm_maker(int count, node_ptr root) :
+                transient_map<K, T, Hash, Policy>(count, root)
             {}
         };
 
@@ -277,17 +703,94 @@ public:
     }
 
 private:
-    friend class transient_map<K, T, Hash>;
+    friend class transient_map<K, T, Hash, Policy>;
+
+    template <class K2, class T2, class Hash2, class Policy2, class Visitor>
+    friend void diff(const persistent_map<K2, T2, Hash2, Policy2>& from,
+            const persistent_map<K2, T2, Hash2, Policy2>& to,
+            Visitor&& visitor);
+
+    template <class K2, class T2, class Hash2, class Policy2>
+    friend void write_snapshot(const persistent_map<K2, T2, Hash2, Policy2>& m,
+            std::ostream& out);
+
+    template <class K2, class T2, class Hash2, class Policy2>
+    friend class map_journal_writer;
 
-    persistent_map(int count, std::shared_ptr<node_type> root) :
+    persistent_map(int count, node_ptr root) :
         count(count),
         root(root)
     {}
 
+    static std::shared_ptr<persistent_map> make(int count, node_ptr root)
+    {
+        // struct to allow creation using make_shared and a private ctor
+        struct pm_maker : public persistent_map
+        {
+            pm_maker(int count, node_ptr root) :
+                persistent_map(count, std::move(root))
+            {}
+        };
+
+        return std::make_shared<pm_maker>(count, std::move(root));
+    }
+
+    template <class Key>
+    const value_type* lookup(const Key& key) const
+    {
+        return detail::trie_lookup<K, T, Hash, Policy>::find(root.get(), 0,
+                Hash{}(key), key);
+    }
+
+    std::shared_ptr<persistent_map> updateWith(const K& key,
+            detail::value_updater<T>& updater)
+    {
+        if (!root && !updater.initial()) {
+            return this->template shared_from_base<persistent_map>();
+        }
+
+        bool addedLeaf = false;
+        auto hash = Hash{}(key);
+        decltype(root) newroot{};
+        if (!root) {
+            newroot = bin_node::emptyBin.assoc(0, hash,
+                    {key, *updater.initial()}, addedLeaf);
+        } else {
+            newroot = root->update(0, hash, key, updater, addedLeaf);
+        }
+
+        if (newroot == root) {
+            return this->template shared_from_base<persistent_map>();
+        }
+
+        return make(addedLeaf ? count + 1 : count, std::move(newroot));
+    }
+
     int count = 0;
-    std::shared_ptr<node_type> root;
+    node_ptr root;
 };
 
+// Reports what changed going from one version of a map to another,
+// calling visitor.added(key, val), visitor.removed(key, val), and
+// visitor.updated(key, oldVal, newVal). Subtrees the versions share
+// are skipped, so the cost follows the number of changes rather than
+// the size of the maps.
+template <class K, class T, class Hash, class Policy, class Visitor>
+void diff(const persistent_map<K, T, Hash, Policy>& from,
+        const persistent_map<K, T, Hash, Policy>& to, Visitor&& visitor)
+{
+    using differ_type = detail::trie_differ<K, T, Hash, Policy,
+            std::remove_reference_t<Visitor>>;
+
+    differ_type differ{visitor};
+    differ.diff(from.root.get(), to.root.get(), 0);
+}
+
+// persistent_map using the canonical CHAMP encoding
+template <class K, class T, class Hash = std::hash<K>,
+        class Policy = shared_policy>
+using champ_map = persistent_map<K, T, Hash, champ_policy<Policy>>;
+
 } // namespace rw::pdata
 
 #endif // RW_PDATA_MAP_H
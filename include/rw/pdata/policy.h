@@ -0,0 +1,263 @@
+#ifndef RW_PDATA_POLICY_H
+#define RW_PDATA_POLICY_H
+
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#include "rw/pdata/pool.h"
+#include "rw/pdata/reclaim.h"
+
+namespace rw::pdata {
+namespace detail {
+
+// Reference count that may be retained and released from any
+// thread. Increments are relaxed; decrements are acquire-release, so
+// the final one synchronizes with every earlier release, and the
+// owner sees all writes before the object is destroyed. (A release
+// decrement plus an acquire fence on the last one would do, but
+// ThreadSanitizer doesn't understand fences.)
+class atomic_refcount
+{
+public:
+    explicit atomic_refcount(uint32_t count = 0) noexcept :
+        count(count)
+    {}
+
+    void inc() noexcept { count.fetch_add(1, std::memory_order_relaxed); }
+
+    // returns true if this released the last reference
+    bool dec() noexcept
+    {
+        return count.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
+    uint32_t use_count() const noexcept
+    {
+        return count.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint32_t> count;
+};
+
+// Plain reference count, for data that never leaves its thread
+class local_refcount
+{
+public:
+    explicit local_refcount(uint32_t count = 0) noexcept :
+        count(count)
+    {}
+
+    void inc() noexcept { count++; }
+
+    // returns true if this released the last reference
+    bool dec() noexcept { return --count == 0; }
+
+    uint32_t use_count() const noexcept { return count; }
+
+private:
+    uint32_t count;
+};
+
+// Intrusive smart pointer. T provides retain() and release(), with
+// release() destroying the object when the last reference is gone.
+// Because the count lives in the object, a ref_ptr can be made from
+// a raw pointer at any time (e.g. from this).
+template <class T>
+class ref_ptr
+{
+public:
+    using element_type = T;
+
+    constexpr ref_ptr() noexcept = default;
+    constexpr ref_ptr(std::nullptr_t) noexcept {}
+
+    ref_ptr(T* p) noexcept :
+        p(p)
+    {
+        if (p) {
+            p->retain();
+        }
+    }
+
+    ref_ptr(const ref_ptr& other) noexcept :
+        ref_ptr(other.p)
+    {}
+
+    ref_ptr(ref_ptr&& other) noexcept :
+        p(std::exchange(other.p, nullptr))
+    {}
+
+    template <class U>
+    ref_ptr(const ref_ptr<U>& other) noexcept :
+        ref_ptr(other.get())
+    {}
+
+    template <class U>
+    ref_ptr(ref_ptr<U>&& other) noexcept :
+        p(other.detach())
+    {}
+
+    ~ref_ptr()
+    {
+        if (p) {
+            p->release();
+        }
+    }
+
+    ref_ptr& operator=(ref_ptr other) noexcept
+    {
+        std::swap(p, other.p);
+        return *this;
+    }
+
+    void reset() noexcept { ref_ptr{}.swap(*this); }
+    void swap(ref_ptr& other) noexcept { std::swap(p, other.p); }
+
+    // give up ownership without releasing
+    T* detach() noexcept { return std::exchange(p, nullptr); }
+
+    T* get() const noexcept { return p; }
+    T& operator*() const noexcept { return *p; }
+    T* operator->() const noexcept { return p; }
+    explicit operator bool() const noexcept { return p != nullptr; }
+
+private:
+    T* p = nullptr;
+};
+
+template <class T, class U>
+bool operator==(const ref_ptr<T>& a, const ref_ptr<U>& b) noexcept
+{
+    return a.get() == b.get();
+}
+
+template <class T, class U>
+bool operator!=(const ref_ptr<T>& a, const ref_ptr<U>& b) noexcept
+{
+    return a.get() != b.get();
+}
+
+template <class T>
+bool operator==(const ref_ptr<T>& a, std::nullptr_t) noexcept
+{
+    return !a;
+}
+
+template <class T>
+bool operator!=(const ref_ptr<T>& a, std::nullptr_t) noexcept
+{
+    return bool(a);
+}
+
+template <class T, class U>
+ref_ptr<T> static_pointer_cast(const ref_ptr<U>& p) noexcept
+{
+    return ref_ptr<T>{static_cast<T*>(p.get())};
+}
+
+template <class T, class U>
+ref_ptr<T> dynamic_pointer_cast(const ref_ptr<U>& p) noexcept
+{
+    return ref_ptr<T>{dynamic_cast<T*>(p.get())};
+}
+
+// Identifies the transient (or batch update) that owns a node, so the
+// node can be changed in place. Zero means no owner. Ids are never
+// reused, so nodes left behind by a finished transient can't be edited
+// again, and comparing them needs no atomics.
+using edit_type = uint64_t;
+
+inline edit_type newEdit() noexcept
+{
+    static std::atomic<edit_type> next{1};
+    return next.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline bool sameEdit(edit_type a, edit_type b) noexcept
+{
+    return a != 0 && a == b;
+}
+
+} // namespace detail
+
+// Memory policies control how pdata nodes are shared and allocated.
+// The default, shared_policy, uses atomic reference counts so maps can
+// be handed between threads freely. local_policy uses plain counts, and
+// is only safe when every version of the map stays on a single thread.
+// Both allocate nodes with operator new, and destroy them as soon as
+// their last reference goes.
+struct shared_policy
+{
+    using refcount_type = detail::atomic_refcount;
+    using allocator_type = detail::new_allocator;
+    using reclaimer_type = detail::immediate_reclaimer;
+
+    static constexpr bool canonical = false;
+    static constexpr bool memoize_hash = false;
+};
+
+struct local_policy
+{
+    using refcount_type = detail::local_refcount;
+    using allocator_type = detail::new_allocator;
+    using reclaimer_type = detail::immediate_reclaimer;
+
+    static constexpr bool canonical = false;
+    static constexpr bool memoize_hash = false;
+};
+
+// Allocates nodes from size-classed, per-thread pools on top of
+// another policy. Building and editing maps then mostly reuses blocks
+// freed by earlier versions, without going through malloc, at the cost
+// of never returning pooled memory to the system.
+template <class Base = shared_policy>
+struct pool_policy : Base
+{
+    using allocator_type = detail::pool_allocator;
+};
+
+// Defers destroying nodes whose last reference goes, on top of another
+// policy. They're queued, then destroyed a slice at a time by reclaim(),
+// or by a background_reclaimer, so the thread dropping a large map pays
+// for a queue push rather than a walk of the whole trie. Subtrees are
+// only queued as their parents are destroyed, so teardown is iterative
+// however deep the trie. The queue is shared by all threads, and any
+// of them may destroy a node, so Base's refcounts must be atomic.
+template <class Base = shared_policy>
+struct deferred_policy : Base
+{
+    static_assert(std::is_same_v<typename Base::refcount_type,
+                          detail::atomic_refcount>,
+            "deferred_policy needs atomic refcounts, as nodes may be "
+            "reclaimed on another thread");
+
+    using reclaimer_type = detail::deferred_reclaimer;
+};
+
+// Selects the canonical (CHAMP) encoding on top of another policy.
+// Nodes are never promoted to array_node, and without() collapses
+// nodes left holding a single value or collision, so the shape of a
+// map's trie depends only on its contents, and maps can be compared
+// node by node, skipping shared subtrees.
+template <class Base = shared_policy>
+struct champ_policy : Base
+{
+    static constexpr bool canonical = true;
+};
+
+// Keeps each value's full hash next to it, on top of another policy,
+// for keys that are expensive to hash, such as long strings. Nodes are
+// split, promoted and merged without rehashing, and lookups skip the
+// key comparison when the hashes differ. Costs a hash_type per value.
+template <class Base = shared_policy>
+struct memo_policy : Base
+{
+    static constexpr bool memoize_hash = true;
+};
+
+} // namespace rw::pdata
+
+#endif // RW_PDATA_POLICY_H
@@ -0,0 +1,257 @@
+#ifndef RW_PDATA_POOL_H
+#define RW_PDATA_POOL_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace rw::pdata::detail {
+
+// Allocates nodes with the global operator new
+struct new_allocator
+{
+    static void* allocate(std::size_t size) { return ::operator new(size); }
+
+    static void deallocate(void* p, std::size_t size) noexcept
+    {
+        ::operator delete(p, size);
+    }
+};
+
+// Size-classed node pool. Each thread keeps a free list per size
+// class, and carves new blocks off its own chunk when a list is empty,
+// so most allocations and frees touch nothing shared. Blocks freed on
+// another thread join that thread's lists; lists that grow long, and
+// those of exiting threads, go back to a shared pool for reuse, along
+// with the unused rest of an exiting thread's chunk. Chunks are kept
+// for the life of the process.
+class pool_allocator
+{
+public:
+    static constexpr std::size_t granularity = 16;
+    static constexpr std::size_t max_size = 1024;
+    static constexpr std::size_t chunk_size = 256 * 1024;
+
+    static void* allocate(std::size_t size)
+    {
+        if (size > max_size) {
+            return ::operator new(size);
+        }
+
+        auto cls = sizeClass(size);
+        auto& list = local().lists[cls];
+        if (list.head) {
+            auto block = list.head;
+            list.head = block->next;
+            list.count--;
+            return block;
+        }
+
+        return refill(cls);
+    }
+
+    static void deallocate(void* p, std::size_t size) noexcept
+    {
+        if (size > max_size) {
+            ::operator delete(p, size);
+            return;
+        }
+
+        auto cls = sizeClass(size);
+        auto& list = local().lists[cls];
+        list.head = new (p) block{list.head};
+        if (++list.count >= 2 * batch) {
+            giveBack(cls, batch);
+        }
+    }
+
+private:
+    static constexpr std::size_t classes = max_size / granularity;
+
+    // blocks moved between a thread and the shared pool at a time
+    static constexpr std::size_t batch = 256;
+
+    struct block
+    {
+        block* next;
+    };
+
+    struct free_list
+    {
+        block* head;
+        std::size_t count;
+    };
+
+    // Trivially destructible, so it stays usable while the thread
+    // exits, when other thread_locals may still free nodes
+    struct thread_state
+    {
+        std::array<free_list, classes> lists;
+        char* bump;
+        char* bumpEnd;
+        bool registered;
+    };
+
+    // returns a thread's free blocks and the rest of its chunk to the
+    // shared pool when it exits
+    struct thread_exit
+    {
+        ~thread_exit()
+        {
+            for (std::size_t cls = 0; cls < classes; cls++) {
+                giveBack(cls, local().lists[cls].count);
+            }
+            giveBackChunk();
+        }
+    };
+
+    // the unused end of an exited thread's chunk, kept in the space
+    // itself
+    struct spare_chunk
+    {
+        spare_chunk* next;
+        char* end;
+    };
+
+    struct shared_pool
+    {
+        std::mutex mutex;
+        std::array<free_list, classes> lists{};
+        spare_chunk* spares = nullptr;
+        std::vector<void*> chunks;
+    };
+
+    static std::size_t sizeClass(std::size_t size) noexcept
+    {
+        return (std::max<std::size_t>(size, 1) - 1) / granularity;
+    }
+
+    static thread_state& local() noexcept
+    {
+        thread_local thread_state state{};
+        return state;
+    }
+
+    static shared_pool& shared()
+    {
+        // never destroyed, as nodes may be freed during static
+        // destruction
+        static auto pool = new shared_pool;
+        return *pool;
+    }
+
+    static void* refill(std::size_t cls)
+    {
+        auto& state = local();
+        if (!state.registered) {
+            thread_local thread_exit exit;
+            state.registered = true;
+        }
+
+        // take a batch freed by other threads if there is one
+        auto& pool = shared();
+        {
+            std::lock_guard<std::mutex> lock{pool.mutex};
+            auto& from = pool.lists[cls];
+            if (from.head) {
+                auto& to = state.lists[cls];
+                auto block = from.head;
+                from.head = block->next;
+                from.count--;
+                for (std::size_t n = 1; n < batch && from.head; n++) {
+                    auto next = from.head;
+                    from.head = next->next;
+                    from.count--;
+                    next->next = to.head;
+                    to.head = next;
+                    to.count++;
+                }
+                return block;
+            }
+        }
+
+        // otherwise bump allocate from the thread's chunk, or what's
+        // left of one an exited thread had, or a new one
+        auto size = (cls + 1) * granularity;
+        if (state.bump + size > state.bumpEnd) {
+            spare_chunk* spare;
+            {
+                std::lock_guard<std::mutex> lock{pool.mutex};
+                spare = pool.spares;
+                if (spare) {
+                    pool.spares = spare->next;
+                }
+            }
+
+            if (spare) {
+                state.bumpEnd = spare->end;
+                state.bump = reinterpret_cast<char*>(spare);
+            } else {
+                auto chunk = static_cast<char*>(::operator new(chunk_size));
+                {
+                    std::lock_guard<std::mutex> lock{pool.mutex};
+                    pool.chunks.push_back(chunk);
+                }
+                state.bump = chunk;
+                state.bumpEnd = chunk + chunk_size;
+            }
+        }
+
+        auto p = state.bump;
+        state.bump += size;
+        return p;
+    }
+
+    // Moves count blocks from this thread's list to the shared pool.
+    // Locking can't throw here: std::mutex::lock only fails for a mutex
+    // that's invalid or already held by this thread, and the pool's is
+    // never destroyed, and never held while nodes are freed.
+    static void giveBack(std::size_t cls, std::size_t count) noexcept
+    {
+        auto& list = local().lists[cls];
+        if (!count) {
+            return;
+        }
+
+        auto first = list.head;
+        auto last = first;
+        for (std::size_t n = 1; n < count; n++) {
+            last = last->next;
+        }
+        list.head = last->next;
+        list.count -= count;
+
+        auto& pool = shared();
+        std::lock_guard<std::mutex> lock{pool.mutex};
+        last->next = pool.lists[cls].head;
+        pool.lists[cls].head = first;
+        pool.lists[cls].count += count;
+    }
+
+    // Hands the rest of this thread's chunk to the shared pool, if it
+    // has room for a block of any size class, so a thread only holds
+    // on to a chunk while it runs. Locks as giveBack() does.
+    static void giveBackChunk() noexcept
+    {
+        auto& state = local();
+        if (state.bumpEnd - state.bump < std::ptrdiff_t(max_size)) {
+            return;
+        }
+
+        // blocks are multiples of granularity, so bump stays aligned
+        auto spare = new (state.bump) spare_chunk{nullptr, state.bumpEnd};
+        state.bump = state.bumpEnd = nullptr;
+
+        auto& pool = shared();
+        std::lock_guard<std::mutex> lock{pool.mutex};
+        spare->next = pool.spares;
+        pool.spares = spare;
+    }
+};
+
+} // namespace rw::pdata::detail
+
+#endif // RW_PDATA_POOL_H
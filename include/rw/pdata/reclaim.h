@@ -0,0 +1,205 @@
+#ifndef RW_PDATA_RECLAIM_H
+#define RW_PDATA_RECLAIM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rw::pdata {
+namespace detail {
+
+// destroys and frees a node whose last reference has gone
+using destroy_fn = void (*)(void*) noexcept;
+
+// Destroys nodes as soon as their last reference goes
+struct immediate_reclaimer
+{
+    static void retire(void* n, destroy_fn destroy) noexcept { destroy(n); }
+};
+
+// Queues nodes whose last reference goes, for reclaim() or a
+// background_reclaimer to destroy later. Destroying a node releases its
+// subtrees, which are kept on the destroying thread's own stack rather
+// than the shared queue, so a trie is torn down iteratively, one node
+// at a time, and the work can stop after any node.
+class deferred_reclaimer
+{
+public:
+    static void retire(void* n, destroy_fn destroy) noexcept
+    {
+        if (auto stack = draining()) {
+            if (pushed(*stack, n, destroy)) {
+                return;
+            }
+        } else {
+            auto& q = queue();
+            std::unique_lock<std::mutex> lock{q.mutex};
+            bool wasEmpty = q.nodes.empty();
+            if (pushed(q.nodes, n, destroy)) {
+                lock.unlock();
+                if (wasEmpty) {
+                    q.ready.notify_all();
+                }
+                return;
+            }
+        }
+
+        // out of memory to queue it, so it goes now
+        destroy(n);
+    }
+
+    static std::size_t reclaim(std::size_t max)
+    {
+        std::vector<retired> stack;
+        {
+            auto& q = queue();
+            std::lock_guard<std::mutex> lock{q.mutex};
+            stack.swap(q.nodes);
+        }
+
+        draining() = &stack;
+        std::size_t count = 0;
+        for (; count < max && !stack.empty(); count++) {
+            auto next = stack.back();
+            stack.pop_back();
+            next.destroy(next.node);
+        }
+        draining() = nullptr;
+
+        // queue what's left for next time
+        if (!stack.empty()) {
+            auto& q = queue();
+            std::lock_guard<std::mutex> lock{q.mutex};
+            q.nodes.insert(q.nodes.end(), stack.begin(), stack.end());
+        }
+        return count;
+    }
+
+    static std::size_t pending()
+    {
+        auto& q = queue();
+        std::lock_guard<std::mutex> lock{q.mutex};
+        return q.nodes.size();
+    }
+
+    // Waits until there are nodes to reclaim, or stop is set. Returns
+    // false if it's stopped.
+    static bool wait(const std::atomic<bool>& stop)
+    {
+        auto& q = queue();
+        std::unique_lock<std::mutex> lock{q.mutex};
+        q.ready.wait(lock, [&] { return stop || !q.nodes.empty(); });
+        return !stop;
+    }
+
+    // wakes anything in wait(), to see that it's been stopped
+    static void wake()
+    {
+        auto& q = queue();
+        {
+            // taking the lock orders this with a waiter's check of stop
+            std::lock_guard<std::mutex> lock{q.mutex};
+        }
+        q.ready.notify_all();
+    }
+
+private:
+    struct retired
+    {
+        void* node;
+        destroy_fn destroy;
+    };
+
+    struct retired_queue
+    {
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::vector<retired> nodes;
+    };
+
+    static bool pushed(std::vector<retired>& to, void* n,
+            destroy_fn destroy) noexcept
+    {
+        try {
+            to.push_back({n, destroy});
+            return true;
+        } catch (...) {
+            return false;
+        }
+    }
+
+    static retired_queue& queue()
+    {
+        // never destroyed, as nodes may be released during static
+        // destruction
+        static auto q = new retired_queue;
+        return *q;
+    }
+
+    // the stack reclaim() is working through on this thread, if any
+    static std::vector<retired>*& draining() noexcept
+    {
+        thread_local std::vector<retired>* stack = nullptr;
+        return stack;
+    }
+};
+
+} // namespace detail
+
+// Destroys up to max nodes of maps, vectors and sorted maps using
+// deferred_policy whose last references have gone, returning the
+// number destroyed. Calling it with a small max between requests
+// spreads the cost of dropping a large map over many calls.
+inline std::size_t reclaim(std::size_t max = SIZE_MAX)
+{
+    return detail::deferred_reclaimer::reclaim(max);
+}
+
+// Nodes queued by deferred_policy and not yet reclaimed. Subtrees are
+// only queued as their parents are destroyed, so a dropped map counts
+// as one until reclaim() gets to it.
+inline std::size_t pending_reclaim()
+{
+    return detail::deferred_reclaimer::pending();
+}
+
+// Reclaims nodes queued by deferred_policy on a thread of its own, for
+// as long as it exists. Its destructor stops the thread, then reclaims
+// whatever is still queued.
+class background_reclaimer
+{
+public:
+    // nodes destroyed between checks of whether to stop
+    static constexpr std::size_t slice = 4096;
+
+    background_reclaimer() :
+        thread([this] {
+            while (detail::deferred_reclaimer::wait(stop)) {
+                detail::deferred_reclaimer::reclaim(slice);
+            }
+        })
+    {}
+
+    background_reclaimer(const background_reclaimer&) = delete;
+    background_reclaimer& operator=(const background_reclaimer&) = delete;
+
+    ~background_reclaimer()
+    {
+        stop = true;
+        detail::deferred_reclaimer::wake();
+        thread.join();
+        reclaim();
+    }
+
+private:
+    std::atomic<bool> stop{false};
+    std::thread thread;
+};
+
+} // namespace rw::pdata
+
+#endif // RW_PDATA_RECLAIM_H
@@ -0,0 +1,376 @@
+#ifndef RW_PDATA_SET_H
+#define RW_PDATA_SET_H
+
+#include "fmt/format.h"
+#include "rw/pdata/hash.h"
+#include "rw/pdata/map-detail.h"
+#include "rw/pdata/policy.h"
+
+#include <initializer_list>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace rw::pdata {
+
+template <class K, class Hash, class Policy>
+class persistent_set;
+
+template <class K, class Hash = std::hash<K>, class Policy = shared_policy>
+class transient_set :
+    public std::enable_shared_from_this<transient_set<K, Hash, Policy>>
+{
+    using node_type = detail::node<K, detail::set_value, Hash, Policy>;
+    using bin_node = detail::bitmap_indexed_node<K, detail::set_value, Hash,
+            Policy>;
+    using node_ptr = typename node_type::node_ptr;
+
+public:
+    using value_type = K;
+    using const_iterator = detail::map_iterator<K, detail::set_value, Hash,
+            Policy>;
+    using iterator = const_iterator;
+
+    transient_set() :
+        edit(detail::newEdit())
+    {}
+
+    std::size_t size() const noexcept { return count; }
+
+    const_iterator begin() const
+    {
+        ensureEditable();
+        return const_iterator{root.get()};
+    }
+
+    const_iterator end() const { return {}; }
+
+    std::shared_ptr<transient_set> insert(const K& key)
+    {
+        ensureEditable();
+
+        bool addedLeaf = false;
+        if (!root) {
+            root = bin_node::emptyBin.assoc(edit, 0, Hash{}(key), key,
+                    addedLeaf);
+        } else {
+            root = root->assoc(edit, 0, Hash{}(key), key, addedLeaf);
+        }
+
+        if (addedLeaf) {
+            count++;
+        }
+        return this->shared_from_this();
+    }
+
+    std::shared_ptr<transient_set> erase(const K& key)
+    {
+        ensureEditable();
+
+        if (root) {
+            bool removedLeaf = false;
+            root = root->without(edit, 0, Hash{}(key), key, removedLeaf);
+
+            if (removedLeaf) {
+                count--;
+            }
+        }
+        return this->shared_from_this();
+    }
+
+    bool contains(const K& key) const
+    {
+        ensureEditable();
+        return lookup(key) != nullptr;
+    }
+
+    // contains with any key type comparable with K, if Hash is
+    // transparent
+    template <class Key, class H = Hash, class = typename H::is_transparent>
+    bool contains(const Key& key) const
+    {
+        ensureEditable();
+        return lookup(key) != nullptr;
+    }
+
+    std::shared_ptr<persistent_set<K, Hash, Policy>> persistent()
+    {
+        ensureEditable();
+
+        // as with transient_map, nodes keep this transient's id, which
+        // no other edit will match
+        edit = 0;
+
+        return persistent_set<K, Hash, Policy>::make(count, root);
+    }
+
+private:
+    friend class persistent_set<K, Hash, Policy>;
+
+    transient_set(std::size_t count, node_ptr root) :
+        edit(detail::newEdit()),
+        count(count),
+        root(std::move(root))
+    {}
+
+    template <class Key>
+    const K* lookup(const Key& key) const
+    {
+        return detail::trie_lookup<K, detail::set_value, Hash, Policy>::find(
+                root.get(), 0, Hash{}(key), key);
+    }
+
+    // throws if persistent() has already been called
+    void ensureEditable() const
+    {
+        if (!edit) {
+            throw std::logic_error("transient_set used after persistent()");
+        }
+    }
+
+    detail::edit_type edit;
+    std::size_t count = 0;
+    node_ptr root;
+};
+
+// Immutable hash set, sharing persistent_map's trie but keeping only
+// keys in its nodes. Union, intersection and difference walk both
+// tries together: subtrees the sets share, or that the result takes
+// whole from one of them, are reused rather than rebuilt, so combining
+// sets derived from each other costs roughly the size of their
+// differences.
+template <class K, class Hash = std::hash<K>, class Policy = shared_policy>
+class persistent_set :
+    public std::enable_shared_from_this<persistent_set<K, Hash, Policy>>
+{
+    using node_type = detail::node<K, detail::set_value, Hash, Policy>;
+    using bin_node = detail::bitmap_indexed_node<K, detail::set_value, Hash,
+            Policy>;
+    using node_ptr = typename node_type::node_ptr;
+
+public:
+    using value_type = K;
+    using const_iterator = detail::map_iterator<K, detail::set_value, Hash,
+            Policy>;
+    using iterator = const_iterator;
+
+    persistent_set() = default;
+
+    // Builds a set from a range of keys all at once, which is much
+    // faster than inserting them one by one
+    template <class InputIt>
+    static std::shared_ptr<persistent_set> create(InputIt first, InputIt last)
+    {
+        std::vector<K> keys(first, last);
+
+        detail::trie_builder<K, detail::set_value, Hash, Policy> builder;
+        auto root = builder.build(keys);
+        return make(builder.size(), std::move(root));
+    }
+
+    static std::shared_ptr<persistent_set> create(
+            std::initializer_list<K> keys)
+    {
+        return create(keys.begin(), keys.end());
+    }
+
+    std::size_t size() const noexcept { return count; }
+    bool empty() const noexcept { return count == 0; }
+
+    const_iterator begin() const { return const_iterator{root.get()}; }
+    const_iterator end() const { return {}; }
+
+    std::shared_ptr<persistent_set> insert(const K& key)
+    {
+        bool addedLeaf = false;
+
+        node_ptr newroot;
+        if (!root) {
+            newroot = bin_node::emptyBin.assoc(0, Hash{}(key), key, addedLeaf);
+        } else {
+            newroot = root->assoc(0, Hash{}(key), key, addedLeaf);
+        }
+
+        if (newroot == root) {
+            return this->shared_from_this();
+        }
+        return make(count + addedLeaf, std::move(newroot));
+    }
+
+    std::shared_ptr<persistent_set> erase(const K& key)
+    {
+        if (!root) {
+            return this->shared_from_this();
+        }
+
+        auto newroot = root->without(0, Hash{}(key), key);
+        if (newroot == root) {
+            return this->shared_from_this();
+        }
+        return make(count - 1, std::move(newroot));
+    }
+
+    bool contains(const K& key) const { return lookup(key) != nullptr; }
+
+    // contains with any key type comparable with K, if Hash is
+    // transparent
+    template <class Key, class H = Hash, class = typename H::is_transparent>
+    bool contains(const Key& key) const
+    {
+        return lookup(key) != nullptr;
+    }
+
+    // Returns a set with the keys of both sets, which is this set or
+    // other if either already holds them all
+    std::shared_ptr<persistent_set> set_union(
+            const std::shared_ptr<persistent_set>& other)
+    {
+        if (!other->root || other->root == root) {
+            return this->shared_from_this();
+        } else if (!root) {
+            return other;
+        }
+
+        // set values are all equal, so there's nothing to resolve
+        auto keep = [](detail::set_value ours, detail::set_value) {
+            return ours;
+        };
+        detail::trie_merger<K, detail::set_value, Hash, Policy,
+                decltype(keep)>
+                merger{keep};
+        auto newroot = merger.merge(root, other->root, 0);
+
+        if (newroot == root) {
+            return this->shared_from_this();
+        } else if (newroot == other->root) {
+            return other;
+        }
+        return make(count + merger.size(), std::move(newroot));
+    }
+
+    // Returns a set with the keys in both sets
+    std::shared_ptr<persistent_set> set_intersection(
+            const std::shared_ptr<persistent_set>& other)
+    {
+        if (other->root == root) {
+            return this->shared_from_this();
+        } else if (!other->root) {
+            return other;
+        } else if (!root) {
+            return this->shared_from_this();
+        }
+        return filter(other, true);
+    }
+
+    // Returns a set with the keys in this set that aren't in other
+    std::shared_ptr<persistent_set> set_difference(
+            const std::shared_ptr<persistent_set>& other)
+    {
+        if (!root || !other->root) {
+            return this->shared_from_this();
+        }
+        return filter(other, false);
+    }
+
+    std::string dump(int indent) const
+    {
+        fmt::memory_buffer msg;
+
+        fmt::format_to(msg, "pset\n");
+        for (int idt = 0; idt < indent; idt++) {
+            fmt::format_to(msg, " ");
+        }
+        if (root) {
+            fmt::format_to(msg, "root: {}", root->dump(indent + 1));
+        } else {
+            fmt::format_to(msg, "root: null\n");
+        }
+
+        return fmt::to_string(msg);
+    }
+
+    // Sets are equal if they hold the same keys. As with
+    // persistent_map, shared subtrees are skipped.
+    friend bool operator==(const persistent_set& a, const persistent_set& b)
+    {
+        if (a.count != b.count) {
+            return false;
+        } else if (a.root == b.root || a.count == 0) {
+            return true;
+        }
+
+        return a.root->equiv(b.root.get(), 0, 0);
+    }
+
+    friend bool operator!=(const persistent_set& a, const persistent_set& b)
+    {
+        return !(a == b);
+    }
+
+    std::shared_ptr<transient_set<K, Hash, Policy>> transient() const
+    {
+        // struct to allow creation using make_shared and a private ctor
+        struct ts_maker : public transient_set<K, Hash, Policy>
+        {
+            ts_maker(std::size_t count, node_ptr root) :
+                transient_set<K, Hash, Policy>(count, std::move(root))
+            {}
+        };
+
+        return std::make_shared<ts_maker>(count, root);
+    }
+
+private:
+    friend class transient_set<K, Hash, Policy>;
+
+    persistent_set(std::size_t count, node_ptr root) :
+        count(count),
+        root(std::move(root))
+    {}
+
+    static std::shared_ptr<persistent_set> make(std::size_t count,
+            node_ptr root)
+    {
+        // struct to allow creation using make_shared and a private ctor
+        struct ps_maker : public persistent_set
+        {
+            ps_maker(std::size_t count, node_ptr root) :
+                persistent_set(count, std::move(root))
+            {}
+        };
+
+        return std::make_shared<ps_maker>(count, std::move(root));
+    }
+
+    // the keys also in other if common, otherwise those not in it
+    std::shared_ptr<persistent_set> filter(
+            const std::shared_ptr<persistent_set>& other, bool common)
+    {
+        detail::trie_filter<K, detail::set_value, Hash, Policy> filter{common};
+        auto newroot = filter.filter(root, other->root, 0);
+
+        if (newroot == root) {
+            return this->shared_from_this();
+        }
+        return make(count - filter.size(), std::move(newroot));
+    }
+
+    template <class Key>
+    const K* lookup(const Key& key) const
+    {
+        return detail::trie_lookup<K, detail::set_value, Hash, Policy>::find(
+                root.get(), 0, Hash{}(key), key);
+    }
+
+    std::size_t count = 0;
+    node_ptr root;
+};
+
+// persistent_set using the canonical CHAMP encoding
+template <class K, class Hash = std::hash<K>, class Policy = shared_policy>
+using champ_set = persistent_set<K, Hash, champ_policy<Policy>>;
+
+} // namespace rw::pdata
+
+#endif // RW_PDATA_SET_H
@@ -0,0 +1,568 @@
+#ifndef RW_PDATA_SNAPSHOT_DETAIL_H
+#define RW_PDATA_SNAPSHOT_DETAIL_H
+
+#include "rw/pdata/map-detail.h"
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rw::pdata::detail {
+
+// A snapshot is a header, then the trie's nodes with each node's
+// subtrees before it, then a footer giving the root. Nodes refer to
+// their subtrees by offset from the start of the snapshot, so it can
+// be read wherever it's mapped. Numbers are in the writer's byte order.
+//
+// A journal is a snapshot that later versions were appended to, each
+// as the nodes earlier versions didn't have and another footer. The
+// last footer is at the end, and each links to the one before.
+
+inline constexpr char snapshot_magic[8] = {'r', 'w', 'p', 'd', 'm', 'a', 'p',
+        '\n'};
+inline constexpr uint32_t snapshot_version = 1;
+
+struct snapshot_header
+{
+    char magic[8];
+    uint32_t version;
+
+    // checked when reading, to catch a snapshot of another map type
+    uint32_t keySize;
+    uint32_t valueSize;
+    uint32_t entrySize;
+};
+
+struct snapshot_footer
+{
+    uint64_t count;
+
+    // offset of the root node, or 0 if the map is empty
+    uint64_t root;
+
+    // offset of the end of the previous version's footer, or 0 if this
+    // is the first
+    uint64_t previous;
+    char magic[8];
+};
+
+enum snapshot_kind : uint32_t
+{
+    snapshot_bitmap,
+    snapshot_array,
+    snapshot_collision
+};
+
+// Each kind of node starts with a 16 byte header giving its kind. Then
+// bitmap nodes have their values and the offsets of their subtrees,
+// array nodes have 32 subtree offsets, 0 for an empty slot, and
+// collision nodes have their values.
+struct snapshot_bitmap_node
+{
+    uint32_t kind;
+    uint32_t datamap;
+    uint32_t nodemap;
+    uint32_t unused;
+};
+
+struct snapshot_collision_node
+{
+    uint32_t kind;
+    uint32_t count;
+    uint64_t hash;
+};
+
+static_assert(sizeof(snapshot_bitmap_node) == sizeof(snapshot_collision_node));
+
+template <class K, class T>
+struct snapshot_entry
+{
+    K key;
+    T val;
+};
+
+constexpr std::size_t alignUp(std::size_t n, std::size_t align) noexcept
+{
+    return (n + align - 1) / align * align;
+}
+
+template <class K, class T>
+constexpr std::size_t snapshot_align =
+        std::max<std::size_t>(alignof(snapshot_entry<K, T>), 8);
+
+// where a node's entries start, from the start of the node
+template <class K, class T>
+constexpr std::size_t snapshot_entries_offset =
+        alignUp(sizeof(snapshot_bitmap_node), alignof(snapshot_entry<K, T>));
+
+// Writes versions of a map to a journal, each as the nodes not already
+// written for an earlier one. It remembers a node by its address, so
+// it holds a reference to each node it writes, to keep the address from
+// being reused for a different node while it's remembered.
+template <class K, class T, class Hash, class Policy>
+class snapshot_writer
+{
+    using node_type = node<K, T, Hash, Policy>;
+    using entry_type = snapshot_entry<K, T>;
+    using traits = entry_traits<K, T>;
+
+public:
+    // a writer of a single version needn't remember what it's written
+    explicit snapshot_writer(std::ostream& out, bool journal = true) :
+        out(out),
+        journal(journal)
+    {
+        buffer.reserve(buffer_size);
+    }
+
+    // appends the version of the map with the given root
+    void write(const node_type* root, std::size_t count)
+    {
+        if (pos == 0) {
+            snapshot_header header{};
+            std::memcpy(header.magic, snapshot_magic, sizeof header.magic);
+            header.version = snapshot_version;
+            header.keySize = sizeof(K);
+            header.valueSize = sizeof(T);
+            header.entrySize = sizeof(entry_type);
+            put(header);
+        }
+
+        snapshot_footer footer{};
+        footer.count = count;
+        footer.root = root ? writeNode(root) : 0;
+        footer.previous = previous;
+        std::memcpy(footer.magic, snapshot_magic, sizeof footer.magic);
+        pad(8);
+        put(footer);
+        previous = pos;
+
+        flush();
+        out.flush();
+        if (!out) {
+            throw std::runtime_error("failed writing map snapshot");
+        }
+        prune();
+    }
+
+    // bytes written so far
+    uint64_t size() const noexcept { return pos; }
+
+private:
+    // writes n's subtrees, then n, returning n's offset, unless it's
+    // been written before
+    uint64_t writeNode(const node_type* n)
+    {
+        if (auto found = written.find(n); found != written.end()) {
+            return found->second;
+        }
+
+        auto offset = writeNew(n);
+        if (journal) {
+            written.emplace(n, offset);
+            held.emplace_back(n);
+        }
+        return offset;
+    }
+
+    uint64_t writeNew(const node_type* n)
+    {
+        if (n->kind() == node_kind::hash_collision) {
+            auto values = n->data();
+            snapshot_collision_node header{};
+            header.kind = snapshot_collision;
+            header.count = static_cast<uint32_t>(values.size());
+            header.hash = Hash{}(traits::key(*values.begin()));
+
+            auto offset = startNode(header);
+            for (const auto& value : values) {
+                putEntry(value);
+            }
+            return offset;
+        }
+
+        if (n->kind() == node_kind::array) {
+            std::array<uint64_t, 32> kids{};
+            for (uint32_t idx = 0; idx < 32; idx++) {
+                if (auto slot = slot_at(n, idx); slot.child) {
+                    kids[idx] = writeNode(slot.child->get());
+                }
+            }
+
+            snapshot_bitmap_node header{};
+            header.kind = snapshot_array;
+            pad(snapshot_align<K, T>);
+            auto offset = pos;
+            put(header);
+            put(kids);
+            return offset;
+        }
+
+        // values in slot order, as a bin stores them
+        std::array<const typename node_type::value_type*, 32> values;
+        std::array<uint64_t, 32> kids;
+        uint32_t valueCount = 0;
+        uint32_t kidCount = 0;
+
+        snapshot_bitmap_node header{};
+        header.kind = snapshot_bitmap;
+        for (uint32_t idx = 0; idx < 32; idx++) {
+            auto slot = slot_at(n, idx);
+            if (slot.value) {
+                header.datamap |= 1u << idx;
+                values[valueCount++] = slot.value;
+            } else if (slot.child) {
+                header.nodemap |= 1u << idx;
+                kids[kidCount++] = writeNode(slot.child->get());
+            }
+        }
+
+        auto offset = startNode(header);
+        for (uint32_t i = 0; i < valueCount; i++) {
+            putEntry(*values[i]);
+        }
+        pad(8);
+        for (uint32_t i = 0; i < kidCount; i++) {
+            put(kids[i]);
+        }
+        return offset;
+    }
+
+    template <class Header>
+    uint64_t startNode(const Header& header)
+    {
+        pad(snapshot_align<K, T>);
+        auto offset = pos;
+        put(header);
+        pad(alignof(entry_type));
+        return offset;
+    }
+
+    void putEntry(const typename node_type::value_type& value)
+    {
+        // zeroed, so padding doesn't write whatever was on the stack
+        alignas(entry_type) char bytes[sizeof(entry_type)] = {};
+        auto entry = reinterpret_cast<entry_type*>(bytes);
+        std::memcpy(&entry->key, &traits::key(value), sizeof(K));
+        std::memcpy(&entry->val, &traits::val(value), sizeof(T));
+        putBytes(bytes, sizeof bytes);
+    }
+
+    template <class U>
+    void put(const U& u)
+    {
+        putBytes(reinterpret_cast<const char*>(&u), sizeof u);
+    }
+
+    void pad(std::size_t align)
+    {
+        static constexpr char zeros[64] = {};
+        putBytes(zeros, alignUp(pos, align) - pos);
+    }
+
+    // nodes are written a few bytes at a time, so they're gathered into
+    // larger writes
+    void putBytes(const char* bytes, std::size_t n)
+    {
+        if (buffer.size() + n > buffer_size) {
+            flush();
+        }
+        buffer.insert(buffer.end(), bytes, bytes + n);
+        pos += n;
+    }
+
+    void flush()
+    {
+        out.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+
+    // Forgets nodes only the writer still holds, which no later
+    // version can share. A node is written after its subtrees, so going
+    // backwards lets a parent go before its subtrees are looked at. This
+    // is put off until there are twice as many nodes as after the last
+    // time, so it costs O(1) for each node written.
+    void prune()
+    {
+        if (held.size() < std::max<std::size_t>(2 * live, 1024)) {
+            return;
+        }
+
+        for (auto n = held.rbegin(); n != held.rend(); ++n) {
+            if ((*n)->use_count() == 1) {
+                written.erase(n->get());
+                n->reset();
+            }
+        }
+        held.erase(std::remove_if(held.begin(), held.end(),
+                           [](const auto& n) { return !n; }),
+                held.end());
+        live = held.size();
+    }
+
+    static constexpr std::size_t buffer_size = 64 * 1024;
+
+    std::ostream& out;
+    const bool journal;
+    uint64_t pos = 0;
+    uint64_t previous = 0;
+    std::vector<char> buffer;
+
+    // offsets of nodes written, and references to them in the order
+    // they were written
+    std::unordered_map<const node_type*, uint64_t> written;
+    std::vector<ref_ptr<const node_type>> held;
+    std::size_t live = 0;
+};
+
+// The bytes of a snapshot or journal, mapped from a file or viewed in
+// place, which the versions read from it share
+class snapshot_data
+{
+public:
+    snapshot_data(const char* base, std::size_t length, bool mapped) :
+        base(base),
+        length(length),
+        mapped(mapped)
+    {}
+
+    snapshot_data(const snapshot_data&) = delete;
+    snapshot_data& operator=(const snapshot_data&) = delete;
+
+    ~snapshot_data()
+    {
+        if (mapped) {
+            ::munmap(const_cast<char*>(base), length);
+        }
+    }
+
+    // maps the file at path read-only, throwing std::system_error if it
+    // can't be read
+    static std::shared_ptr<const snapshot_data> map(const std::string& path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(),
+                    "opening map snapshot " + path);
+        }
+
+        struct stat st{};
+        void* addr = MAP_FAILED;
+        if (::fstat(fd, &st) != 0) {
+            // errno says why
+        } else if (st.st_size == 0) {
+            errno = EINVAL;
+        } else {
+            addr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        auto error = errno;
+        ::close(fd);
+        if (addr == MAP_FAILED) {
+            throw std::system_error(error, std::generic_category(),
+                    "mapping map snapshot " + path);
+        }
+        return std::make_shared<snapshot_data>(
+                static_cast<const char*>(addr), st.st_size, true);
+    }
+
+    // Checks the header is for a map of K to T, returning the last
+    // footer. Throws std::runtime_error if it isn't a snapshot of this
+    // type of map.
+    template <class K, class T>
+    snapshot_footer check() const
+    {
+        if (reinterpret_cast<uintptr_t>(base) % alignof(std::max_align_t)) {
+            fail("misaligned");
+        }
+        if (length < sizeof(snapshot_header) + sizeof(snapshot_footer)) {
+            fail("too short");
+        }
+
+        snapshot_header header;
+        std::memcpy(&header, base, sizeof header);
+        if (std::memcmp(header.magic, snapshot_magic, sizeof header.magic)) {
+            fail("not a snapshot");
+        }
+        if (header.version != snapshot_version) {
+            fail("unknown version");
+        }
+        if (header.keySize != sizeof(K) || header.valueSize != sizeof(T) ||
+                header.entrySize != sizeof(snapshot_entry<K, T>)) {
+            fail("written for another key or value type");
+        }
+        return footer<K, T>(length);
+    }
+
+    // the footer ending at end, checked as far as it can be
+    template <class K, class T>
+    snapshot_footer footer(uint64_t end) const
+    {
+        if (end < sizeof(snapshot_header) + sizeof(snapshot_footer) ||
+                end > length) {
+            fail("bad version");
+        }
+
+        snapshot_footer footer;
+        std::memcpy(&footer, base + end - sizeof footer, sizeof footer);
+        if (std::memcmp(footer.magic, snapshot_magic, sizeof footer.magic)) {
+            fail("not a snapshot");
+        }
+        if (footer.root >= end - sizeof footer ||
+                footer.root % snapshot_align<K, T> ||
+                footer.previous >= end) {
+            fail("bad root");
+        }
+        return footer;
+    }
+
+    const char* const base;
+    const std::size_t length;
+
+private:
+    [[noreturn]] static void fail(const char* why)
+    {
+        throw std::runtime_error(std::string{"bad map snapshot: "} + why);
+    }
+
+    const bool mapped;
+};
+
+// Looks up keys in a snapshot mapped at base
+template <class K, class T, class Hash>
+class snapshot_reader
+{
+public:
+    using entry_type = snapshot_entry<K, T>;
+
+    snapshot_reader() = default;
+
+    snapshot_reader(const char* base, uint64_t root) :
+        base(base),
+        root(root)
+    {}
+
+    template <class Key>
+    const entry_type* find(const Key& key) const
+    {
+        if (!root) {
+            return nullptr;
+        }
+
+        hash_type hash = Hash{}(key);
+        auto offset = root;
+        for (uint32_t shift = 0;; shift += 5) {
+            auto n = base + offset;
+            if (kind(n) == snapshot_array) {
+                offset = arrayChildren(n)[mask(hash, shift)];
+                if (!offset) {
+                    return nullptr;
+                }
+                continue;
+            } else if (kind(n) == snapshot_collision) {
+                auto header = reinterpret_cast<const snapshot_collision_node*>(n);
+                if (header->hash != hash) {
+                    return nullptr;
+                }
+                auto found = std::find_if(entries(n),
+                        entries(n) + header->count,
+                        [&](const auto& e) { return e.key == key; });
+                return found != entries(n) + header->count ? found : nullptr;
+            }
+
+            auto header = reinterpret_cast<const snapshot_bitmap_node*>(n);
+            auto bit = bitpos(hash, shift);
+            if (header->datamap & bit) {
+                auto e = entries(n) + popcount(header->datamap & (bit - 1));
+                return e->key == key ? e : nullptr;
+            } else if (!(header->nodemap & bit)) {
+                return nullptr;
+            }
+            offset = children(n)[popcount(header->nodemap & (bit - 1))];
+        }
+    }
+
+    // calls f(key, val) for each entry
+    template <class F>
+    void for_each(F&& f) const
+    {
+        if (root) {
+            visit(root, f);
+        }
+    }
+
+private:
+    template <class F>
+    void visit(uint64_t offset, F& f) const
+    {
+        auto n = base + offset;
+        if (kind(n) == snapshot_array) {
+            for (uint32_t i = 0; i < 32; i++) {
+                if (arrayChildren(n)[i]) {
+                    visit(arrayChildren(n)[i], f);
+                }
+            }
+            return;
+        } else if (kind(n) == snapshot_collision) {
+            auto header = reinterpret_cast<const snapshot_collision_node*>(n);
+            for (uint32_t i = 0; i < header->count; i++) {
+                f(entries(n)[i].key, entries(n)[i].val);
+            }
+            return;
+        }
+
+        auto header = reinterpret_cast<const snapshot_bitmap_node*>(n);
+        for (uint32_t i = 0; i < popcount(header->datamap); i++) {
+            f(entries(n)[i].key, entries(n)[i].val);
+        }
+        for (uint32_t i = 0; i < popcount(header->nodemap); i++) {
+            visit(children(n)[i], f);
+        }
+    }
+
+    static uint32_t kind(const char* n) noexcept
+    {
+        return reinterpret_cast<const uint32_t*>(n)[0];
+    }
+
+    static const entry_type* entries(const char* n) noexcept
+    {
+        return reinterpret_cast<const entry_type*>(
+                n + snapshot_entries_offset<K, T>);
+    }
+
+    static const uint64_t* arrayChildren(const char* n) noexcept
+    {
+        return reinterpret_cast<const uint64_t*>(
+                n + sizeof(snapshot_bitmap_node));
+    }
+
+    // only for bitmap nodes, whose subtree offsets follow their values
+    static const uint64_t* children(const char* n) noexcept
+    {
+        auto header = reinterpret_cast<const snapshot_bitmap_node*>(n);
+        auto end = snapshot_entries_offset<K, T> +
+                   popcount(header->datamap) * sizeof(entry_type);
+        return reinterpret_cast<const uint64_t*>(n + alignUp(end, 8));
+    }
+
+    const char* base = nullptr;
+    uint64_t root = 0;
+};
+
+} // namespace rw::pdata::detail
+
+#endif // RW_PDATA_SNAPSHOT_DETAIL_H
@@ -0,0 +1,288 @@
+#ifndef RW_PDATA_SNAPSHOT_H
+#define RW_PDATA_SNAPSHOT_H
+
+#include "rw/pdata/map.h"
+#include "rw/pdata/policy.h"
+#include "rw/pdata/snapshot-detail.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace rw::pdata {
+
+template <class K, class T, class Hash, class Policy>
+class map_journal;
+
+// Writes versions of a map to out as a journal, a snapshot that each
+// checkpoint() appends to. A checkpoint writes only the nodes earlier
+// ones didn't, since versions share most of theirs, so it costs about
+// the size of the changes since the last one rather than of the map.
+// map_journal reads back any version, and map_snapshot the last.
+//
+// The writer remembers a node it's written, and holds a reference to
+// it, until the writer is the only one holding it. Writing checkpoints
+// of versions made one from the other keeps that to about one version's
+// nodes. A new writer starts a new journal.
+template <class K, class T, class Hash = std::hash<K>,
+        class Policy = shared_policy>
+class map_journal_writer
+{
+    static_assert(std::is_trivially_copyable_v<K> &&
+                          std::is_trivially_copyable_v<T>,
+            "snapshots need trivially copyable keys and values");
+
+public:
+    explicit map_journal_writer(std::ostream& out) :
+        writer(out)
+    {}
+
+    // Appends m as the journal's next version, and flushes the stream.
+    // Throws std::runtime_error if the stream fails.
+    void checkpoint(const persistent_map<K, T, Hash, Policy>& m)
+    {
+        writer.write(m.root.get(), m.size());
+    }
+
+    // bytes written to the journal so far
+    uint64_t size() const noexcept { return writer.size(); }
+
+private:
+    detail::snapshot_writer<K, T, Hash, Policy> writer;
+};
+
+// Writes a binary snapshot of m to out, which map_snapshot can map and
+// query in place. The snapshot mirrors m's trie, so it's about the size
+// of the map in memory, and writing it costs one pass over the map.
+// Keys and values are copied bytewise, so both must be trivially
+// copyable, and the reader must use the same Hash and byte order.
+template <class K, class T, class Hash, class Policy>
+void write_snapshot(const persistent_map<K, T, Hash, Policy>& m,
+        std::ostream& out)
+{
+    static_assert(std::is_trivially_copyable_v<K> &&
+                          std::is_trivially_copyable_v<T>,
+            "snapshots need trivially copyable keys and values");
+
+    detail::snapshot_writer<K, T, Hash, Policy> writer{out, false};
+    writer.write(m.root.get(), m.size());
+}
+
+// A read-only map over a snapshot from write_snapshot(), queried in
+// place: opening one maps the file and checks its header, without
+// reading or copying the map, so a large map is ready at once and its
+// pages are only read as lookups touch them. Changing it gives a
+// persistent_map, built from the snapshot the first time it's needed.
+template <class K, class T, class Hash = std::hash<K>,
+        class Policy = shared_policy>
+class map_snapshot
+{
+    static_assert(std::is_trivially_copyable_v<K> &&
+                          std::is_trivially_copyable_v<T>,
+            "snapshots need trivially copyable keys and values");
+
+    using reader_type = detail::snapshot_reader<K, T, Hash>;
+
+public:
+    using map_type = persistent_map<K, T, Hash, Policy>;
+
+    map_snapshot(const map_snapshot&) = delete;
+    map_snapshot& operator=(const map_snapshot&) = delete;
+
+    // Maps the snapshot in the file at path, or a journal's last
+    // version. Throws std::system_error if it can't be read, or
+    // std::runtime_error if it isn't a snapshot of this type of map.
+    static std::shared_ptr<map_snapshot> open(const std::string& path)
+    {
+        auto data = detail::snapshot_data::map(path);
+        return make(data, data->template check<K, T>());
+    }
+
+    // A snapshot already in memory, which must stay there unchanged for
+    // as long as the map_snapshot does. Throws std::runtime_error if
+    // it isn't a snapshot of this type of map, or isn't aligned to
+    // alignof(std::max_align_t).
+    static std::shared_ptr<map_snapshot> view(const void* data,
+            std::size_t size)
+    {
+        auto viewed = std::make_shared<detail::snapshot_data>(
+                static_cast<const char*>(data), size, false);
+        return make(viewed, viewed->template check<K, T>());
+    }
+
+    std::size_t size() const noexcept { return count; }
+    bool empty() const noexcept { return count == 0; }
+
+    std::optional<T> find(const K& key) const
+    {
+        if (auto found = reader.find(key)) {
+            return found->val;
+        }
+        return std::nullopt;
+    }
+
+    bool contains(const K& key) const { return reader.find(key) != nullptr; }
+
+    // Like find(), but returns a pointer into the snapshot, or null,
+    // which stays valid for as long as this map_snapshot does
+    const T* find_ptr(const K& key) const
+    {
+        auto found = reader.find(key);
+        return found ? &found->val : nullptr;
+    }
+
+    // calls f(key, val) for each value, in no particular order
+    template <class F>
+    void for_each(F&& f) const
+    {
+        reader.for_each(f);
+    }
+
+    // The snapshot as a persistent_map, built on the first call and
+    // shared by later ones
+    std::shared_ptr<map_type> persistent() const
+    {
+        std::call_once(promoted, [this] {
+            std::vector<typename map_type::value_type> values;
+            values.reserve(count);
+            reader.for_each([&](const K& key, const T& val) {
+                values.emplace_back(key, val);
+            });
+            map = map_type::create(values.begin(), values.end());
+        });
+        return map;
+    }
+
+    // Returns a persistent_map, adding or replacing a value
+    std::shared_ptr<map_type> assoc(const K& key, T val) const
+    {
+        return persistent()->assoc(key, std::move(val));
+    }
+
+    // Returns a persistent_map without key
+    std::shared_ptr<map_type> without(const K& key) const
+    {
+        return persistent()->without(key);
+    }
+
+private:
+    friend class map_journal<K, T, Hash, Policy>;
+
+    map_snapshot(std::shared_ptr<const detail::snapshot_data> data,
+            const detail::snapshot_footer& footer) :
+        data(std::move(data)),
+        count(footer.count),
+        reader(this->data->base, footer.root)
+    {}
+
+    static std::shared_ptr<map_snapshot> make(
+            std::shared_ptr<const detail::snapshot_data> data,
+            const detail::snapshot_footer& footer)
+    {
+        // struct to allow creation using make_shared and a private ctor
+        struct ms_maker : public map_snapshot
+        {
+            ms_maker(std::shared_ptr<const detail::snapshot_data> data,
+                    const detail::snapshot_footer& footer) :
+                map_snapshot(std::move(data), footer)
+            {}
+        };
+
+        return std::make_shared<ms_maker>(std::move(data), footer);
+    }
+
+    std::shared_ptr<const detail::snapshot_data> data;
+    std::size_t count = 0;
+    reader_type reader;
+
+    mutable std::once_flag promoted;
+    mutable std::shared_ptr<map_type> map;
+};
+
+// The versions in a journal from map_journal_writer, oldest first, each
+// read in place as a map_snapshot. They share one mapping of the file.
+template <class K, class T, class Hash = std::hash<K>,
+        class Policy = shared_policy>
+class map_journal
+{
+public:
+    using snapshot_type = map_snapshot<K, T, Hash, Policy>;
+
+    // Maps the journal in the file at path. Throws std::system_error if
+    // it can't be read, or std::runtime_error if it isn't a journal of
+    // this type of map.
+    static std::shared_ptr<map_journal> open(const std::string& path)
+    {
+        return make(detail::snapshot_data::map(path));
+    }
+
+    // a journal already in memory, as with map_snapshot::view()
+    static std::shared_ptr<map_journal> view(const void* data,
+            std::size_t size)
+    {
+        return make(std::make_shared<detail::snapshot_data>(
+                static_cast<const char*>(data), size, false));
+    }
+
+    // the number of versions
+    std::size_t size() const noexcept { return ends.size(); }
+
+    // version i, from 0 for the first checkpoint
+    std::shared_ptr<snapshot_type> version(std::size_t i) const
+    {
+        if (i >= ends.size()) {
+            throw std::out_of_range("map_journal has no such version");
+        }
+        return snapshot_type::make(data,
+                data->template footer<K, T>(ends[i]));
+    }
+
+    std::shared_ptr<snapshot_type> latest() const
+    {
+        return version(ends.size() - 1);
+    }
+
+private:
+    explicit map_journal(std::shared_ptr<const detail::snapshot_data> data) :
+        data(std::move(data))
+    {
+        // follow the footers back from the last
+        auto footer = this->data->template check<K, T>();
+        ends.push_back(this->data->length);
+        while (footer.previous) {
+            ends.push_back(footer.previous);
+            footer = this->data->template footer<K, T>(footer.previous);
+        }
+        std::reverse(ends.begin(), ends.end());
+    }
+
+    static std::shared_ptr<map_journal> make(
+            std::shared_ptr<const detail::snapshot_data> data)
+    {
+        // struct to allow creation using make_shared and a private ctor
+        struct mj_maker : public map_journal
+        {
+            explicit mj_maker(std::shared_ptr<const detail::snapshot_data> data) :
+                map_journal(std::move(data))
+            {}
+        };
+
+        return std::make_shared<mj_maker>(std::move(data));
+    }
+
+    std::shared_ptr<const detail::snapshot_data> data;
+
+    // where each version's footer ends
+    std::vector<uint64_t> ends;
+};
+
+} // namespace rw::pdata
+
+#endif // RW_PDATA_SNAPSHOT_H
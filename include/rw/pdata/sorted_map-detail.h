@@ -0,0 +1,856 @@
+#ifndef RW_PDATA_SORTED_MAP_DETAIL_H
+#define RW_PDATA_SORTED_MAP_DETAIL_H
+
+#include "rw/pdata/policy.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace rw::pdata::detail {
+
+// most values in a leaf of a sorted map's tree, or subtrees in a branch
+constexpr uint32_t btree_width = 32;
+
+// nodes keep at least this many, except the root and those along the
+// tree's right edge
+constexpr uint32_t btree_min = btree_width / 2;
+
+// more levels than a tree of mostly half full nodes could ever need
+constexpr uint32_t btree_max_depth = 16;
+
+// Node of a sorted map's B+tree. Leaves hold up to 32 values in key
+// order. Branches hold up to 32 subtrees, with a key between each pair
+// that's greater than any key in the subtree before it, and no greater
+// than any in the one after. The slots follow the node in the same
+// allocation.
+template <class K, class T, class Policy>
+class btree_node
+{
+public:
+    using value_type = std::pair<K, T>;
+    using node_ptr = ref_ptr<btree_node>;
+
+    static_assert(alignof(value_type) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__,
+            "over-aligned keys and values are not supported");
+
+    static node_ptr leaf(edit_type edit) { return create(edit, true); }
+    static node_ptr branch(edit_type edit) { return create(edit, false); }
+
+    void retain() const noexcept { refs.inc(); }
+    void release() const noexcept
+    {
+        if (refs.dec()) {
+            Policy::reclaimer_type::retire(const_cast<btree_node*>(this),
+                    &btree_node::reclaim);
+        }
+    }
+
+    bool isLeaf() const noexcept { return m_leaf; }
+
+    // whether the node can be changed in place by edit
+    bool ownedBy(edit_type other) const noexcept
+    {
+        return sameEdit(edit, other);
+    }
+
+    // number of values in a leaf, or of subtrees in a branch
+    uint32_t size() const noexcept { return count; }
+
+    value_type* values() const noexcept
+    {
+        auto base = reinterpret_cast<const char*>(this) + slotsOffset();
+        return reinterpret_cast<value_type*>(const_cast<char*>(base));
+    }
+
+    node_ptr* children() const noexcept
+    {
+        auto base = reinterpret_cast<const char*>(this) + slotsOffset();
+        return reinterpret_cast<node_ptr*>(const_cast<char*>(base));
+    }
+
+    // only in branches: keys()[i] is between subtrees i and i + 1
+    K* keys() const noexcept
+    {
+        auto base = reinterpret_cast<const char*>(this) + keysOffset();
+        return reinterpret_cast<K*>(const_cast<char*>(base));
+    }
+
+    void pushValue(value_type val) { insertValue(count, std::move(val)); }
+
+    void insertValue(uint32_t i, value_type val)
+    {
+        insertAt(values(), count, i, std::move(val));
+        count++;
+    }
+
+    void eraseValue(uint32_t i)
+    {
+        eraseAt(values(), count, i);
+        count--;
+    }
+
+    // adds the first subtree of a new branch
+    void pushChild(node_ptr child) noexcept
+    {
+        new (children()) node_ptr(std::move(child));
+        count = 1;
+    }
+
+    // Adds a subtree at i, along with the key between it and the one
+    // before, or for i == 0, the one after
+    void insertChild(uint32_t i, K key, node_ptr child)
+    {
+        insertAt(keys(), count - 1, i ? i - 1 : 0, std::move(key));
+        insertAt(children(), count, i, std::move(child));
+        count++;
+    }
+
+    // removes subtree i, and the key insertChild() would have added
+    void eraseChild(uint32_t i)
+    {
+        if (count > 1) {
+            eraseAt(keys(), count - 1, i ? i - 1 : 0);
+        }
+        eraseAt(children(), count, i);
+        count--;
+    }
+
+    // a copy of the node owned by edit
+    node_ptr copy(edit_type edit) const
+    {
+        auto dup = create(edit, m_leaf);
+        if (m_leaf) {
+            std::uninitialized_copy_n(values(), count, dup->values());
+        } else {
+            std::uninitialized_copy_n(children(), count, dup->children());
+            std::uninitialized_copy_n(keys(), count - 1, dup->keys());
+        }
+        dup->count = count;
+        return dup;
+    }
+
+private:
+    btree_node(edit_type edit, bool leaf) noexcept :
+        m_leaf(leaf),
+        edit(edit)
+    {}
+
+    ~btree_node()
+    {
+        if (m_leaf) {
+            std::destroy_n(values(), count);
+        } else if (count) {
+            std::destroy_n(children(), count);
+            std::destroy_n(keys(), count - 1);
+        }
+    }
+
+    static node_ptr create(edit_type edit, bool leaf)
+    {
+        void* mem = Policy::allocator_type::allocate(allocSize(leaf));
+        return node_ptr{new (mem) btree_node(edit, leaf)};
+    }
+
+    void destroy() noexcept
+    {
+        auto size = allocSize(m_leaf);
+        this->~btree_node();
+        Policy::allocator_type::deallocate(this, size);
+    }
+
+    // destroys a node the policy's reclaimer was given by release()
+    static void reclaim(void* n) noexcept
+    {
+        static_cast<btree_node*>(n)->destroy();
+    }
+
+    // inserts val at i among the n slots from first, the last of which
+    // is raw memory after
+    template <class U>
+    static void insertAt(U* first, uint32_t n, uint32_t i, U val)
+    {
+        if (i == n) {
+            new (first + n) U(std::move(val));
+            return;
+        }
+
+        new (first + n) U(std::move(first[n - 1]));
+        std::move_backward(first + i, first + n - 1, first + n);
+        first[i] = std::move(val);
+    }
+
+    // removes slot i of the n from first
+    template <class U>
+    static void eraseAt(U* first, uint32_t n, uint32_t i)
+    {
+        std::move(first + i + 1, first + n, first + i);
+        std::destroy_at(first + n - 1);
+    }
+
+    static constexpr std::size_t alignUp(std::size_t n, std::size_t align)
+    {
+        return (n + align - 1) & ~(align - 1);
+    }
+
+    static constexpr std::size_t slotsOffset()
+    {
+        return alignUp(sizeof(btree_node),
+                std::max(alignof(value_type), alignof(node_ptr)));
+    }
+
+    static constexpr std::size_t keysOffset()
+    {
+        return alignUp(slotsOffset() + btree_width * sizeof(node_ptr),
+                alignof(K));
+    }
+
+    static constexpr std::size_t allocSize(bool leaf)
+    {
+        if (leaf) {
+            return slotsOffset() + btree_width * sizeof(value_type);
+        }
+        return keysOffset() + (btree_width - 1) * sizeof(K);
+    }
+
+    mutable typename Policy::refcount_type refs;
+    uint8_t count = 0;
+    const bool m_leaf;
+    const edit_type edit;
+};
+
+// Bidirectional iterator over a sorted map's values, in key order. It
+// keeps the path to its leaf, so moving between leaves only climbs as
+// far as their common branch.
+template <class K, class T, class Policy>
+class btree_iterator
+{
+    using node_type = btree_node<K, T, Policy>;
+
+public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = typename node_type::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
+    btree_iterator() = default;
+
+    // the end of the tree at root, with the given number of levels of
+    // branches
+    btree_iterator(const node_type* root, uint32_t height) noexcept :
+        root(root),
+        height(height)
+    {}
+
+    // Descends from root, taking slot pick(node, levels below it) of
+    // each node. The slot picked in the leaf may be one past its last.
+    template <class Pick>
+    btree_iterator(const node_type* root, uint32_t height, Pick pick) noexcept :
+        root(root),
+        height(height)
+    {
+        if (!root) {
+            return;
+        }
+
+        auto n = root;
+        for (uint32_t h = 0; h < height; h++) {
+            path[h] = n;
+            slots[h] = pick(n, height - h);
+            n = n->children()[slots[h]].get();
+        }
+
+        leaf = n;
+        pos = pick(n, 0);
+        if (pos == leaf->size()) {
+            nextLeaf();
+        }
+    }
+
+    reference operator*() const noexcept { return leaf->values()[pos]; }
+    pointer operator->() const noexcept { return leaf->values() + pos; }
+
+    btree_iterator& operator++() noexcept
+    {
+        if (++pos == leaf->size()) {
+            nextLeaf();
+        }
+        return *this;
+    }
+
+    btree_iterator operator++(int) noexcept
+    {
+        auto it = *this;
+        ++*this;
+        return it;
+    }
+
+    btree_iterator& operator--() noexcept
+    {
+        if (!leaf) {
+            lastLeaf();
+        } else if (pos > 0) {
+            pos--;
+        } else {
+            prevLeaf();
+        }
+        return *this;
+    }
+
+    btree_iterator operator--(int) noexcept
+    {
+        auto it = *this;
+        --*this;
+        return it;
+    }
+
+    friend bool operator==(const btree_iterator& a,
+            const btree_iterator& b) noexcept
+    {
+        return a.leaf == b.leaf && a.pos == b.pos;
+    }
+
+    friend bool operator!=(const btree_iterator& a,
+            const btree_iterator& b) noexcept
+    {
+        return !(a == b);
+    }
+
+private:
+    // moves to the first value of the next leaf, or to the end
+    void nextLeaf() noexcept
+    {
+        auto h = height;
+        while (h > 0 && slots[h - 1] + 1 == path[h - 1]->size()) {
+            h--;
+        }
+
+        pos = 0;
+        if (h == 0) {
+            leaf = nullptr;
+            return;
+        }
+
+        slots[h - 1]++;
+        leaf = descend(h, false);
+    }
+
+    // moves to the last value of the previous leaf
+    void prevLeaf() noexcept
+    {
+        auto h = height;
+        while (slots[h - 1] == 0) {
+            h--;
+        }
+
+        slots[h - 1]--;
+        leaf = descend(h, true);
+        pos = leaf->size() - 1;
+    }
+
+    // moves from the end to the last value
+    void lastLeaf() noexcept
+    {
+        auto n = root;
+        for (uint32_t h = 0; h < height; h++) {
+            path[h] = n;
+            slots[h] = n->size() - 1;
+            n = n->children()[slots[h]].get();
+        }
+
+        leaf = n;
+        pos = leaf->size() - 1;
+    }
+
+    // Fills the path below level h - 1 down to the first or last leaf
+    // under the subtree taken there, and returns the leaf
+    const node_type* descend(uint32_t h, bool last) noexcept
+    {
+        auto n = path[h - 1]->children()[slots[h - 1]].get();
+        for (; h < height; h++) {
+            path[h] = n;
+            slots[h] = last ? n->size() - 1 : 0;
+            n = n->children()[slots[h]].get();
+        }
+        return n;
+    }
+
+    const node_type* root = nullptr;
+    uint32_t height = 0;
+
+    // branches from the root down, and the slot taken in each
+    const node_type* path[btree_max_depth] = {};
+    uint32_t slots[btree_max_depth] = {};
+
+    // null at the end
+    const node_type* leaf = nullptr;
+    uint32_t pos = 0;
+};
+
+// The contents of a sorted map: a B+tree, whose root is a leaf until
+// it fills, or null when the map is empty, and whose leaves are all
+// height levels of branches below it. Changes are made in place to
+// nodes owned by the given edit, and on copies otherwise.
+template <class K, class T, class Compare, class Policy>
+struct btree
+{
+    using node_type = btree_node<K, T, Policy>;
+    using node_ptr = typename node_type::node_ptr;
+    using value_type = typename node_type::value_type;
+    using iterator = btree_iterator<K, T, Policy>;
+
+    std::size_t count = 0;
+    uint32_t height = 0;
+    node_ptr root;
+
+    template <class Key>
+    const value_type* find(const Key& key) const
+    {
+        if (!root) {
+            return nullptr;
+        }
+
+        const node_type* n = root.get();
+        for (auto h = height; h > 0; h--) {
+            n = n->children()[childFor(n, key)].get();
+        }
+
+        auto i = lowerIn(n, key);
+        if (i < n->size() && !Compare{}(key, n->values()[i].first)) {
+            return n->values() + i;
+        }
+        return nullptr;
+    }
+
+    iterator begin() const
+    {
+        return {root.get(), height, [](const node_type*, uint32_t) {
+                    return 0u;
+                }};
+    }
+
+    iterator end() const { return {root.get(), height}; }
+
+    // the first value whose key isn't less than key
+    template <class Key>
+    iterator lowerBound(const Key& key) const
+    {
+        return {root.get(), height, [&](const node_type* n, uint32_t h) {
+                    return h ? childFor(n, key) : lowerIn(n, key);
+                }};
+    }
+
+    // the first value whose key is greater than key
+    template <class Key>
+    iterator upperBound(const Key& key) const
+    {
+        return {root.get(), height, [&](const node_type* n, uint32_t h) {
+                    return h ? childFor(n, key) : upperIn(n, key);
+                }};
+    }
+
+    // Adds value, or replaces the value of its key, returning whether
+    // it was added. The root stays the same if the key already had an
+    // equal value.
+    bool assoc(edit_type edit, value_type value)
+    {
+        if (!root) {
+            root = node_type::leaf(edit);
+            root->pushValue(std::move(value));
+            count = 1;
+            return true;
+        }
+
+        bool added = false;
+        split_type split;
+        if (auto n = assocIn(edit, root, height, std::move(value), true, added,
+                    split)) {
+            root = std::move(n);
+        }
+        if (split.right) {
+            auto n = node_type::branch(edit);
+            n->pushChild(std::move(root));
+            n->insertChild(1, std::move(*split.key), std::move(split.right));
+            root = std::move(n);
+            height++;
+        }
+
+        count += added;
+        return added;
+    }
+
+    // removes key, returning whether it was there
+    template <class Key>
+    bool without(edit_type edit, const Key& key)
+    {
+        if (!root) {
+            return false;
+        }
+
+        bool removed = false;
+        if (auto n = withoutIn(edit, root, height, key, removed)) {
+            root = std::move(n);
+        }
+        if (!removed) {
+            return false;
+        }
+
+        // drop levels left with a single subtree
+        while (height > 0 && root->size() == 1) {
+            root = root->children()[0];
+            height--;
+        }
+        if (root->size() == 0) {
+            root.reset();
+            height = 0;
+        }
+
+        count--;
+        return true;
+    }
+
+    // Builds the tree from values in any order, all at once. If a key
+    // appears more than once, its last value is kept. The values are
+    // moved into the tree.
+    void build(std::vector<value_type>& values)
+    {
+        *this = {};
+        std::stable_sort(values.begin(), values.end(),
+                [](const value_type& a, const value_type& b) {
+                    return Compare{}(a.first, b.first);
+                });
+
+        std::size_t n = 0;
+        for (std::size_t i = 0; i < values.size(); i++) {
+            if (n && !Compare{}(values[n - 1].first, values[i].first)) {
+                values[n - 1] = std::move(values[i]);
+            } else {
+                if (n != i) {
+                    values[n] = std::move(values[i]);
+                }
+                n++;
+            }
+        }
+        values.resize(n);
+        if (values.empty()) {
+            return;
+        }
+
+        // full leaves, except that the values are spread over them
+        // evenly so none is less than half full
+        std::vector<node_ptr> level;
+        std::vector<K> lows;
+        auto leaves = (n + btree_width - 1) / btree_width;
+        for (std::size_t j = 0; j < leaves; j++) {
+            auto leaf = node_type::leaf(edit_type{});
+            for (auto i = n * j / leaves; i < n * (j + 1) / leaves; i++) {
+                leaf->pushValue(std::move(values[i]));
+            }
+            lows.push_back(leaf->values()[0].first);
+            level.push_back(std::move(leaf));
+        }
+
+        // then branches over them, the same way
+        while (level.size() > 1) {
+            std::vector<node_ptr> above;
+            std::vector<K> aboveLows;
+            auto size = level.size();
+            auto branches = (size + btree_width - 1) / btree_width;
+            for (std::size_t j = 0; j < branches; j++) {
+                auto first = size * j / branches;
+                auto branch = node_type::branch(edit_type{});
+                branch->pushChild(std::move(level[first]));
+                for (auto i = first + 1; i < size * (j + 1) / branches; i++) {
+                    branch->insertChild(branch->size(), std::move(lows[i]),
+                            std::move(level[i]));
+                }
+                aboveLows.push_back(std::move(lows[first]));
+                above.push_back(std::move(branch));
+            }
+
+            level = std::move(above);
+            lows = std::move(aboveLows);
+            height++;
+        }
+
+        root = std::move(level[0]);
+        count = n;
+    }
+
+private:
+    // the right half of a node that overflowed, and the key between it
+    // and the left
+    struct split_type
+    {
+        node_ptr right;
+        std::optional<K> key;
+    };
+
+    // index of the first value in leaf n whose key isn't less than key
+    template <class Key>
+    static uint32_t lowerIn(const node_type* n, const Key& key) noexcept
+    {
+        auto vals = n->values();
+        return uint32_t(std::lower_bound(vals, vals + n->size(), key,
+                                [](const value_type& v, const Key& k) {
+                                    return Compare{}(v.first, k);
+                                }) -
+                        vals);
+    }
+
+    // index of the first value in leaf n whose key is greater than key
+    template <class Key>
+    static uint32_t upperIn(const node_type* n, const Key& key) noexcept
+    {
+        auto vals = n->values();
+        return uint32_t(std::upper_bound(vals, vals + n->size(), key,
+                                [](const Key& k, const value_type& v) {
+                                    return Compare{}(k, v.first);
+                                }) -
+                        vals);
+    }
+
+    // slot of branch n whose subtree would hold key
+    template <class Key>
+    static uint32_t childFor(const node_type* n, const Key& key) noexcept
+    {
+        auto keys = n->keys();
+        return uint32_t(std::upper_bound(keys, keys + n->size() - 1, key,
+                                [](const Key& k, const K& sep) {
+                                    return Compare{}(k, sep);
+                                }) -
+                        keys);
+    }
+
+    static node_ptr editable(const node_ptr& n, edit_type edit)
+    {
+        return n->ownedBy(edit) ? n : n->copy(edit);
+    }
+
+    // n if edit owns it, otherwise a copy, which is also put in dup.
+    // Unlike the above, changing a node in place costs no reference
+    // count changes.
+    static node_type* editable(const node_ptr& n, edit_type edit,
+            node_ptr& dup)
+    {
+        if (n->ownedBy(edit)) {
+            return n.get();
+        }
+        dup = n->copy(edit);
+        return dup.get();
+    }
+
+    // How many of the 33 values or subtrees of an overflowing node go
+    // to its left half, given where the new one goes. Appending to the
+    // right edge of the tree, as with keys that only grow, leaves the
+    // left half full, so such trees aren't left half empty.
+    static uint32_t splitPoint(uint32_t i, bool edge) noexcept
+    {
+        return edge && i == btree_width ? btree_width : btree_min + 1;
+    }
+
+    // Adds value to n, a subtree with the given height, which is on
+    // the right edge of the tree if edge. Returns n's replacement, or
+    // null if n stays, whether changed in place or not. If n
+    // overflowed, its right half is split off into split.
+    static node_ptr assocIn(edit_type edit, const node_ptr& n,
+            uint32_t height, value_type&& value, bool edge, bool& added,
+            split_type& split)
+    {
+        node_ptr dup;
+        if (height == 0) {
+            auto vals = n->values();
+            auto i = lowerIn(n.get(), value.first);
+            if (i < n->size() && !Compare{}(value.first, vals[i].first)) {
+                if (!(vals[i].second == value.second)) {
+                    editable(n, edit, dup)->values()[i].second =
+                            std::move(value.second);
+                }
+                return dup;
+            }
+
+            added = true;
+            if (n->size() < btree_width) {
+                editable(n, edit, dup)->insertValue(i, std::move(value));
+                return dup;
+            }
+
+            auto mid = splitPoint(i, edge);
+            auto left = node_type::leaf(edit);
+            auto right = node_type::leaf(edit);
+            for (uint32_t j = 0; j <= btree_width; j++) {
+                auto& half = j < mid ? left : right;
+                if (j == i) {
+                    half->pushValue(std::move(value));
+                } else {
+                    half->pushValue(vals[j < i ? j : j - 1]);
+                }
+            }
+
+            split.key = right->values()[0].first;
+            split.right = std::move(right);
+            return left;
+        }
+
+        auto i = childFor(n.get(), value.first);
+        auto kids = n->children();
+
+        split_type sub;
+        auto child = assocIn(edit, kids[i], height - 1, std::move(value),
+                edge && i + 1 == n->size(), added, sub);
+        if (!sub.right) {
+            if (child) {
+                editable(n, edit, dup)->children()[i] = std::move(child);
+            }
+            return dup;
+        } else if (n->size() < btree_width) {
+            auto target = editable(n, edit, dup);
+            if (child) {
+                target->children()[i] = std::move(child);
+            }
+            target->insertChild(i + 1, std::move(*sub.key),
+                    std::move(sub.right));
+            return dup;
+        }
+
+        // n's subtrees, with child in place of i and the split off half
+        // after it, and the keys between them
+        if (!child) {
+            child = kids[i];
+        }
+        auto kid = [&](uint32_t j) -> const node_ptr& {
+            return j < i ? kids[j]
+                         : j == i ? child : j == i + 1 ? sub.right : kids[j - 1];
+        };
+        auto key = [&](uint32_t j) -> const K& {
+            return j < i ? n->keys()[j] : j == i ? *sub.key : n->keys()[j - 1];
+        };
+
+        auto mid = splitPoint(i + 1, edge);
+        auto left = node_type::branch(edit);
+        left->pushChild(kid(0));
+        for (uint32_t j = 1; j < mid; j++) {
+            left->insertChild(j, key(j - 1), kid(j));
+        }
+
+        auto right = node_type::branch(edit);
+        right->pushChild(kid(mid));
+        for (uint32_t j = mid + 1; j <= btree_width; j++) {
+            right->insertChild(j - mid, key(j - 1), kid(j));
+        }
+
+        split.key = key(mid - 1);
+        split.right = std::move(right);
+        return left;
+    }
+
+    // Removes key from n, a subtree with the given height, returning
+    // its replacement, or null if n stays, as assocIn() does. n may be
+    // left with too few values or subtrees for its parent to fix.
+    template <class Key>
+    static node_ptr withoutIn(edit_type edit, const node_ptr& n,
+            uint32_t height, const Key& key, bool& removed)
+    {
+        node_ptr dup;
+        if (height == 0) {
+            auto i = lowerIn(n.get(), key);
+            if (i < n->size() && !Compare{}(key, n->values()[i].first)) {
+                removed = true;
+                editable(n, edit, dup)->eraseValue(i);
+            }
+            return dup;
+        }
+
+        auto i = childFor(n.get(), key);
+        auto child = withoutIn(edit, n->children()[i], height - 1, key,
+                removed);
+        if (!removed) {
+            return dup;
+        }
+
+        auto target = editable(n, edit, dup);
+        if (child) {
+            target->children()[i] = std::move(child);
+        }
+
+        auto size = target->children()[i]->size();
+        if (size == 0) {
+            // only nodes along the right edge get this small
+            target->eraseChild(i);
+        } else if (size < btree_min && target->size() > 1) {
+            rebalance(edit, target, i, height);
+        }
+        return dup;
+    }
+
+    // Fixes subtree i of n, a branch owned by edit with the given
+    // height, after it's been left with too few values or subtrees, by
+    // merging it with a neighbour, or if they won't fit in one node,
+    // taking one from it
+    static void rebalance(edit_type edit, node_type* n, uint32_t i,
+            uint32_t height)
+    {
+        auto l = i + 1 < n->size() ? i : i - 1;
+        auto& sep = n->keys()[l];
+        auto left = editable(n->children()[l], edit);
+        auto right = n->children()[l + 1];
+        bool leaves = height == 1;
+
+        if (left->size() + right->size() <= btree_width) {
+            if (leaves) {
+                for (uint32_t j = 0; j < right->size(); j++) {
+                    left->pushValue(right->values()[j]);
+                }
+            } else {
+                left->insertChild(left->size(), sep, right->children()[0]);
+                for (uint32_t j = 1; j < right->size(); j++) {
+                    left->insertChild(left->size(), right->keys()[j - 1],
+                            right->children()[j]);
+                }
+            }
+
+            n->children()[l] = std::move(left);
+            n->eraseChild(l + 1);
+            return;
+        }
+
+        right = editable(right, edit);
+        if (left->size() < right->size()) {
+            if (leaves) {
+                left->pushValue(std::move(right->values()[0]));
+                right->eraseValue(0);
+                sep = right->values()[0].first;
+            } else {
+                left->insertChild(left->size(), std::move(sep),
+                        right->children()[0]);
+                sep = std::move(right->keys()[0]);
+                right->eraseChild(0);
+            }
+        } else {
+            auto last = left->size() - 1;
+            if (leaves) {
+                right->insertValue(0, std::move(left->values()[last]));
+                left->eraseValue(last);
+                sep = right->values()[0].first;
+            } else {
+                right->insertChild(0, std::move(sep), left->children()[last]);
+                sep = std::move(left->keys()[last - 1]);
+                left->eraseChild(last);
+            }
+        }
+
+        n->children()[l] = std::move(left);
+        n->children()[l + 1] = std::move(right);
+    }
+};
+
+} // namespace rw::pdata::detail
+
+#endif // RW_PDATA_SORTED_MAP_DETAIL_H
@@ -0,0 +1,288 @@
+#ifndef RW_PDATA_SORTED_MAP_H
+#define RW_PDATA_SORTED_MAP_H
+
+#include "rw/pdata/policy.h"
+#include "rw/pdata/sorted_map-detail.h"
+
+#include <algorithm>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+namespace rw::pdata {
+
+template <class K, class T, class Compare, class Policy>
+class persistent_sorted_map;
+
+template <class K, class T, class Compare = std::less<K>,
+        class Policy = shared_policy>
+class transient_sorted_map :
+    public std::enable_shared_from_this<
+            transient_sorted_map<K, T, Compare, Policy>>
+{
+    using tree_type = detail::btree<K, T, Compare, Policy>;
+
+public:
+    using value_type = typename tree_type::value_type;
+    using const_iterator = typename tree_type::iterator;
+    using iterator = const_iterator;
+
+    std::size_t size() const noexcept { return tree.count; }
+
+    const_iterator begin() const
+    {
+        ensureEditable();
+        return tree.begin();
+    }
+
+    const_iterator end() const { return tree.end(); }
+
+    std::shared_ptr<transient_sorted_map> assoc(const K& key, T val)
+    {
+        ensureEditable();
+        tree.assoc(edit, {key, std::move(val)});
+        return this->shared_from_this();
+    }
+
+    std::shared_ptr<transient_sorted_map> without(const K& key)
+    {
+        ensureEditable();
+        tree.without(edit, key);
+        return this->shared_from_this();
+    }
+
+    std::optional<T> find(const K& key) const
+    {
+        ensureEditable();
+        if (auto found = tree.find(key)) {
+            return found->second;
+        }
+        return std::nullopt;
+    }
+
+    bool contains(const K& key) const
+    {
+        ensureEditable();
+        return tree.find(key) != nullptr;
+    }
+
+    std::shared_ptr<persistent_sorted_map<K, T, Compare, Policy>> persistent()
+    {
+        ensureEditable();
+
+        // as with transient_map, nodes keep this transient's id, which
+        // no other edit will match
+        edit = 0;
+
+        return persistent_sorted_map<K, T, Compare, Policy>::make(tree);
+    }
+
+private:
+    friend class persistent_sorted_map<K, T, Compare, Policy>;
+
+    explicit transient_sorted_map(tree_type tree) :
+        edit(detail::newEdit()),
+        tree(std::move(tree))
+    {}
+
+    // throws if persistent() has already been called
+    void ensureEditable() const
+    {
+        if (!edit) {
+            throw std::logic_error(
+                    "transient_sorted_map used after persistent()");
+        }
+    }
+
+    detail::edit_type edit;
+    tree_type tree;
+};
+
+// Immutable map ordered by key, stored as a B+tree of 32 wide nodes,
+// so lookups and updates cost O(log32 n), and ordered iteration walks
+// leaves of contiguous values. lower_bound() and upper_bound() give
+// ranges of keys without a sort. Versions share structure, and an
+// update copies only the nodes on its path, so keeping old versions of
+// an index around is cheap.
+template <class K, class T, class Compare = std::less<K>,
+        class Policy = shared_policy>
+class persistent_sorted_map :
+    public std::enable_shared_from_this<
+            persistent_sorted_map<K, T, Compare, Policy>>
+{
+    using tree_type = detail::btree<K, T, Compare, Policy>;
+
+public:
+    using value_type = typename tree_type::value_type;
+    using const_iterator = typename tree_type::iterator;
+    using iterator = const_iterator;
+
+    persistent_sorted_map() = default;
+
+    // Builds a map from a range of key/value pairs all at once, which
+    // is much faster than assoc'ing them one by one. If a key appears
+    // more than once, its last value is kept.
+    template <class InputIt>
+    static std::shared_ptr<persistent_sorted_map> create(InputIt first,
+            InputIt last)
+    {
+        std::vector<value_type> values(first, last);
+
+        tree_type tree;
+        tree.build(values);
+        return make(std::move(tree));
+    }
+
+    static std::shared_ptr<persistent_sorted_map> create(
+            std::initializer_list<value_type> values)
+    {
+        return create(values.begin(), values.end());
+    }
+
+    std::size_t size() const noexcept { return tree.count; }
+    bool empty() const noexcept { return tree.count == 0; }
+
+    const_iterator begin() const { return tree.begin(); }
+    const_iterator end() const { return tree.end(); }
+
+    // Returns a new persistent_sorted_map, adding or replacing a value
+    std::shared_ptr<persistent_sorted_map> assoc(const K& key, T val)
+    {
+        auto next = tree;
+        next.assoc(detail::edit_type{}, {key, std::move(val)});
+        if (next.root == tree.root) {
+            return this->shared_from_this();
+        }
+        return make(std::move(next));
+    }
+
+    std::shared_ptr<persistent_sorted_map> without(const K& key)
+    {
+        // a new edit lets merging nodes after a removal change the
+        // copies it's just made in place
+        auto next = tree;
+        if (!next.without(detail::newEdit(), key)) {
+            return this->shared_from_this();
+        }
+        return make(std::move(next));
+    }
+
+    std::optional<T> find(const K& key) const
+    {
+        if (auto found = tree.find(key)) {
+            return found->second;
+        }
+        return std::nullopt;
+    }
+
+    // Lookups with any key type comparable with K, if Compare is
+    // transparent (defines is_transparent), like std::less<>
+    template <class Key, class C = Compare, class = typename C::is_transparent>
+    std::optional<T> find(const Key& key) const
+    {
+        if (auto found = tree.find(key)) {
+            return found->second;
+        }
+        return std::nullopt;
+    }
+
+    bool contains(const K& key) const { return tree.find(key) != nullptr; }
+
+    template <class Key, class C = Compare, class = typename C::is_transparent>
+    bool contains(const Key& key) const
+    {
+        return tree.find(key) != nullptr;
+    }
+
+    // Like find(), but returns a pointer to the value in the map, or
+    // null, rather than a copy. It stays valid for as long as this map
+    // does.
+    const T* find_ptr(const K& key) const
+    {
+        auto found = tree.find(key);
+        return found ? &found->second : nullptr;
+    }
+
+    // the first value whose key isn't less than key
+    const_iterator lower_bound(const K& key) const
+    {
+        return tree.lowerBound(key);
+    }
+
+    template <class Key, class C = Compare, class = typename C::is_transparent>
+    const_iterator lower_bound(const Key& key) const
+    {
+        return tree.lowerBound(key);
+    }
+
+    // the first value whose key is greater than key
+    const_iterator upper_bound(const K& key) const
+    {
+        return tree.upperBound(key);
+    }
+
+    template <class Key, class C = Compare, class = typename C::is_transparent>
+    const_iterator upper_bound(const Key& key) const
+    {
+        return tree.upperBound(key);
+    }
+
+    friend bool operator==(const persistent_sorted_map& a,
+            const persistent_sorted_map& b)
+    {
+        if (a.size() != b.size()) {
+            return false;
+        } else if (a.tree.root == b.tree.root) {
+            return true;
+        }
+        return std::equal(a.begin(), a.end(), b.begin());
+    }
+
+    friend bool operator!=(const persistent_sorted_map& a,
+            const persistent_sorted_map& b)
+    {
+        return !(a == b);
+    }
+
+    std::shared_ptr<transient_sorted_map<K, T, Compare, Policy>> transient() const
+    {
+        // struct to allow creation using make_shared and a private ctor
+        struct tsm_maker : public transient_sorted_map<K, T, Compare, Policy>
+        {
+            explicit tsm_maker(tree_type tree) :
+                transient_sorted_map<K, T, Compare, Policy>(std::move(tree))
+            {}
+        };
+
+        return std::make_shared<tsm_maker>(tree);
+    }
+
+private:
+    friend class transient_sorted_map<K, T, Compare, Policy>;
+
+    explicit persistent_sorted_map(tree_type tree) :
+        tree(std::move(tree))
+    {}
+
+    static std::shared_ptr<persistent_sorted_map> make(tree_type tree)
+    {
+        // struct to allow creation using make_shared and a private ctor
+        struct psm_maker : public persistent_sorted_map
+        {
+            explicit psm_maker(tree_type tree) :
+                persistent_sorted_map(std::move(tree))
+            {}
+        };
+
+        return std::make_shared<psm_maker>(std::move(tree));
+    }
+
+    tree_type tree;
+};
+
+} // namespace rw::pdata
+
+#endif // RW_PDATA_SORTED_MAP_H
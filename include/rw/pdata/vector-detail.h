@@ -0,0 +1,941 @@
+#ifndef RW_PDATA_VECTOR_DETAIL_H
+#define RW_PDATA_VECTOR_DETAIL_H
+
+#include "rw/pdata/policy.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace rw::pdata::detail {
+
+// each level of a vector's trie takes 5 bits of an index
+constexpr uint32_t vector_bits = 5;
+constexpr uint32_t vector_width = 1u << vector_bits;
+
+// Node of a vector's trie. Leaves hold up to 32 values, and branches
+// up to 32 subtrees. In a regular branch every subtree but the last is
+// full, so an index is split into 5 bit slot numbers. A relaxed branch
+// (made by slicing or concatenation) may have subtrees that aren't, so
+// it also keeps the running total of values under its subtrees. The
+// slots follow the node in the same allocation.
+template <class T, class Policy>
+class vector_node
+{
+public:
+    using node_ptr = ref_ptr<vector_node>;
+
+    static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__,
+            "over-aligned values are not supported");
+
+    static ref_ptr<vector_node> leaf(edit_type edit)
+    {
+        return create(edit, true, false);
+    }
+
+    static ref_ptr<vector_node> branch(edit_type edit, bool relaxed)
+    {
+        return create(edit, false, relaxed);
+    }
+
+    void retain() const noexcept { refs.inc(); }
+    void release() const noexcept
+    {
+        if (refs.dec()) {
+            Policy::reclaimer_type::retire(const_cast<vector_node*>(this),
+                    &vector_node::reclaim);
+        }
+    }
+
+    bool isLeaf() const noexcept { return m_leaf; }
+    bool relaxed() const noexcept { return m_relaxed; }
+
+    // whether the node can be changed in place by edit
+    bool ownedBy(edit_type other) const noexcept
+    {
+        return sameEdit(edit, other);
+    }
+
+    // number of values in a leaf, or of subtrees in a branch
+    uint32_t size() const noexcept { return count; }
+
+    T* values() const noexcept
+    {
+        auto base = reinterpret_cast<const char*>(this) + slotsOffset();
+        return reinterpret_cast<T*>(const_cast<char*>(base));
+    }
+
+    node_ptr* children() const noexcept
+    {
+        auto base = reinterpret_cast<const char*>(this) + slotsOffset();
+        return reinterpret_cast<node_ptr*>(const_cast<char*>(base));
+    }
+
+    // only in relaxed branches: values under subtrees 0 to idx
+    std::size_t* sizes() const noexcept
+    {
+        auto base = reinterpret_cast<const char*>(this) + sizesOffset();
+        return reinterpret_cast<std::size_t*>(const_cast<char*>(base));
+    }
+
+    void push(T val)
+    {
+        new (values() + count) T(std::move(val));
+        count++;
+    }
+
+    void pop() noexcept { std::destroy_at(values() + --count); }
+
+    // adds a subtree to a regular branch
+    void pushChild(node_ptr child) noexcept
+    {
+        new (children() + count) node_ptr(std::move(child));
+        count++;
+    }
+
+    // adds a subtree to a relaxed branch, with the running total of
+    // values it brings the branch to
+    void pushChild(node_ptr child, std::size_t total) noexcept
+    {
+        new (children() + count) node_ptr(std::move(child));
+        sizes()[count] = total;
+        count++;
+    }
+
+    void popChild() noexcept { std::destroy_at(children() + --count); }
+
+    // a copy of the node owned by edit
+    ref_ptr<vector_node> copy(edit_type edit) const
+    {
+        auto dup = create(edit, m_leaf, m_relaxed);
+        if (m_leaf) {
+            for (uint32_t i = 0; i < count; i++) {
+                dup->push(values()[i]);
+            }
+        } else {
+            for (uint32_t i = 0; i < count; i++) {
+                if (m_relaxed) {
+                    dup->pushChild(children()[i], sizes()[i]);
+                } else {
+                    dup->pushChild(children()[i]);
+                }
+            }
+        }
+        return dup;
+    }
+
+private:
+    vector_node(edit_type edit, bool leaf, bool relaxed) noexcept :
+        m_leaf(leaf),
+        m_relaxed(relaxed),
+        edit(edit)
+    {}
+
+    ~vector_node()
+    {
+        if (m_leaf) {
+            std::destroy_n(values(), count);
+        } else {
+            std::destroy_n(children(), count);
+        }
+    }
+
+    static ref_ptr<vector_node> create(edit_type edit, bool leaf,
+            bool relaxed)
+    {
+        void* mem = Policy::allocator_type::allocate(allocSize(leaf, relaxed));
+        return ref_ptr<vector_node>{new (mem) vector_node(edit, leaf, relaxed)};
+    }
+
+    void destroy() noexcept
+    {
+        auto size = allocSize(m_leaf, m_relaxed);
+        this->~vector_node();
+        Policy::allocator_type::deallocate(this, size);
+    }
+
+    // destroys a node the policy's reclaimer was given by release()
+    static void reclaim(void* n) noexcept
+    {
+        static_cast<vector_node*>(n)->destroy();
+    }
+
+    static constexpr std::size_t alignUp(std::size_t n, std::size_t align)
+    {
+        return (n + align - 1) & ~(align - 1);
+    }
+
+    static constexpr std::size_t slotsOffset()
+    {
+        return alignUp(sizeof(vector_node),
+                std::max(alignof(T), alignof(node_ptr)));
+    }
+
+    static constexpr std::size_t sizesOffset()
+    {
+        return slotsOffset() + vector_width * sizeof(node_ptr);
+    }
+
+    static constexpr std::size_t allocSize(bool leaf, bool relaxed)
+    {
+        if (leaf) {
+            return slotsOffset() + vector_width * sizeof(T);
+        } else if (relaxed) {
+            return sizesOffset() + vector_width * sizeof(std::size_t);
+        }
+        return sizesOffset();
+    }
+
+    mutable typename Policy::refcount_type refs;
+    uint8_t count = 0;
+    const bool m_leaf;
+    const bool m_relaxed;
+    const edit_type edit;
+};
+
+// The contents of a vector: a trie of leaves, plus a tail leaf holding
+// the last 1-32 values, so most appends and pops only touch the tail.
+// The root is a branch, or null while the tail holds everything, and
+// shift is the number of index bits below it. Changes are made in
+// place to nodes owned by the given edit, and on copies otherwise.
+template <class T, class Policy>
+struct vector_trie
+{
+    using node_type = vector_node<T, Policy>;
+    using node_ptr = typename node_type::node_ptr;
+
+    std::size_t count = 0;
+    uint32_t shift = vector_bits;
+    node_ptr root;
+    node_ptr tail;
+
+    std::size_t tailOffset() const noexcept
+    {
+        return count - (tail ? tail->size() : 0);
+    }
+
+    // the leaf holding index i, which is made relative to it
+    const node_type* leafFor(std::size_t& i) const noexcept
+    {
+        auto offset = tailOffset();
+        if (i >= offset) {
+            i -= offset;
+            return tail.get();
+        }
+
+        const node_type* n = root.get();
+        for (auto s = shift; s > 0; s -= vector_bits) {
+            n = n->children()[slotOf(n, s, i)].get();
+        }
+        return n;
+    }
+
+    const T& get(std::size_t i) const noexcept
+    {
+        auto leaf = leafFor(i);
+        return leaf->values()[i];
+    }
+
+    void push_back(edit_type edit, T val)
+    {
+        if (tail && tail->size() < vector_width) {
+            ensureOwned(tail, edit);
+            tail->push(std::move(val));
+        } else {
+            auto leaf = node_type::leaf(edit);
+            leaf->push(std::move(val));
+            if (tail) {
+                pushLeaf(edit, tail);
+            }
+            tail = std::move(leaf);
+        }
+        count++;
+    }
+
+    void pop_back(edit_type edit)
+    {
+        if (tail->size() > 1) {
+            ensureOwned(tail, edit);
+            tail->pop();
+        } else if (!root) {
+            tail.reset();
+        } else {
+            // the tree's last leaf becomes the tail
+            node_ptr leaf;
+            root = popLeaf(edit, root, shift, leaf);
+            tail = std::move(leaf);
+            shrink();
+        }
+        count--;
+    }
+
+    void set(edit_type edit, std::size_t i, T val)
+    {
+        auto offset = tailOffset();
+        if (i >= offset) {
+            ensureOwned(tail, edit);
+            tail->values()[i - offset] = std::move(val);
+        } else {
+            root = setIn(edit, root, shift, i, std::move(val));
+        }
+    }
+
+    // keeps the first n values
+    void take(edit_type edit, std::size_t n)
+    {
+        if (n >= count) {
+            return;
+        } else if (n == 0) {
+            *this = {};
+            return;
+        }
+
+        auto offset = tailOffset();
+        if (n > offset) {
+            ensureOwned(tail, edit);
+            while (tail->size() > n - offset) {
+                tail->pop();
+            }
+        } else {
+            // the leaf holding the new last value becomes the tail
+            auto idx = n - 1;
+            auto leaf = leafFor(idx);
+            auto start = n - 1 - idx;
+
+            auto newTail = node_type::leaf(edit);
+            for (std::size_t i = 0; i <= idx; i++) {
+                newTail->push(leaf->values()[i]);
+            }
+
+            root = start ? takeIn(edit, root, shift, start) : nullptr;
+            tail = std::move(newTail);
+            shrink();
+        }
+        count = n;
+    }
+
+    // drops the first n values
+    void drop(edit_type edit, std::size_t n)
+    {
+        if (n == 0) {
+            return;
+        } else if (n >= count) {
+            *this = {};
+            return;
+        }
+
+        auto offset = tailOffset();
+        if (n >= offset) {
+            if (n > offset) {
+                auto leaf = node_type::leaf(edit);
+                for (auto i = n - offset; i < tail->size(); i++) {
+                    leaf->push(tail->values()[i]);
+                }
+                tail = std::move(leaf);
+            }
+            root.reset();
+            shift = vector_bits;
+        } else {
+            root = dropIn(edit, root, shift, n);
+            shrink();
+        }
+        count -= n;
+    }
+
+    // appends other's values
+    void concat(edit_type edit, const vector_trie& other)
+    {
+        if (other.count == 0) {
+            return;
+        } else if (count == 0) {
+            *this = other;
+            return;
+        } else if (!other.root) {
+            for (uint32_t i = 0; i < other.tail->size(); i++) {
+                push_back(edit, other.tail->values()[i]);
+            }
+            return;
+        }
+
+        // the tail joins the tree, whose right edge is then merged with
+        // the left edge of other's tree
+        pushLeaf(edit, tail);
+
+        auto top = std::max(shift, other.shift);
+        auto joined = join(edit, root, shift, other.root, other.shift);
+        if (joined.size() == 1) {
+            root = std::move(joined[0]);
+            shift = top;
+        } else {
+            root = makeBranch(edit, top + vector_bits, joined.data(),
+                    joined.data() + joined.size());
+            shift = top + vector_bits;
+        }
+
+        tail = other.tail;
+        count += other.count;
+        shrink();
+    }
+
+private:
+    // a subtree rooted at a leaf has a shift of 0
+    static constexpr std::size_t fullSize(uint32_t shift) noexcept
+    {
+        return std::size_t{1} << (shift + vector_bits);
+    }
+
+    // number of values under n, a subtree at shift
+    static std::size_t treeSize(const node_type* n, uint32_t shift) noexcept
+    {
+        std::size_t total = 0;
+        for (; shift > 0; shift -= vector_bits) {
+            auto last = n->size() - 1;
+            if (n->relaxed()) {
+                return total + n->sizes()[last];
+            }
+            total += std::size_t(last) << shift;
+            n = n->children()[last].get();
+        }
+        return total + n->size();
+    }
+
+    // slot of n, a branch at shift, holding index i, which is made
+    // relative to it
+    static uint32_t slotOf(const node_type* n, uint32_t shift,
+            std::size_t& i) noexcept
+    {
+        // subtrees hold at most 1 << shift values, so a relaxed
+        // branch's slot is at or after the regular one
+        auto slot = uint32_t(i >> shift);
+        if (!n->relaxed()) {
+            i -= std::size_t(slot) << shift;
+            return slot;
+        }
+
+        auto sizes = n->sizes();
+        while (sizes[slot] <= i) {
+            slot++;
+        }
+        if (slot) {
+            i -= sizes[slot - 1];
+        }
+        return slot;
+    }
+
+    static node_ptr editable(const node_ptr& n, edit_type edit)
+    {
+        return n->ownedBy(edit) ? n : n->copy(edit);
+    }
+
+    // replaces n with a copy unless edit owns it, which keeps the
+    // common case free of reference count changes
+    static void ensureOwned(node_ptr& n, edit_type edit)
+    {
+        if (!n->ownedBy(edit)) {
+            n = n->copy(edit);
+        }
+    }
+
+    // A branch at shift holding the given subtrees. It's only relaxed
+    // if one before the last isn't full.
+    static node_ptr makeBranch(edit_type edit, uint32_t shift,
+            const node_ptr* first, const node_ptr* last)
+    {
+        std::array<std::size_t, vector_width> totals;
+        std::size_t total = 0;
+        bool relaxed = false;
+        for (auto it = first; it != last; ++it) {
+            auto size = treeSize(it->get(), shift - vector_bits);
+            relaxed |= it + 1 != last && size != fullSize(shift - vector_bits);
+            total += size;
+            totals[it - first] = total;
+        }
+
+        auto n = node_type::branch(edit, relaxed);
+        for (auto it = first; it != last; ++it) {
+            if (relaxed) {
+                n->pushChild(*it, totals[it - first]);
+            } else {
+                n->pushChild(*it);
+            }
+        }
+        return n;
+    }
+
+    // leaf, under branches up to one at shift
+    static node_ptr newPath(edit_type edit, uint32_t shift, node_ptr leaf)
+    {
+        for (uint32_t s = vector_bits; s <= shift; s += vector_bits) {
+            auto n = node_type::branch(edit, false);
+            n->pushChild(std::move(leaf));
+            leaf = std::move(n);
+        }
+        return leaf;
+    }
+
+    // adds a leaf of any size after the tree's last
+    void pushLeaf(edit_type edit, const node_ptr& leaf)
+    {
+        if (!root) {
+            root = newPath(edit, vector_bits, leaf);
+            shift = vector_bits;
+        } else if (auto n = appendIn(edit, root, shift, leaf)) {
+            root = std::move(n);
+        } else {
+            // the tree is full, so grows a level
+            std::array<node_ptr, 2> halves{root, newPath(edit, shift, leaf)};
+            root = makeBranch(edit, shift + vector_bits, halves.data(),
+                    halves.data() + halves.size());
+            shift += vector_bits;
+        }
+    }
+
+    // n, a branch at shift, with leaf added after its last, or null if
+    // there's no room
+    static node_ptr appendIn(edit_type edit, const node_ptr& n, uint32_t shift,
+            const node_ptr& leaf)
+    {
+        auto last = n->size() - 1;
+        if (shift > vector_bits) {
+            if (auto sub = appendIn(edit, n->children()[last],
+                        shift - vector_bits, leaf)) {
+                auto dup = editable(n, edit);
+                dup->children()[last] = std::move(sub);
+                if (dup->relaxed()) {
+                    dup->sizes()[last] += leaf->size();
+                }
+                return dup;
+            }
+        }
+
+        if (n->size() == vector_width) {
+            return nullptr;
+        }
+
+        // the old last subtree must be full for n to stay regular
+        node_ptr dup;
+        if (n->relaxed() ||
+                treeSize(n->children()[last].get(), shift - vector_bits) ==
+                        fullSize(shift - vector_bits)) {
+            dup = editable(n, edit);
+        } else {
+            dup = relax(edit, n, shift);
+        }
+
+        auto path = newPath(edit, shift - vector_bits, leaf);
+        if (dup->relaxed()) {
+            dup->pushChild(std::move(path), dup->sizes()[last] + leaf->size());
+        } else {
+            dup->pushChild(std::move(path));
+        }
+        return dup;
+    }
+
+    // a relaxed copy of n, a branch at shift
+    static node_ptr relax(edit_type edit, const node_ptr& n, uint32_t shift)
+    {
+        auto dup = node_type::branch(edit, true);
+        std::size_t total = 0;
+        for (uint32_t i = 0; i < n->size(); i++) {
+            total += treeSize(n->children()[i].get(), shift - vector_bits);
+            dup->pushChild(n->children()[i], total);
+        }
+        return dup;
+    }
+
+    // n, a branch at shift, without its last leaf, which is returned
+    // in leaf; null if that was all it held
+    static node_ptr popLeaf(edit_type edit, const node_ptr& n, uint32_t shift,
+            node_ptr& leaf)
+    {
+        auto last = n->size() - 1;
+        node_ptr sub;
+        if (shift > vector_bits) {
+            sub = popLeaf(edit, n->children()[last], shift - vector_bits, leaf);
+        } else {
+            leaf = n->children()[last];
+        }
+
+        if (!sub && last == 0) {
+            return nullptr;
+        }
+
+        auto dup = editable(n, edit);
+        if (sub) {
+            dup->children()[last] = std::move(sub);
+            if (dup->relaxed()) {
+                dup->sizes()[last] -= leaf->size();
+            }
+        } else {
+            dup->popChild();
+        }
+        return dup;
+    }
+
+    static node_ptr setIn(edit_type edit, const node_ptr& n, uint32_t shift,
+            std::size_t i, T&& val)
+    {
+        auto dup = editable(n, edit);
+        if (shift == 0) {
+            dup->values()[i] = std::move(val);
+            return dup;
+        }
+
+        auto slot = slotOf(dup.get(), shift, i);
+        dup->children()[slot] = setIn(edit, dup->children()[slot],
+                shift - vector_bits, i, std::move(val));
+        return dup;
+    }
+
+    // the first m values of n, a subtree at shift, where m ends on a
+    // leaf boundary
+    static node_ptr takeIn(edit_type edit, const node_ptr& n, uint32_t shift,
+            std::size_t m)
+    {
+        if (shift == 0) {
+            return n;
+        }
+
+        auto i = m - 1;
+        auto slot = slotOf(n.get(), shift, i);
+        auto sub = takeIn(edit, n->children()[slot], shift - vector_bits, i + 1);
+
+        auto dup = editable(n, edit);
+        while (dup->size() > slot + 1) {
+            dup->popChild();
+        }
+        dup->children()[slot] = std::move(sub);
+        if (dup->relaxed()) {
+            dup->sizes()[slot] = m;
+        }
+        return dup;
+    }
+
+    // n, a subtree at shift, without its first m values, where m is
+    // less than its size
+    static node_ptr dropIn(edit_type edit, const node_ptr& n, uint32_t shift,
+            std::size_t m)
+    {
+        if (shift == 0) {
+            auto leaf = node_type::leaf(edit);
+            for (auto i = m; i < n->size(); i++) {
+                leaf->push(n->values()[i]);
+            }
+            return leaf;
+        }
+
+        auto slot = slotOf(n.get(), shift, m);
+        std::array<node_ptr, vector_width> kept;
+        uint32_t k = 0;
+        kept[k++] = m ? dropIn(edit, n->children()[slot], shift - vector_bits, m)
+                      : n->children()[slot];
+        for (auto i = slot + 1; i < n->size(); i++) {
+            kept[k++] = n->children()[i];
+        }
+        return makeBranch(edit, shift, kept.data(), kept.data() + k);
+    }
+
+    // Joins subtree a, at aShift, with b, at bShift, returning one or
+    // two subtrees at the higher shift holding a's values then b's.
+    // Only the nodes along a's right edge and b's left edge are
+    // rebuilt.
+    static std::vector<node_ptr> join(edit_type edit, const node_ptr& a,
+            uint32_t aShift, const node_ptr& b, uint32_t bShift)
+    {
+        std::vector<node_ptr> subs;
+        if (aShift == 0 && bShift == 0) {
+            subs = {a, b};
+            rebalance(edit, 0, subs);
+            return subs;
+        }
+
+        // join the edges a level down, then combine the result with the
+        // rest of the subtrees at this level
+        auto shift = std::max(aShift, bShift);
+        auto aLast = aShift == shift ? a->size() - 1 : 0;
+        if (aShift == shift) {
+            subs.assign(a->children(), a->children() + aLast);
+        }
+
+        auto mid = join(edit, aShift == shift ? a->children()[aLast] : a,
+                aShift == shift ? aShift - vector_bits : aShift,
+                bShift == shift ? b->children()[0] : b,
+                bShift == shift ? bShift - vector_bits : bShift);
+        subs.insert(subs.end(), mid.begin(), mid.end());
+
+        if (bShift == shift) {
+            subs.insert(subs.end(), b->children() + 1,
+                    b->children() + b->size());
+        }
+
+        rebalance(edit, shift - vector_bits, subs);
+
+        std::vector<node_ptr> joined;
+        for (std::size_t i = 0; i < subs.size(); i += vector_width) {
+            auto end = std::min<std::size_t>(i + vector_width, subs.size());
+            joined.push_back(makeBranch(edit, shift, subs.data() + i,
+                    subs.data() + end));
+        }
+        return joined;
+    }
+
+    // Moves the slots of a run of subtrees at shift towards the front,
+    // so there are at most two more subtrees than the slots need, which
+    // bounds how far relaxed lookups have to search. Subtrees that
+    // don't need to change are kept as they are.
+    static void rebalance(edit_type edit, uint32_t shift,
+            std::vector<node_ptr>& subs)
+    {
+        constexpr std::size_t extras = 2;
+
+        std::vector<uint32_t> plan;
+        std::size_t total = 0;
+        for (const auto& sub : subs) {
+            plan.push_back(sub->size());
+            total += sub->size();
+        }
+
+        auto optimal = (total + vector_width - 1) / vector_width;
+        if (plan.size() <= optimal + extras) {
+            return;
+        }
+
+        // spread the first short subtree's slots over those after it,
+        // until it's gone, and repeat
+        std::size_t i = 0;
+        while (plan.size() > optimal + extras) {
+            while (plan[i] >= vector_width - extras / 2) {
+                i++;
+            }
+
+            uint32_t remaining = plan[i];
+            while (remaining > 0) {
+                auto size = std::min(remaining + plan[i + 1], vector_width);
+                remaining = remaining + plan[i + 1] - size;
+                plan[i] = size;
+                i++;
+            }
+            plan.erase(plan.begin() + i);
+            i = i > 0 ? i - 1 : 0;
+        }
+
+        // fill the new subtrees from the old ones' slots, in order
+        std::vector<node_ptr> rebuilt;
+        std::size_t from = 0;
+        uint32_t offset = 0;
+        for (auto size : plan) {
+            if (offset == 0 && subs[from]->size() == size) {
+                rebuilt.push_back(subs[from++]);
+                continue;
+            }
+
+            // the next slot to move
+            auto next = [&] {
+                std::pair<std::size_t, uint32_t> at{from, offset};
+                if (++offset == subs[from]->size()) {
+                    from++;
+                    offset = 0;
+                }
+                return at;
+            };
+
+            if (shift == 0) {
+                auto leaf = node_type::leaf(edit);
+                while (leaf->size() < size) {
+                    auto [src, idx] = next();
+                    leaf->push(subs[src]->values()[idx]);
+                }
+                rebuilt.push_back(std::move(leaf));
+            } else {
+                std::array<node_ptr, vector_width> kids;
+                for (uint32_t k = 0; k < size; k++) {
+                    auto [src, idx] = next();
+                    kids[k] = subs[src]->children()[idx];
+                }
+                rebuilt.push_back(makeBranch(edit, shift, kids.data(),
+                        kids.data() + size));
+            }
+        }
+        subs = std::move(rebuilt);
+    }
+
+    // drops levels holding a single subtree from the top
+    void shrink()
+    {
+        if (!root) {
+            shift = vector_bits;
+            return;
+        }
+        while (shift > vector_bits && root->size() == 1) {
+            root = root->children()[0];
+            shift -= vector_bits;
+        }
+    }
+};
+
+// Random access iterator over a vector, walking a leaf at a time
+template <class T, class Policy>
+class vector_iterator
+{
+    using trie_type = vector_trie<T, Policy>;
+
+public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T*;
+    using reference = const T&;
+
+    vector_iterator() = default;
+
+    vector_iterator(const trie_type* trie, std::size_t index) noexcept :
+        trie(trie),
+        index(index)
+    {
+        load();
+    }
+
+    reference operator*() const noexcept { return *cur; }
+    pointer operator->() const noexcept { return cur; }
+    reference operator[](difference_type n) const noexcept
+    {
+        return trie->get(index + n);
+    }
+
+    vector_iterator& operator++() noexcept
+    {
+        index++;
+        if (++cur == leafEnd) {
+            load();
+        }
+        return *this;
+    }
+
+    vector_iterator operator++(int) noexcept
+    {
+        auto it = *this;
+        ++*this;
+        return it;
+    }
+
+    vector_iterator& operator--() noexcept
+    {
+        index--;
+        if (cur == leafBegin) {
+            load();
+        } else {
+            --cur;
+        }
+        return *this;
+    }
+
+    vector_iterator operator--(int) noexcept
+    {
+        auto it = *this;
+        --*this;
+        return it;
+    }
+
+    vector_iterator& operator+=(difference_type n) noexcept
+    {
+        index += n;
+        load();
+        return *this;
+    }
+
+    vector_iterator& operator-=(difference_type n) noexcept
+    {
+        return *this += -n;
+    }
+
+    friend vector_iterator operator+(vector_iterator it,
+            difference_type n) noexcept
+    {
+        return it += n;
+    }
+
+    friend vector_iterator operator+(difference_type n,
+            vector_iterator it) noexcept
+    {
+        return it += n;
+    }
+
+    friend vector_iterator operator-(vector_iterator it,
+            difference_type n) noexcept
+    {
+        return it -= n;
+    }
+
+    friend difference_type operator-(const vector_iterator& a,
+            const vector_iterator& b) noexcept
+    {
+        return difference_type(a.index) - difference_type(b.index);
+    }
+
+    friend bool operator==(const vector_iterator& a,
+            const vector_iterator& b) noexcept
+    {
+        return a.index == b.index;
+    }
+
+    friend bool operator!=(const vector_iterator& a,
+            const vector_iterator& b) noexcept
+    {
+        return a.index != b.index;
+    }
+
+    friend bool operator<(const vector_iterator& a,
+            const vector_iterator& b) noexcept
+    {
+        return a.index < b.index;
+    }
+
+    friend bool operator>(const vector_iterator& a,
+            const vector_iterator& b) noexcept
+    {
+        return b < a;
+    }
+
+    friend bool operator<=(const vector_iterator& a,
+            const vector_iterator& b) noexcept
+    {
+        return !(b < a);
+    }
+
+    friend bool operator>=(const vector_iterator& a,
+            const vector_iterator& b) noexcept
+    {
+        return !(a < b);
+    }
+
+private:
+    // finds the leaf holding index
+    void load() noexcept
+    {
+        if (!trie || index >= trie->count) {
+            cur = leafBegin = leafEnd = nullptr;
+            return;
+        }
+
+        auto i = index;
+        auto leaf = trie->leafFor(i);
+        leafBegin = leaf->values();
+        leafEnd = leafBegin + leaf->size();
+        cur = leafBegin + i;
+    }
+
+    const trie_type* trie = nullptr;
+    std::size_t index = 0;
+    const T* cur = nullptr;
+    const T* leafBegin = nullptr;
+    const T* leafEnd = nullptr;
+};
+
+} // namespace rw::pdata::detail
+
+#endif // RW_PDATA_VECTOR_DETAIL_H
@@ -0,0 +1,285 @@
+#ifndef RW_PDATA_VECTOR_H
+#define RW_PDATA_VECTOR_H
+
+#include "rw/pdata/policy.h"
+#include "rw/pdata/vector-detail.h"
+
+#include <algorithm>
+#include <initializer_list>
+#include <memory>
+#include <stdexcept>
+
+namespace rw::pdata {
+
+template <class T, class Policy>
+class persistent_vector;
+
+template <class T, class Policy = shared_policy>
+class transient_vector :
+    public std::enable_shared_from_this<transient_vector<T, Policy>>
+{
+    using trie_type = detail::vector_trie<T, Policy>;
+
+public:
+    using value_type = T;
+
+    std::size_t size() const noexcept { return trie.count; }
+
+    const T& at(std::size_t i) const
+    {
+        ensureEditable();
+        if (i >= trie.count) {
+            throw std::out_of_range("transient_vector index out of range");
+        }
+        return trie.get(i);
+    }
+
+    std::shared_ptr<transient_vector> push_back(T val)
+    {
+        ensureEditable();
+        trie.push_back(edit, std::move(val));
+        return this->shared_from_this();
+    }
+
+    std::shared_ptr<transient_vector> pop_back()
+    {
+        ensureEditable();
+        if (!trie.count) {
+            throw std::out_of_range("pop_back on empty transient_vector");
+        }
+        trie.pop_back(edit);
+        return this->shared_from_this();
+    }
+
+    std::shared_ptr<transient_vector> set(std::size_t i, T val)
+    {
+        ensureEditable();
+        if (i >= trie.count) {
+            throw std::out_of_range("transient_vector index out of range");
+        }
+        trie.set(edit, i, std::move(val));
+        return this->shared_from_this();
+    }
+
+    std::shared_ptr<persistent_vector<T, Policy>> persistent()
+    {
+        ensureEditable();
+
+        // as with transient_map, nodes keep this transient's id, which
+        // no other edit will match
+        edit = 0;
+
+        return persistent_vector<T, Policy>::make(trie);
+    }
+
+private:
+    friend class persistent_vector<T, Policy>;
+
+    explicit transient_vector(trie_type trie) :
+        edit(detail::newEdit()),
+        trie(std::move(trie))
+    {}
+
+    // throws if persistent() has already been called
+    void ensureEditable() const
+    {
+        if (!edit) {
+            throw std::logic_error("transient_vector used after persistent()");
+        }
+    }
+
+    detail::edit_type edit;
+    trie_type trie;
+};
+
+// Immutable sequence, stored as a relaxed radix balanced (RRB) trie of
+// 32 value leaves. Indexing and updates cost O(log32 n), push_back
+// and pop_back are amortized constant as they mostly touch a separate
+// tail leaf, and slicing and concatenation are O(log n), sharing all
+// but the edges of the original tries. Versions share structure, so
+// keeping old ones around is cheap.
+template <class T, class Policy = shared_policy>
+class persistent_vector :
+    public std::enable_shared_from_this<persistent_vector<T, Policy>>
+{
+    using trie_type = detail::vector_trie<T, Policy>;
+
+public:
+    using value_type = T;
+    using const_iterator = detail::vector_iterator<T, Policy>;
+    using iterator = const_iterator;
+
+    persistent_vector() = default;
+
+    template <class InputIt>
+    static std::shared_ptr<persistent_vector> create(InputIt first, InputIt last)
+    {
+        trie_type trie;
+        auto edit = detail::newEdit();
+        for (; first != last; ++first) {
+            trie.push_back(edit, *first);
+        }
+        return make(std::move(trie));
+    }
+
+    static std::shared_ptr<persistent_vector> create(
+            std::initializer_list<T> values)
+    {
+        return create(values.begin(), values.end());
+    }
+
+    std::size_t size() const noexcept { return trie.count; }
+    bool empty() const noexcept { return trie.count == 0; }
+
+    const_iterator begin() const { return const_iterator{&trie, 0}; }
+    const_iterator end() const { return const_iterator{&trie, trie.count}; }
+
+    const T& operator[](std::size_t i) const noexcept { return trie.get(i); }
+
+    const T& at(std::size_t i) const
+    {
+        if (i >= trie.count) {
+            throw std::out_of_range("persistent_vector index out of range");
+        }
+        return trie.get(i);
+    }
+
+    const T& front() const noexcept { return trie.get(0); }
+    const T& back() const noexcept { return trie.get(trie.count - 1); }
+
+    std::shared_ptr<persistent_vector> push_back(T val)
+    {
+        auto next = trie;
+        next.push_back(detail::edit_type{}, std::move(val));
+        return make(std::move(next));
+    }
+
+    std::shared_ptr<persistent_vector> pop_back()
+    {
+        if (!trie.count) {
+            throw std::out_of_range("pop_back on empty persistent_vector");
+        }
+
+        auto next = trie;
+        next.pop_back(detail::edit_type{});
+        return make(std::move(next));
+    }
+
+    // Returns a new persistent_vector with the value at i replaced
+    std::shared_ptr<persistent_vector> set(std::size_t i, T val)
+    {
+        if (i >= trie.count) {
+            throw std::out_of_range("persistent_vector index out of range");
+        }
+
+        auto next = trie;
+        next.set(detail::edit_type{}, i, std::move(val));
+        return make(std::move(next));
+    }
+
+    // the first n values
+    std::shared_ptr<persistent_vector> take(std::size_t n)
+    {
+        if (n >= trie.count) {
+            return this->shared_from_this();
+        }
+
+        auto next = trie;
+        next.take(detail::edit_type{}, n);
+        return make(std::move(next));
+    }
+
+    // all but the first n values
+    std::shared_ptr<persistent_vector> drop(std::size_t n)
+    {
+        if (n == 0) {
+            return this->shared_from_this();
+        }
+
+        auto next = trie;
+        next.drop(detail::edit_type{}, n);
+        return make(std::move(next));
+    }
+
+    // the values from first up to last
+    std::shared_ptr<persistent_vector> slice(std::size_t first,
+            std::size_t last)
+    {
+        last = std::min(last, trie.count);
+        if (first >= last) {
+            return make(trie_type{});
+        } else if (first == 0 && last == trie.count) {
+            return this->shared_from_this();
+        }
+
+        auto next = trie;
+        next.take(detail::edit_type{}, last);
+        next.drop(detail::edit_type{}, first);
+        return make(std::move(next));
+    }
+
+    // Returns this vector's values followed by other's. Only the nodes
+    // along the seam are rebuilt, and rebalanced so lookups stay fast.
+    std::shared_ptr<persistent_vector> concat(const persistent_vector& other)
+    {
+        if (other.empty()) {
+            return this->shared_from_this();
+        }
+
+        auto next = trie;
+        next.concat(detail::newEdit(), other.trie);
+        return make(std::move(next));
+    }
+
+    friend bool operator==(const persistent_vector& a,
+            const persistent_vector& b)
+    {
+        return a.size() == b.size() &&
+               std::equal(a.begin(), a.end(), b.begin());
+    }
+
+    friend bool operator!=(const persistent_vector& a,
+            const persistent_vector& b)
+    {
+        return !(a == b);
+    }
+
+    std::shared_ptr<transient_vector<T, Policy>> transient() const
+    {
+        // struct to allow creation using make_shared and a private ctor
+        struct tv_maker : public transient_vector<T, Policy>
+        {
+            explicit tv_maker(trie_type trie) :
+                transient_vector<T, Policy>(std::move(trie))
+            {}
+        };
+
+        return std::make_shared<tv_maker>(trie);
+    }
+
+private:
+    friend class transient_vector<T, Policy>;
+
+    explicit persistent_vector(trie_type trie) :
+        trie(std::move(trie))
+    {}
+
+    static std::shared_ptr<persistent_vector> make(trie_type trie)
+    {
+        // struct to allow creation using make_shared and a private ctor
+        struct pv_maker : public persistent_vector
+        {
+            explicit pv_maker(trie_type trie) :
+                persistent_vector(std::move(trie))
+            {}
+        };
+
+        return std::make_shared<pv_maker>(std::move(trie));
+    }
+
+    trie_type trie;
+};
+
+} // namespace rw::pdata
+
+#endif // RW_PDATA_VECTOR_H
@@ -1,11 +1,12 @@
 #include "fmt/chrono.h"
 #include "fmt/core.h"
 #include "rw/logging.h"
+#include "rw/pdata/atom.h"
+#include "rw/pdata/map.h"
 
 #include <ctime>
 #include <string_view>
 #include <unistd.h>
-#include <unordered_map>
 
 using namespace std::literals;
 
@@ -35,14 +36,18 @@ struct fmt::formatter<std::shared_ptr<rw::logging::Logger>>
 // this. -1 not initialized, 0 no color, 1 use color
 static int g_is_color = -1;
 
-static std::unordered_map<std::string, std::shared_ptr<rw::logging::Logger>> g_loggers;
-/* todo: benchmark
-// global logger map
-// todo: when switched to c++20, use std:atomic<std::shared_ptr<...>>
-static std::shared_ptr<
-        rw::pdata::persistent_map<std::string, std::shared_ptr<logging::Logger>>>
-        g_loggers;
-*/
+// global logger map; lookups don't lock, and adding a logger swaps
+// in a new version of the map
+using logger_map = rw::pdata::persistent_map<std::string,
+        std::shared_ptr<rw::logging::Logger>, rw::pdata::string_hash>;
+
+static rw::pdata::atom<logger_map>& loggers()
+{
+    // never destroyed, so loggers can be looked up during static
+    // destruction
+    static auto loggers = new rw::pdata::atom<logger_map>;
+    return *loggers;
+}
 
 constexpr std::array level_names{
         "TRACE"sv,
@@ -66,57 +71,20 @@ namespace rw::logging {
 
 std::shared_ptr<Logger> get(std::string_view name)
 {
-    // todo: allocating a string here feels like a hack
-    std::string sname{name};
-    auto found = g_loggers.find(sname);
-    if (found != g_loggers.end())
-        return found->second;
-    else {
-        auto logger = std::make_shared<logging::Logger>(sname);
-        g_loggers[sname] = logger;
-        return logger;
+    auto current = loggers().load();
+    if (auto found = current->find_ptr(name)) {
+        return *found;
     }
-}
 
-/* todo: benchmark
-std::shared_ptr<logging::Logger> logging::get(std::string_view name)
-{
-    auto loggers = std::atomic_load(&g_loggers);
-    if (!loggers) {
-        // make a new one
-        loggers = std::make_shared<decltype(g_loggers)::element_type>();
-
-        decltype(g_loggers) target{}; // replace if empty
-        if (!std::atomic_compare_exchange_strong(&g_loggers, &target, loggers)) {
-            // somebody beat us to it.
-            loggers = target;
-        }
-    }
-
-    // todo: allocating a string here feels like a hack
+    // another thread may add the same logger while we're making ours;
+    // if so, use theirs
     std::string sname{name};
-    for (;;) {
-        // if it already exists in loggers, return it
-        auto logger = loggers->find(sname);
-        if (logger) {
-            return logger.value();
-        } else {
-            // otherwise, make a new one
-            auto logger = std::make_shared<logging::Logger>(name);
-
-            // try to replace the old map with a new one containing
-            // the new logger
-            if (std::atomic_compare_exchange_weak(&g_loggers, &loggers,
-                        loggers->assoc(sname, logger))) {
-                // succeeded, we can return our new logger
-                return logger;
-            }
-            // no luck, but loggers is now the current value of g_loggers,
-            // so go around again
-        }
-    }
+    auto logger = std::make_shared<logging::Logger>(sname);
+    auto updated = loggers().swap([&](const std::shared_ptr<logger_map>& m) {
+        return m->contains(name) ? m : m->assoc(sname, logger);
+    });
+    return *updated->find_ptr(name);
 }
-*/
 
 std::shared_ptr<Logger>dbg()
 {
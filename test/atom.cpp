@@ -0,0 +1,116 @@
+#include "doctest.h"
+#include "rw/logging.h"
+#include "rw/pdata/atom.h"
+#include "rw/pdata/map.h"
+
+#include <ostream>
+#include <thread>
+#include <vector>
+
+TEST_SUITE_BEGIN("persistent-data");
+
+// Looks up a logger from a static destructor. It's constructed before
+// any test runs, so before the loggers' atom is first used, and
+// destroyed after anything that use creates.
+struct static_logger_user
+{
+    ~static_logger_user() { rw::logging::get("atom-static-destruction"); }
+};
+static static_logger_user staticLoggerUser;
+
+using int_map = rw::pdata::persistent_map<uint64_t, uint64_t>;
+
+TEST_CASE("atom load, store, and compare_exchange")
+{
+    rw::pdata::atom<int_map> a;
+    auto m0 = a.load();
+    REQUIRE(m0->size() == 0);
+
+    auto m1 = m0->assoc(1, 2);
+    a.store(m1);
+    REQUIRE(a.load() == m1);
+
+    // fails, and reports the current version
+    auto expected = m0;
+    REQUIRE(!a.compare_exchange(expected, m0->assoc(3, 4)));
+    REQUIRE(expected == m1);
+
+    REQUIRE(a.compare_exchange(expected, m1->assoc(3, 4)));
+    REQUIRE(a.load()->find(3) == 4);
+    REQUIRE(a.load()->find(1) == 2);
+
+    // the old version is still usable
+    REQUIRE(!m1->find(3));
+}
+
+TEST_CASE("atom swap from many threads")
+{
+    rw::pdata::atom<int_map> a;
+
+    constexpr int threads = 4;
+    constexpr int per_thread = 500;
+
+    // checked once the threads are joined, as a failed REQUIRE can't
+    // be reported from another thread
+    std::vector<int> misses(threads);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            for (int i = 0; i < per_thread; i++) {
+                // every write lands, however they interleave
+                uint64_t key = t * per_thread + i;
+                a.swap([&](const std::shared_ptr<int_map>& m) {
+                    return m->assoc(key, key * 2);
+                });
+
+                // readers see a complete version
+                auto m = a.load();
+                if (m->find(key) != key * 2) {
+                    misses[t]++;
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    for (auto missed : misses) {
+        REQUIRE(missed == 0);
+    }
+
+    auto m = a.load();
+    REQUIRE(m->size() == threads * per_thread);
+    for (uint64_t key = 0; key < threads * per_thread; key++) {
+        REQUIRE(m->find(key) == key * 2);
+    }
+
+    // an unchanged result doesn't replace the version
+    REQUIRE(a.swap([](const std::shared_ptr<int_map>& m) { return m; }) == m);
+    REQUIRE(a.load() == m);
+}
+
+TEST_CASE("loggers are shared between threads")
+{
+    std::vector<std::shared_ptr<rw::logging::Logger>> loggers(4);
+    std::vector<std::thread> workers;
+    for (std::size_t t = 0; t < loggers.size(); t++) {
+        workers.emplace_back([&, t] {
+            loggers[t] = rw::logging::get("atom-test");
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    for (const auto& logger : loggers) {
+        REQUIRE(logger == rw::logging::get("atom-test"));
+    }
+}
+
+TEST_CASE("loggers during static destruction")
+{
+    // staticLoggerUser looks it up again once the tests are done
+    REQUIRE(rw::logging::get("atom-static-destruction"));
+}
+
+TEST_SUITE_END();
@@ -3,7 +3,17 @@
 #include "rw/pdata/map.h"
 #include "fmt/format.h"
 
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <numeric>
 #include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 // todo: rename node_count to something different,
 // and note that it's intended to ease debugging
@@ -22,7 +32,7 @@ TEST_CASE("bitmap_indexed_node overflows to array node")
     using bin_node = rw::pdata::detail::bitmap_indexed_node<MockHashable, MockHashable, MockHashableHash>;
     using arr_node = rw::pdata::detail::array_node<MockHashable, MockHashable, MockHashableHash>;
 
-    std::shared_ptr<base_node> node = std::make_shared<bin_node>(rw::pdata::detail::edit_type{});
+    base_node::node_ptr node = rw::pdata::detail::make_node<bin_node>(rw::pdata::detail::edit_type{});
     // fill 16 items in (0-16)
     for (int i = 0; i < 16; i++) {
         auto a = MockHashable{uint32_t(i), i};
@@ -36,7 +46,7 @@ TEST_CASE("bitmap_indexed_node overflows to array node")
         REQUIRE(addedLeaf);
 
         // make sure it's still a bitmap_indexed_node
-        auto n = std::dynamic_pointer_cast<bin_node>(node);
+        auto n = rw::pdata::detail::dynamic_pointer_cast<bin_node>(node);
         REQUIRE(n);
         REQUIRE(n->node_count() == i + 1);
     }
@@ -55,7 +65,7 @@ TEST_CASE("bitmap_indexed_node overflows to array node")
         REQUIRE(addedLeaf);
 
         // make sure it's now an array_node
-        auto n = std::dynamic_pointer_cast<arr_node>(node);
+        auto n = rw::pdata::detail::dynamic_pointer_cast<arr_node>(node);
         REQUIRE(n);
         REQUIRE(n->node_count() == i + 1);
 
@@ -83,7 +93,7 @@ TEST_CASE("bitmap_indexed_node collide")
     using base_node = rw::pdata::detail::node<MockHashable, MockHashable, MockHashableHash>;
     using bin_node = rw::pdata::detail::bitmap_indexed_node<MockHashable, MockHashable, MockHashableHash>;
 
-    std::shared_ptr<base_node> node = std::make_shared<bin_node>(rw::pdata::detail::edit_type{});
+    base_node::node_ptr node = rw::pdata::detail::make_node<bin_node>(rw::pdata::detail::edit_type{});
 
     // add two different items with same hash value
     auto a = MockHashable{uint32_t(22892882), 3847823};
@@ -99,7 +109,7 @@ TEST_CASE("bitmap_indexed_node collide")
     REQUIRE(addedLeaf);
 
     // make sure it's still a bitmap_indexed_node
-    auto n = std::dynamic_pointer_cast<bin_node>(node);
+    auto n = rw::pdata::detail::dynamic_pointer_cast<bin_node>(node);
     REQUIRE(n);
 
     // we expect the bitmap_indexed_node to contain only a single child
@@ -295,6 +305,878 @@ TEST_CASE("transient_map without")
     REQUIRE(m2->find(k2) == 3);
 }
 
+TEST_CASE("transient_map used after persistent")
+{
+    auto pairs = randomPairs<uint64_t>(100);
+    auto t = std::make_shared<rw::pdata::persistent_map<uint64_t, uint64_t>>()
+                     ->transient();
+    for (const auto& [key, val] : pairs) {
+        t->assoc(key, val);
+    }
+    auto m = t->persistent();
+
+    REQUIRE_THROWS_AS(t->assoc(1, 2), std::logic_error);
+    REQUIRE_THROWS_AS(t->without(pairs[0].first), std::logic_error);
+    REQUIRE_THROWS_AS(t->find(pairs[0].first), std::logic_error);
+    REQUIRE_THROWS_AS(t->begin(), std::logic_error);
+    REQUIRE_THROWS_AS(t->persistent(), std::logic_error);
+
+    // a new transient from the result doesn't share the old one's
+    // edit, so it copies rather than changing m
+    auto t2 = m->transient();
+    for (const auto& [key, val] : pairs) {
+        t2->assoc(key, val + 1);
+    }
+    REQUIRE(check(m, pairs));
+}
+
+TEST_CASE("persistent_map equality")
+{
+    auto pairs = randomPairs<uint64_t>(1000);
+    auto reversed = decltype(pairs)(pairs.rbegin(), pairs.rend());
+
+    auto m1 = fillPersistent(
+            std::make_shared<rw::pdata::persistent_map<uint64_t, uint64_t>>(),
+            pairs);
+    auto m2 = fillTransient(
+            std::make_shared<rw::pdata::persistent_map<uint64_t, uint64_t>>(),
+            reversed);
+    REQUIRE(*m1 == *m2);
+
+    // same keys, one different value
+    auto m3 = m2->assoc(pairs[10].first, pairs[10].second + 1);
+    REQUIRE(*m1 != *m3);
+
+    // same size, one different key
+    auto m4 = m1->without(pairs[10].first)->assoc(pairs[10].first + 1, 3);
+    REQUIRE(m4->size() == m1->size());
+    REQUIRE(*m1 != *m4);
+}
+
+TEST_CASE("champ_map is canonical after without")
+{
+    using map_type = rw::pdata::champ_map<uint64_t, uint64_t>;
+
+    auto pairs = randomPairs<uint64_t>(5000);
+    auto half = decltype(pairs)(pairs.begin(), pairs.begin() + 2500);
+
+    auto m1 = fillTransient(std::make_shared<map_type>(), half);
+
+    // add everything, then take the second half back out
+    auto m2 = fillPersistent(std::make_shared<map_type>(), pairs);
+    auto t = m2->transient();
+    for (std::size_t i = 2500; i < pairs.size(); i++) {
+        t->without(pairs[i].first);
+    }
+    m2 = t->persistent();
+
+    REQUIRE(m2->size() == 2500);
+    REQUIRE(*m1 == *m2);
+    REQUIRE(m1->dump(0) == m2->dump(0));
+}
+
+TEST_CASE("champ_map collisions collapse")
+{
+    using map_type = rw::pdata::champ_map<MockHashable, int, MockHashableHash>;
+
+    // a and b collide; c shares the first level with them
+    auto a = MockHashable{uint32_t(22892882), 1};
+    auto b = MockHashable{uint32_t(22892882), 2};
+    auto c = MockHashable{uint32_t(22892882) ^ (1 << 10), 3};
+
+    auto m1 = std::make_shared<map_type>()->assoc(a, 1)->assoc(b, 2);
+    auto m2 = m1->assoc(c, 3)->without(c);
+    REQUIRE(*m1 == *m2);
+    REQUIRE(m1->dump(0) == m2->dump(0));
+
+    // removing one of a pair leaves a plain value
+    auto m3 = std::make_shared<map_type>()->assoc(a, 1);
+    auto m4 = m1->without(b);
+    REQUIRE(*m3 == *m4);
+    REQUIRE(m3->dump(0) == m4->dump(0));
+}
+
+TEST_CASE("hash_collision_node with many collisions")
+{
+    using map_type = rw::pdata::persistent_map<MockHashable, int, MockHashableHash>;
+
+    // more keys than fingerprints, all with one hash
+    std::vector<MockHashable> keys;
+    for (int i = 0; i < 600; i++) {
+        keys.push_back({uint32_t(0xbad), i});
+    }
+
+    auto m = std::make_shared<map_type>();
+    for (int i = 0; i < 600; i += 2) {
+        m = m->assoc(keys[i], i);
+    }
+    auto t = m->transient();
+    for (int i = 1; i < 600; i += 2) {
+        t->assoc(keys[i], i);
+    }
+    auto full = t->persistent();
+
+    REQUIRE(m->size() == 300);
+    REQUIRE(full->size() == 600);
+    for (int i = 0; i < 600; i++) {
+        REQUIRE(full->find(keys[i]) == i);
+        REQUIRE(bool(m->find(keys[i])) == (i % 2 == 0));
+    }
+    REQUIRE(!full->find(MockHashable{uint32_t(0xbad), 600}));
+
+    // remove from the middle, persistently and in place
+    auto fewer = full;
+    for (int i = 0; i < 600; i += 3) {
+        fewer = fewer->without(keys[i]);
+    }
+    auto t2 = full->transient();
+    for (int i = 0; i < 600; i += 3) {
+        t2->without(keys[i]);
+    }
+    auto fewer2 = t2->persistent();
+
+    REQUIRE(fewer->size() == 400);
+    REQUIRE(*fewer == *fewer2);
+    for (int i = 0; i < 600; i++) {
+        REQUIRE(bool(fewer->find(keys[i])) == (i % 3 != 0));
+        REQUIRE(bool(fewer2->find(keys[i])) == (i % 3 != 0));
+    }
+    REQUIRE(full->size() == 600);
+}
+
+TEST_CASE("persistent_map iteration")
+{
+    std::vector counts{0, 5, 100, 1000, 10000};
+
+    for (auto count : counts) {
+        auto pairs = randomPairs<uint64_t>(count);
+        std::unordered_map<uint64_t, uint64_t> expected(pairs.begin(), pairs.end());
+
+        auto m = fillTransient(
+                std::make_shared<rw::pdata::persistent_map<uint64_t, uint64_t>>(),
+                pairs);
+
+        std::size_t seen = 0;
+        for (const auto& [key, val] : *m) {
+            REQUIRE(expected.at(key) == val);
+            seen++;
+        }
+        REQUIRE(seen == m->size());
+        REQUIRE(seen == expected.size());
+    }
+}
+
+TEST_CASE("transient_map iteration with collisions")
+{
+    auto t = std::make_shared<rw::pdata::transient_map<MockHashable, int, MockHashableHash>>();
+
+    // 300 values spread over 7 hashes, so most live in collision nodes
+    for (int i = 0; i < 300; i++) {
+        t->assoc(MockHashable{uint32_t(i % 7) << 3, i}, i);
+    }
+    t->without(MockHashable{0, 0});
+
+    std::vector<bool> seen(300);
+    for (auto it = t->begin(); it != t->end(); ++it) {
+        REQUIRE(it->first.val == it->second);
+        REQUIRE(!seen[it->second]);
+        seen[it->second] = true;
+    }
+    REQUIRE(std::count(seen.begin(), seen.end(), true) == 299);
+    REQUIRE(!seen[0]);
+}
+
+TEST_CASE("persistent_map create")
+{
+    using map_type = rw::pdata::persistent_map<uint64_t, uint64_t>;
+
+    // later values for a key replace earlier ones
+    auto pairs = randomPairs<uint64_t>(10000);
+    auto dupPairs = randomDupPairs(pairs);
+    auto all = pairs;
+    all.insert(all.end(), dupPairs.begin(), dupPairs.end());
+
+    auto m1 = map_type::create(all.begin(), all.end());
+    auto m2 = fillTransient(std::make_shared<map_type>(), all);
+    REQUIRE(m1->size() == m2->size());
+    REQUIRE(check(m1, dupPairs));
+    REQUIRE(*m1 == *m2);
+
+    // the result is an ordinary map
+    auto m3 = m1->assoc(pairs[0].first, 1)->without(pairs[1].first);
+    REQUIRE(m3->find(pairs[0].first) == 1);
+    REQUIRE(!m3->find(pairs[1].first));
+
+    REQUIRE(map_type::create({})->size() == 0);
+    REQUIRE(map_type::create({{1, 2}, {3, 4}, {1, 5}})->find(1) == 5);
+
+    // a canonical map has the same trie however it was built
+    using champ_type = rw::pdata::champ_map<uint64_t, uint64_t>;
+    auto c1 = champ_type::create(all.begin(), all.end());
+    auto c2 = fillTransient(std::make_shared<champ_type>(), all);
+    REQUIRE(c1->dump(0) == c2->dump(0));
+}
+
+TEST_CASE("persistent_map create with collisions")
+{
+    using map_type = rw::pdata::persistent_map<MockHashable, int, MockHashableHash>;
+
+    // 300 values over 7 hashes, each key given twice
+    std::vector<std::pair<MockHashable, int>> pairs;
+    for (int i = 0; i < 600; i++) {
+        auto key = i % 300;
+        pairs.push_back({MockHashable{uint32_t(key % 7) << 3, key}, i});
+    }
+
+    auto t = std::make_shared<map_type>()->transient();
+    for (const auto& [key, val] : pairs) {
+        t->assoc(key, val);
+    }
+    auto m2 = t->persistent();
+
+    auto m1 = map_type::create(pairs.begin(), pairs.end());
+    REQUIRE(m1->size() == 300);
+    REQUIRE(*m1 == *m2);
+    REQUIRE(m1->find(MockHashable{0, 0}) == 300);
+}
+
+TEST_CASE("persistent_map create_parallel")
+{
+    auto pairs = randomPairs<uint64_t>(100000);
+    auto dupPairs = randomDupPairs(pairs);
+    auto all = pairs;
+    all.insert(all.end(), dupPairs.begin(), dupPairs.end());
+
+    using map_type = rw::pdata::persistent_map<uint64_t, uint64_t>;
+    auto m1 = map_type::create_parallel(all.begin(), all.end(), 4);
+    auto m2 = map_type::create(all.begin(), all.end());
+    REQUIRE(m1->size() == m2->size());
+    REQUIRE(check(m1, dupPairs));
+    REQUIRE(*m1 == *m2);
+
+    using champ_type = rw::pdata::champ_map<uint64_t, uint64_t>;
+    auto c1 = champ_type::create_parallel(all.begin(), all.end(), 4);
+    auto c2 = champ_type::create(all.begin(), all.end());
+    REQUIRE(c1->dump(0) == c2->dump(0));
+
+    // colliding keys, each given twice
+    using mock_type = rw::pdata::persistent_map<MockHashable, int, MockHashableHash>;
+    std::vector<std::pair<MockHashable, int>> mocks;
+    for (int i = 0; i < 100000; i++) {
+        auto key = i % 50000;
+        mocks.push_back({MockHashable{uint32_t(key % 1000) * 0x2345u, key}, i});
+    }
+    auto m3 = mock_type::create_parallel(mocks.begin(), mocks.end(), 4);
+    REQUIRE(m3->size() == 50000);
+    REQUIRE(*m3 == *mock_type::create(mocks.begin(), mocks.end()));
+    REQUIRE(m3->find(MockHashable{0, 0}) == 50000);
+}
+
+TEST_CASE("persistent_map reduce")
+{
+    using map_type = rw::pdata::persistent_map<uint64_t, uint64_t>;
+
+    auto sum = [](uint64_t acc, uint64_t, uint64_t val) { return acc + val; };
+    auto plus = [](uint64_t a, uint64_t b) { return a + b; };
+
+    auto empty = std::make_shared<map_type>();
+    REQUIRE(empty->reduce(uint64_t{7}, sum) == 7);
+    REQUIRE(empty->parallel_reduce(uint64_t{0}, sum, plus, 4) == 0);
+
+    auto pairs = randomPairs<uint64_t>(100000);
+    auto m = map_type::create(pairs.begin(), pairs.end());
+
+    uint64_t expected = 0;
+    for (const auto& [key, val] : *m) {
+        expected += val;
+    }
+    REQUIRE(m->reduce(uint64_t{0}, sum) == expected);
+    REQUIRE(m->parallel_reduce(uint64_t{0}, sum, plus, 4) == expected);
+    REQUIRE(m->parallel_reduce(uint64_t{0}, sum, plus, 1) == expected);
+
+    // both fold in iteration order
+    using keys_type = std::vector<uint64_t>;
+    auto push = [](keys_type acc, uint64_t key, uint64_t) {
+        acc.push_back(key);
+        return acc;
+    };
+    auto append = [](keys_type a, keys_type b) {
+        a.insert(a.end(), b.begin(), b.end());
+        return a;
+    };
+
+    keys_type keys;
+    for (const auto& [key, val] : *m) {
+        keys.push_back(key);
+    }
+    REQUIRE(m->reduce(keys_type{}, push) == keys);
+    REQUIRE(m->parallel_reduce(keys_type{}, push, append, 4) == keys);
+
+    // colliding keys
+    using mock_type = rw::pdata::persistent_map<MockHashable, int, MockHashableHash>;
+    std::vector<std::pair<MockHashable, int>> mocks;
+    for (int i = 0; i < 50000; i++) {
+        mocks.push_back({MockHashable{uint32_t(i % 1000) * 0x2345u, i}, 1});
+    }
+    auto m2 = mock_type::create(mocks.begin(), mocks.end());
+    auto count = [](int acc, const MockHashable&, int val) { return acc + val; };
+    REQUIRE(m2->reduce(0, count) == 50000);
+    REQUIRE(m2->parallel_reduce(0, count, std::plus<int>{}, 4) == 50000);
+}
+
+TEST_CASE("persistent_map merge")
+{
+    using map_type = rw::pdata::persistent_map<uint64_t, uint64_t>;
+
+    auto pairs = randomPairs<uint64_t>(10000);
+    auto defaults = map_type::create(pairs.begin(), pairs.end());
+
+    // overrides made from the defaults share most of their nodes
+    auto overrides = defaults;
+    for (int i = 0; i < 100; i++) {
+        overrides = overrides->assoc(pairs[i * 7].first, i);
+    }
+    overrides = overrides->assoc(1, 2)->assoc(3, 4);
+
+    auto merged = defaults->merge(overrides);
+    REQUIRE(merged->size() == defaults->size() + 2);
+    REQUIRE(*merged == *overrides);
+
+    // nothing to do
+    REQUIRE(merged->merge(defaults, [](auto mine, auto) { return mine; }) == merged);
+    REQUIRE(defaults->merge(defaults) == defaults);
+    REQUIRE(std::make_shared<map_type>()->merge(defaults) == defaults);
+
+    // unrelated maps, summing values of shared keys (resolve is only
+    // called when the values differ)
+    std::vector<std::pair<uint64_t, uint64_t>> other;
+    for (uint64_t i = 0; i < 2000; i++) {
+        auto key = i < 500 ? pairs[i].first : pairs[i].first * 31 + 7;
+        other.push_back({key, i});
+    }
+    auto m1 = map_type::create(other.begin(), other.end());
+    auto m2 = defaults->merge(m1, [](auto mine, auto theirs) { return mine + theirs; });
+
+    std::unordered_map<uint64_t, uint64_t> expected(pairs.begin(), pairs.end());
+    for (auto [key, val] : other) {
+        expected[key] += val;
+    }
+    REQUIRE(m2->size() == expected.size());
+    for (auto [key, val] : expected) {
+        REQUIRE(m2->find(key) == val);
+    }
+
+    // merging a canonical map gives the same trie as building it
+    using champ_type = rw::pdata::champ_map<uint64_t, uint64_t>;
+    auto c1 = champ_type::create(pairs.begin(), pairs.end());
+    auto c2 = champ_type::create(other.begin(), other.end());
+    auto c3 = c1->merge(c2);
+    auto all = pairs;
+    all.insert(all.end(), other.begin(), other.end());
+    REQUIRE(c3->dump(0) == champ_type::create(all.begin(), all.end())->dump(0));
+}
+
+TEST_CASE("persistent_map merge with collisions")
+{
+    using map_type = rw::pdata::persistent_map<MockHashable, int, MockHashableHash>;
+
+    std::vector<std::pair<MockHashable, int>> pairs1;
+    std::vector<std::pair<MockHashable, int>> pairs2;
+    for (int i = 0; i < 300; i++) {
+        auto key = MockHashable{uint32_t(i % 13) * 0x421u, i};
+        if (i % 3 != 0) {
+            pairs1.push_back({key, i});
+        }
+        if (i % 2 != 0) {
+            pairs2.push_back({key, -i});
+        }
+    }
+
+    auto m1 = map_type::create(pairs1.begin(), pairs1.end());
+    auto m2 = map_type::create(pairs2.begin(), pairs2.end());
+    auto merged = m1->merge(m2, [](int mine, int) { return mine; });
+
+    REQUIRE(merged->size() == 250);
+    for (int i = 0; i < 300; i++) {
+        auto val = merged->find(MockHashable{uint32_t(i % 13) * 0x421u, i});
+        if (i % 6 == 3) {
+            REQUIRE(val == -i);
+        } else if (i % 6 != 0) {
+            REQUIRE(val == i);
+        } else {
+            REQUIRE(!val);
+        }
+    }
+}
+
+TEST_CASE("persistent_map assoc_many and without_many")
+{
+    using map_type = rw::pdata::persistent_map<uint64_t, uint64_t>;
+
+    auto pairs = randomPairs<uint64_t>(20000);
+    auto half = decltype(pairs)(pairs.begin(), pairs.begin() + 10000);
+    auto m1 = map_type::create(half.begin(), half.end());
+    auto dump1 = m1->dump(0);
+
+    // new keys and replacements, with later values winning
+    auto updates = decltype(pairs)(pairs.begin() + 5000, pairs.end());
+    auto dupPairs = randomDupPairs(updates);
+    updates.insert(updates.end(), dupPairs.begin(), dupPairs.end());
+
+    auto m2 = m1->assoc_many(updates.begin(), updates.end());
+    REQUIRE(*m2 == *fillPersistent(m1, updates));
+    REQUIRE(m2->size() == 20000);
+    REQUIRE(m1->dump(0) == dump1);
+
+    std::vector<uint64_t> keys;
+    for (std::size_t i = 0; i < pairs.size(); i += 2) {
+        keys.push_back(pairs[i].first);
+    }
+    auto m3 = m2->without_many(keys.begin(), keys.end());
+    REQUIRE(m3->size() == 10000);
+    for (std::size_t i = 0; i < pairs.size(); i++) {
+        REQUIRE(bool(m3->find(pairs[i].first)) == (i % 2 == 1));
+    }
+    REQUIRE(m2->size() == 20000);
+
+    // nothing changes
+    REQUIRE(m1->assoc_many(half.begin(), half.end()) == m1);
+    REQUIRE(m3->without_many(keys.begin(), keys.end()) == m3);
+
+    // everything goes
+    auto all = std::vector<uint64_t>{};
+    for (const auto& [key, val] : *m3) {
+        all.push_back(key);
+    }
+    auto m4 = m3->without_many(all.begin(), all.end());
+    REQUIRE(m4->size() == 0);
+    REQUIRE(*m4 == map_type{});
+}
+
+// records a diff as a map of key -> (old, new), with -1 for missing
+template <class K>
+struct DiffRecorder
+{
+    void added(const K& key, int val) { record(key, {-1, val}); }
+    void removed(const K& key, int val) { record(key, {val, -1}); }
+    void updated(const K& key, int from, int to) { record(key, {from, to}); }
+
+    void record(const K& key, std::pair<int, int> change)
+    {
+        REQUIRE(changes.find(key.val) == changes.end());
+        changes[key.val] = change;
+    }
+
+    std::unordered_map<int, std::pair<int, int>> changes;
+};
+
+template <class Map, class Key>
+void checkDiff(const std::shared_ptr<Map>& from,
+        const std::shared_ptr<Map>& to, const std::vector<Key>& keys)
+{
+    DiffRecorder<Key> recorder;
+    diff(*from, *to, recorder);
+
+    std::size_t expected = 0;
+    for (const auto& key : keys) {
+        auto a = from->find(key).value_or(-1);
+        auto b = to->find(key).value_or(-1);
+        if (a != b) {
+            REQUIRE(recorder.changes.at(key.val) == std::make_pair(a, b));
+            expected++;
+        }
+    }
+    REQUIRE(recorder.changes.size() == expected);
+}
+
+TEST_CASE("persistent_map diff")
+{
+    using map_type = rw::pdata::persistent_map<MockHashable, int, MockHashableHash>;
+
+    std::vector<MockHashable> keys;
+    for (int i = 0; i < 20000; i++) {
+        keys.push_back({uint32_t(i) * 2654435761u, i});
+    }
+
+    auto t = std::make_shared<map_type>()->transient();
+    for (int i = 0; i < 10000; i++) {
+        t->assoc(keys[i], i);
+    }
+    auto m1 = t->persistent();
+
+    // some added, removed, and updated
+    t = m1->transient();
+    for (int i = 0; i < 10000; i += 37) {
+        t->without(keys[i]);
+        t->assoc(keys[i + 1], -i);
+        t->assoc(keys[i + 10000], i);
+    }
+    auto m2 = t->persistent();
+
+    checkDiff(m1, m2, keys);
+    checkDiff(m2, m1, keys);
+    checkDiff(std::make_shared<map_type>(), m1, keys);
+    checkDiff(m1, std::make_shared<map_type>(), keys);
+
+    DiffRecorder<MockHashable> none;
+    rw::pdata::diff(*m1, *m1, none);
+    REQUIRE(none.changes.empty());
+}
+
+TEST_CASE("persistent_map diff with collisions")
+{
+    using map_type = rw::pdata::persistent_map<MockHashable, int, MockHashableHash>;
+
+    std::vector<MockHashable> keys;
+    for (int i = 0; i < 500; i++) {
+        keys.push_back({uint32_t(i % 11) * 0x3001u, i});
+    }
+
+    auto m1 = std::make_shared<map_type>();
+    for (int i = 0; i < 250; i++) {
+        m1 = m1->assoc(keys[i], i);
+    }
+
+    auto m2 = m1;
+    for (int i = 0; i < 500; i += 3) {
+        m2 = i % 2 ? m2->without(keys[i]) : m2->assoc(keys[i], -i);
+    }
+
+    checkDiff(m1, m2, keys);
+    checkDiff(m2, m1, keys);
+}
+
+TEST_CASE("persistent_map with pool_policy")
+{
+    using map_type = rw::pdata::persistent_map<uint64_t, uint64_t,
+            std::hash<uint64_t>, rw::pdata::pool_policy<>>;
+
+    auto pairs = randomPairs<uint64_t>(5000);
+    auto m1 = fillPersistent(std::make_shared<map_type>(), pairs);
+    auto m2 = fillTransient(std::make_shared<map_type>(), pairs);
+    REQUIRE(check(m1, pairs));
+    REQUIRE(*m1 == *m2);
+
+    // versions built and dropped on other threads hand their blocks
+    // back when the threads exit; their sizes are checked after the
+    // join, as a failed REQUIRE can't be reported from another thread
+    std::vector<std::size_t> sizes(4);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&, t] {
+            auto m = m1;
+            for (std::size_t i = t; i < pairs.size(); i += 4) {
+                m = m->without(pairs[i].first);
+            }
+            sizes[t] = m->size();
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    for (auto size : sizes) {
+        REQUIRE(size == pairs.size() - pairs.size() / 4);
+    }
+
+    m2.reset();
+    auto m3 = fillTransient(std::make_shared<map_type>(), pairs);
+    REQUIRE(*m1 == *m3);
+}
+
+TEST_CASE("persistent_map with deferred_policy")
+{
+    using map_type = rw::pdata::persistent_map<uint64_t, uint64_t,
+            std::hash<uint64_t>, rw::pdata::deferred_policy<>>;
+
+    auto pairs = randomPairs<uint64_t>(5000);
+    auto m1 = fillTransient(std::make_shared<map_type>(), pairs);
+    auto stats = m1->stats();
+    auto nodes = stats.bitmap_nodes + stats.array_nodes +
+                 stats.collision_nodes;
+
+    // nodes the transient outgrew while filling m1
+    REQUIRE(rw::pdata::pending_reclaim() > 0);
+    rw::pdata::reclaim();
+
+    // a version sharing all but one path with m1
+    auto m2 = m1->assoc(pairs[0].first, 0);
+    m2.reset();
+    REQUIRE(rw::pdata::pending_reclaim() == 1);
+    REQUIRE(rw::pdata::reclaim() > 0);
+    REQUIRE(check(m1, pairs));
+
+    // dropping m1 queues its root, then its subtrees follow as their
+    // parents are reclaimed, a slice at a time
+    m1.reset();
+    REQUIRE(rw::pdata::pending_reclaim() == 1);
+    REQUIRE(rw::pdata::reclaim(10) == 10);
+    REQUIRE(rw::pdata::pending_reclaim() > 0);
+    REQUIRE(rw::pdata::reclaim() == nodes - 10);
+    REQUIRE(rw::pdata::pending_reclaim() == 0);
+}
+
+TEST_CASE("background_reclaimer")
+{
+    using map_type = rw::pdata::persistent_map<uint64_t, uint64_t,
+            std::hash<uint64_t>, rw::pdata::deferred_policy<>>;
+
+    auto pairs = randomPairs<uint64_t>(5000);
+    {
+        rw::pdata::background_reclaimer reclaimer;
+
+        // versions dropped on several threads at once, checked after
+        // the join, as with pool_policy
+        auto m = fillTransient(std::make_shared<map_type>(), pairs);
+        std::vector<std::size_t> sizes(4);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; t++) {
+            threads.emplace_back([&, t] {
+                auto mine = m;
+                for (std::size_t i = t; i < pairs.size(); i += 4) {
+                    mine = mine->without(pairs[i].first);
+                }
+                sizes[t] = mine->size();
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        for (auto size : sizes) {
+            REQUIRE(size == pairs.size() - pairs.size() / 4);
+        }
+        REQUIRE(check(m, pairs));
+        m.reset();
+
+        // reclaimed without anyone calling reclaim()
+        for (int i = 0; i < 500 && rw::pdata::pending_reclaim(); i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        REQUIRE(rw::pdata::pending_reclaim() == 0);
+    }
+    REQUIRE(rw::pdata::reclaim() == 0);
+}
+
+TEST_CASE("persistent_map with memo_policy")
+{
+    using map_type = rw::pdata::persistent_map<std::string, int,
+            std::hash<std::string>, rw::pdata::memo_policy<>>;
+
+    std::vector<std::pair<std::string, int>> pairs;
+    for (int i = 0; i < 5000; i++) {
+        pairs.push_back({fmt::format("/var/lib/service/data/{}/file", i), i});
+    }
+
+    auto t = std::make_shared<map_type>()->transient();
+    for (const auto& [key, val] : pairs) {
+        t->assoc(key, val);
+    }
+    auto m1 = t->persistent();
+    auto m2 = map_type::create(pairs.begin(), pairs.end());
+    REQUIRE(*m1 == *m2);
+
+    for (const auto& [key, val] : pairs) {
+        REQUIRE(m1->find(key) == val);
+    }
+    REQUIRE(!m1->find("/var/lib/service/data/5000/file"));
+
+    auto m3 = m1;
+    for (int i = 0; i < 5000; i += 2) {
+        m3 = m3->without(pairs[i].first);
+    }
+    REQUIRE(m3->size() == 2500);
+    REQUIRE(*m1->merge(m3) == *m1);
+
+    // colliding keys share one stored hash
+    using mock_type = rw::pdata::champ_map<MockHashable, int, MockHashableHash,
+            rw::pdata::memo_policy<>>;
+    auto a = MockHashable{uint32_t(22892882), 1};
+    auto b = MockHashable{uint32_t(22892882), 2};
+    auto c = std::make_shared<mock_type>()->assoc(a, 1)->assoc(b, 2);
+    REQUIRE(c->find(a) == 1);
+    REQUIRE(c->find(b) == 2);
+    REQUIRE(*c->without(b) == *std::make_shared<mock_type>()->assoc(a, 1));
+}
+
+TEST_CASE("persistent_map transparent lookup")
+{
+    using map_type = rw::pdata::persistent_map<std::string, int,
+            rw::pdata::string_hash>;
+
+    auto m = map_type::create({{"alpha", 1}, {"beta", 2}, {"gamma", 3}});
+
+    std::string_view beta{"beta!", 4};
+    REQUIRE(m->find(beta) == 2);
+    REQUIRE(m->find("gamma") == 3);
+    REQUIRE(m->contains(beta));
+    REQUIRE(!m->contains("delta"));
+    REQUIRE(!m->find(std::string_view{}));
+
+    auto m2 = m->without(beta);
+    REQUIRE(m2->size() == 2);
+    REQUIRE(!m2->contains("beta"));
+    REQUIRE(m->without("delta") == m);
+
+    auto t = m->transient();
+    REQUIRE(t->find(beta) == 2);
+    t->without(beta);
+    REQUIRE(!t->contains(beta));
+    REQUIRE(t->contains(std::string{"alpha"}));
+    REQUIRE(t->size() == 2);
+
+    // string_hash agrees with std::hash, so both find the same keys
+    auto plain = std::make_shared<rw::pdata::persistent_map<std::string, int>>()
+                         ->assoc("alpha", 1);
+    REQUIRE(plain->contains("alpha"));
+    REQUIRE(rw::pdata::string_hash{}("alpha") == std::hash<std::string>{}("alpha"));
+}
+
+TEST_CASE("persistent_map find_ptr")
+{
+    using map_type = rw::pdata::persistent_map<std::string, std::string,
+            rw::pdata::string_hash>;
+
+    auto m1 = map_type::create({{"a", std::string(100, 'a')}, {"b", "b"}});
+
+    // points at the value in the map, rather than copying it
+    auto found = m1->find_ptr("a");
+    REQUIRE(found);
+    REQUIRE(*found == std::string(100, 'a'));
+    REQUIRE(!m1->find_ptr("c"));
+
+    // later versions don't move or change it
+    auto m2 = m1->assoc("c", "c")->assoc("a", "changed");
+    REQUIRE(*m2->find_ptr(std::string{"a"}) == "changed");
+
+    auto t = m1->transient();
+    t->assoc("a", "changed");
+    REQUIRE(*t->find_ptr("a") == "changed");
+    REQUIRE(m1->find_ptr("a") == found);
+    REQUIRE(*found == std::string(100, 'a'));
+}
+
+TEST_CASE("persistent_map update and upsert")
+{
+    using map_type = rw::pdata::persistent_map<uint64_t, uint64_t>;
+    auto inc = [](uint64_t n) { return n + 1; };
+
+    // counts of keys drawn with repeats
+    std::mt19937_64 gen(4321u);
+    std::vector<uint64_t> keys(20000);
+    for (auto& key : keys) {
+        key = gen() % 5000;
+    }
+
+    std::unordered_map<uint64_t, uint64_t> expected;
+    auto m = std::make_shared<map_type>();
+    auto t = std::make_shared<map_type>()->transient();
+    for (auto key : keys) {
+        expected[key]++;
+        m = m->upsert(key, 1, inc);
+        t->upsert(key, 1, inc);
+    }
+    REQUIRE(m->size() == expected.size());
+    REQUIRE(t->size() == expected.size());
+    for (const auto& [key, count] : expected) {
+        REQUIRE(m->find(key) == count);
+        REQUIRE(t->find(key) == count);
+    }
+    REQUIRE(*m == *t->persistent());
+
+    // update leaves missing keys out
+    auto empty = std::make_shared<map_type>();
+    REQUIRE(empty->update(1, inc) == empty);
+    REQUIRE(m->update(5000, inc) == m);
+
+    auto m2 = m->update(keys[0], inc);
+    REQUIRE(m2->size() == m->size());
+    REQUIRE(m2->find(keys[0]) == expected[keys[0]] + 1);
+    REQUIRE(m->find(keys[0]) == expected[keys[0]]);
+
+    // an unchanged value keeps the map
+    REQUIRE(m->update(keys[0], [](uint64_t n) { return n; }) == m);
+
+    // the canonical encoding
+    using champ_type = rw::pdata::champ_map<uint64_t, uint64_t>;
+    auto c = std::make_shared<champ_type>();
+    for (auto key : keys) {
+        c = c->upsert(key, 1, inc);
+    }
+    REQUIRE(c->size() == expected.size());
+    REQUIRE(c->find(keys[0]) == expected[keys[0]]);
+}
+
+TEST_CASE("persistent_map update with collisions")
+{
+    using map_type = rw::pdata::persistent_map<MockHashable, int, MockHashableHash>;
+    auto inc = [](int n) { return n + 1; };
+
+    auto m = std::make_shared<map_type>();
+    auto t = std::make_shared<map_type>()->transient();
+    for (int i = 0; i < 300; i++) {
+        MockHashable key{uint32_t(i % 100 % 3), i % 100};
+        m = m->upsert(key, 1, inc);
+        t->upsert(key, 1, inc);
+    }
+    REQUIRE(m->size() == 100);
+    REQUIRE(t->size() == 100);
+    for (int i = 0; i < 100; i++) {
+        MockHashable key{uint32_t(i % 3), i};
+        REQUIRE(m->find(key) == 3);
+        REQUIRE(t->find(key) == 3);
+    }
+
+    // a missing key in a collision node, and one with a hash beside it
+    REQUIRE(m->update(MockHashable{0, 1000}, inc) == m);
+    REQUIRE(m->update(MockHashable{7, 1000}, inc) == m);
+    t->update(MockHashable{0, 1000}, inc);
+    REQUIRE(t->size() == 100);
+
+    auto m2 = m->update(MockHashable{1, 1}, inc);
+    REQUIRE(m2->find(MockHashable{1, 1}) == 4);
+    REQUIRE(m->find(MockHashable{1, 1}) == 3);
+}
+
+TEST_CASE("persistent_map stats")
+{
+    using map_type = rw::pdata::persistent_map<uint64_t, uint64_t>;
+
+    auto empty = std::make_shared<map_type>()->stats();
+    REQUIRE(empty.bytes == 0);
+    REQUIRE(empty.depths.empty());
+
+    auto pairs = randomPairs<uint64_t>(5000);
+    auto m1 = map_type::create(pairs.begin(), pairs.end());
+    auto stats = m1->stats();
+    REQUIRE(stats.bitmap_nodes + stats.array_nodes > 1);
+    REQUIRE(stats.collision_nodes == 0);
+    REQUIRE(std::accumulate(stats.depths.begin(), stats.depths.end(),
+                    std::size_t{0}) == 5000);
+    REQUIRE(stats.bytes > 5000 * sizeof(map_type::value_type));
+    REQUIRE(stats.shared_bytes == 0);
+    REQUIRE(m1->stats(*m1).unique_bytes() == 0);
+
+    // a new version only pays for the path to its change
+    auto m2 = m1->assoc(pairs[0].first, 1)->assoc(1, 1);
+    auto shared = m2->stats(*m1);
+    REQUIRE(shared.unique_bytes() > 0);
+    REQUIRE(shared.unique_bytes() < stats.bytes / 10);
+    REQUIRE(m2->stats(map_type{}).shared_bytes == 0);
+}
+
+TEST_CASE("persistent_map stats with collisions")
+{
+    using map_type = rw::pdata::persistent_map<MockHashable, int, MockHashableHash>;
+
+    auto m = std::make_shared<map_type>();
+    for (int i = 0; i < 100; i++) {
+        m = m->assoc({uint32_t(i % 2), i}, i);
+    }
+
+    auto stats = m->stats();
+    REQUIRE(stats.collision_nodes == 2);
+    REQUIRE(stats.depths.back() == 100);
+}
+
 /*
 func TestTransientHashMapContext(t *testing.T) {
 	k0 := &atom.Num{Val: big.NewInt(222)}
@@ -0,0 +1,220 @@
+#include "doctest.h"
+#include "map-helpers.h"
+#include "rw/pdata/set.h"
+
+#include <algorithm>
+#include <array>
+#include <random>
+#include <tuple>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+template <class Set, class K, class Hash>
+bool same(const Set& s, const std::unordered_set<K, Hash>& expected)
+{
+    if (s.size() != expected.size() ||
+            std::size_t(std::distance(s.begin(), s.end())) != expected.size()) {
+        return false;
+    }
+    return std::all_of(expected.begin(), expected.end(),
+            [&](const K& key) { return s.contains(key); });
+}
+
+// Checks union, intersection and difference of sets made from random
+// keys, some derived from others so they share subtrees
+template <class Set>
+void checkAlgebra()
+{
+    using expected_type = std::unordered_set<uint64_t>;
+
+    // constant seed for random
+    std::mt19937 gen(904421ull);
+    std::uniform_int_distribution<uint64_t> dis(0, 30000);
+
+    std::vector<uint64_t> keys(20000);
+    std::generate(keys.begin(), keys.end(), [&] { return dis(gen); });
+
+    auto base = Set::create(keys.begin(), keys.begin() + 10000);
+    expected_type baseKeys(keys.begin(), keys.begin() + 10000);
+
+    std::vector<std::pair<std::shared_ptr<Set>, expected_type>> sets;
+    sets.emplace_back(base, baseKeys);
+    sets.emplace_back(Set::create(keys.begin() + 5000, keys.end()),
+            expected_type(keys.begin() + 5000, keys.end()));
+    sets.emplace_back(std::make_shared<Set>(), expected_type{});
+
+    // versions of base with a few keys added and removed
+    for (int n : {1, 30, 2000}) {
+        auto s = base;
+        auto expected = baseKeys;
+        for (int i = 0; i < n; i++) {
+            s = s->insert(keys[10000 + i])->erase(keys[i * 3]);
+            expected.insert(keys[10000 + i]);
+            expected.erase(keys[i * 3]);
+        }
+        sets.emplace_back(s, expected);
+    }
+
+    for (const auto& [a, aKeys] : sets) {
+        for (const auto& [b, bKeys] : sets) {
+            expected_type both, common, onlyA;
+            for (auto key : aKeys) {
+                (bKeys.count(key) ? common : onlyA).insert(key);
+            }
+            both = aKeys;
+            both.insert(bKeys.begin(), bKeys.end());
+
+            auto u = a->set_union(b);
+            auto i = a->set_intersection(b);
+            auto d = a->set_difference(b);
+            REQUIRE(same(*u, both));
+            REQUIRE(same(*i, common));
+            REQUIRE(same(*d, onlyA));
+
+            // same as sets built from scratch
+            REQUIRE(*u == *Set::create(both.begin(), both.end()));
+            REQUIRE(*i == *Set::create(common.begin(), common.end()));
+            REQUIRE(*d == *Set::create(onlyA.begin(), onlyA.end()));
+        }
+    }
+}
+
+} // namespace
+
+TEST_SUITE_BEGIN("persistent-data");
+
+TEST_CASE("persistent_set insert and erase")
+{
+    using set_type = rw::pdata::persistent_set<uint64_t>;
+
+    auto pairs = randomPairs<uint64_t>(5000);
+    auto s = std::make_shared<set_type>();
+    for (const auto& pair : pairs) {
+        s = s->insert(pair.first);
+    }
+    REQUIRE(s->size() == 5000);
+    REQUIRE(s->insert(pairs[7].first).get() == s.get());
+
+    auto t = s->transient();
+    for (std::size_t i = 0; i < pairs.size(); i += 2) {
+        t->erase(pairs[i].first);
+    }
+    t->insert(1)->insert(1);
+    auto s2 = t->persistent();
+
+    REQUIRE(s2->size() == 2501);
+    for (std::size_t i = 0; i < pairs.size(); i++) {
+        REQUIRE(s->contains(pairs[i].first));
+        REQUIRE(s2->contains(pairs[i].first) == (i % 2 == 1));
+    }
+    REQUIRE(s2->contains(1));
+    REQUIRE(s2->erase(2).get() == s2.get());
+    REQUIRE_THROWS_AS(t->insert(2), std::logic_error);
+    REQUIRE_THROWS_AS(t->begin(), std::logic_error);
+}
+
+TEST_CASE("persistent_set algebra")
+{
+    checkAlgebra<rw::pdata::persistent_set<uint64_t>>();
+}
+
+TEST_CASE("champ_set algebra")
+{
+    checkAlgebra<rw::pdata::champ_set<uint64_t>>();
+}
+
+TEST_CASE("persistent_set algebra with memo_policy")
+{
+    checkAlgebra<rw::pdata::persistent_set<uint64_t, std::hash<uint64_t>,
+            rw::pdata::memo_policy<rw::pdata::shared_policy>>>();
+}
+
+TEST_CASE("persistent_set algebra reuses sets")
+{
+    using set_type = rw::pdata::persistent_set<uint64_t>;
+
+    auto pairs = randomPairs<uint64_t>(3000);
+    auto big = std::make_shared<set_type>();
+    for (const auto& pair : pairs) {
+        big = big->insert(pair.first);
+    }
+    auto small = big->erase(pairs[3].first)->erase(pairs[2000].first);
+
+    REQUIRE(big->set_union(small).get() == big.get());
+    REQUIRE(small->set_union(big).get() == big.get());
+    REQUIRE(small->set_intersection(big).get() == small.get());
+    REQUIRE(big->set_intersection(big).get() == big.get());
+    REQUIRE(big->set_difference(std::make_shared<set_type>()).get() == big.get());
+    REQUIRE(big->set_difference(big)->empty());
+
+    auto d = big->set_difference(small);
+    REQUIRE(d->size() == 2);
+    REQUIRE(d->contains(pairs[3].first));
+    REQUIRE(d->contains(pairs[2000].first));
+}
+
+TEST_CASE("persistent_set algebra with collisions")
+{
+    using set_type = rw::pdata::persistent_set<MockHashable, MockHashableHash>;
+    using expected_type = std::unordered_set<MockHashable, MockHashableHash>;
+
+    // few hashes, some of which share their first levels
+    auto key = [](int i) {
+        return MockHashable{uint32_t(i % 7) << (i % 3 * 5), i};
+    };
+
+    std::vector<MockHashable> keys;
+    for (int i = 0; i < 300; i++) {
+        keys.push_back(key(i));
+    }
+
+    for (auto [aFirst, aLast, bFirst, bLast] :
+            {std::array{0, 200, 100, 300}, std::array{0, 150, 0, 300},
+                    std::array{0, 1, 0, 300}, std::array{20, 21, 0, 40}}) {
+        CAPTURE(aFirst);
+        CAPTURE(bFirst);
+
+        expected_type aKeys(keys.begin() + aFirst, keys.begin() + aLast);
+        expected_type bKeys(keys.begin() + bFirst, keys.begin() + bLast);
+        auto a = set_type::create(aKeys.begin(), aKeys.end());
+        auto b = set_type::create(bKeys.begin(), bKeys.end());
+
+        for (auto [x, y, xKeys, yKeys] :
+                {std::tuple{a, b, aKeys, bKeys}, std::tuple{b, a, bKeys, aKeys}}) {
+            expected_type both = xKeys, common, onlyX;
+            both.insert(yKeys.begin(), yKeys.end());
+            for (const auto& k : xKeys) {
+                (yKeys.count(k) ? common : onlyX).insert(k);
+            }
+
+            REQUIRE(same(*x->set_union(y), both));
+            REQUIRE(same(*x->set_intersection(y), common));
+            REQUIRE(same(*x->set_difference(y), onlyX));
+        }
+    }
+}
+
+TEST_CASE("champ_set is canonical after algebra")
+{
+    using set_type = rw::pdata::champ_set<MockHashable, MockHashableHash>;
+
+    std::vector<MockHashable> keys;
+    for (int i = 0; i < 400; i++) {
+        keys.push_back({uint32_t(i % 50) << (i % 4 * 5), i});
+    }
+
+    auto a = set_type::create(keys.begin(), keys.begin() + 300);
+    auto b = set_type::create(keys.begin() + 100, keys.end());
+
+    auto i = a->set_intersection(b);
+    auto iFresh = set_type::create(keys.begin() + 100, keys.begin() + 300);
+    REQUIRE(i->dump(0) == iFresh->dump(0));
+
+    auto d = a->set_difference(b);
+    auto dFresh = set_type::create(keys.begin(), keys.begin() + 100);
+    REQUIRE(d->dump(0) == dFresh->dump(0));
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,235 @@
+#include "map-helpers.h"
+#include "doctest.h"
+#include "rw/pdata/snapshot.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+using map_type = rw::pdata::persistent_map<uint64_t, double>;
+using snapshot_type = rw::pdata::map_snapshot<uint64_t, double>;
+
+// a copy of a snapshot in aligned memory, to view in place
+template <class Map>
+std::vector<uint64_t> snapshotOf(const Map& m)
+{
+    std::ostringstream out;
+    rw::pdata::write_snapshot(m, out);
+    auto bytes = out.str();
+
+    std::vector<uint64_t> buffer((bytes.size() + 7) / 8);
+    std::memcpy(buffer.data(), bytes.data(), bytes.size());
+    return buffer;
+}
+
+} // namespace
+
+TEST_SUITE_BEGIN("persistent-data");
+
+TEST_CASE("map_snapshot round trip")
+{
+    // constant seed for random
+    std::mt19937_64 gen(4410981ull);
+
+    std::unordered_map<uint64_t, double> expected;
+    for (int i = 0; i < 50000; i++) {
+        expected[gen()] = i * 0.5;
+    }
+    auto m = map_type::create(expected.begin(), expected.end());
+
+    auto buffer = snapshotOf(*m);
+    auto s = snapshot_type::view(buffer.data(), buffer.size() * 8);
+    REQUIRE(s->size() == expected.size());
+
+    for (const auto& [key, val] : expected) {
+        REQUIRE(s->find(key) == val);
+        REQUIRE(*s->find_ptr(key) == val);
+    }
+    for (int i = 0; i < 1000; i++) {
+        auto key = gen();
+        REQUIRE(s->contains(key) == (expected.count(key) != 0));
+    }
+
+    std::size_t seen = 0;
+    s->for_each([&](uint64_t key, double val) {
+        REQUIRE(expected.at(key) == val);
+        seen++;
+    });
+    REQUIRE(seen == expected.size());
+
+    // and an empty map
+    buffer = snapshotOf(map_type{});
+    s = snapshot_type::view(buffer.data(), buffer.size() * 8);
+    REQUIRE(s->empty());
+    REQUIRE(!s->contains(0));
+}
+
+TEST_CASE("map_snapshot with collisions")
+{
+    using collision_map = rw::pdata::persistent_map<MockHashable, int,
+            MockHashableHash>;
+    using collision_snapshot = rw::pdata::map_snapshot<MockHashable, int,
+            MockHashableHash>;
+
+    // a few hashes shared by many keys, so there are collision nodes
+    // at the bottom of the trie as well as values
+    auto t = std::make_shared<collision_map>()->transient();
+    for (int i = 0; i < 2000; i++) {
+        t->assoc(MockHashable{uint32_t(i % 7 == 0 ? i % 3 : i), i}, -i);
+    }
+    auto m = t->persistent();
+    REQUIRE(m->stats().collision_nodes > 0);
+
+    auto buffer = snapshotOf(*m);
+    auto s = collision_snapshot::view(buffer.data(), buffer.size() * 8);
+    REQUIRE(s->size() == 2000);
+    for (int i = 0; i < 2000; i++) {
+        REQUIRE(s->find(MockHashable{uint32_t(i % 7 == 0 ? i % 3 : i), i}) ==
+                -i);
+    }
+    REQUIRE(!s->contains(MockHashable{1, 3000}));
+    REQUIRE(!s->contains(MockHashable{2, 1}));
+}
+
+TEST_CASE("map_snapshot from a file")
+{
+    std::vector<std::pair<uint64_t, double>> pairs;
+    for (uint64_t i = 0; i < 10000; i++) {
+        pairs.emplace_back(i * i, i);
+    }
+    auto m = map_type::create(pairs.begin(), pairs.end());
+
+    auto path = "rw-pdata-snapshot-test-" + std::to_string(::getpid());
+    {
+        std::ofstream out(path, std::ios::binary);
+        rw::pdata::write_snapshot(*m, out);
+    }
+    auto s = snapshot_type::open(path);
+    std::remove(path.c_str());
+
+    REQUIRE(s->size() == 10000);
+    for (const auto& [key, val] : pairs) {
+        REQUIRE(s->find(key) == val);
+    }
+
+    // changes make a persistent_map from the snapshot once, leaving
+    // the snapshot as it was
+    auto m2 = s->assoc(3, 0.5);
+    auto m3 = s->without(4);
+    REQUIRE(s->persistent().get() == s->persistent().get());
+    REQUIRE(*s->persistent() == *m);
+    REQUIRE(m2->size() == 10001);
+    REQUIRE(m2->find(3) == 0.5);
+    REQUIRE(m3->size() == 9999);
+    REQUIRE(!m3->contains(4));
+    REQUIRE(!s->contains(3));
+    REQUIRE(s->contains(4));
+
+    REQUIRE_THROWS_AS(snapshot_type::open(path), std::system_error);
+}
+
+TEST_CASE("map_snapshot rejects other data")
+{
+    auto buffer = snapshotOf(*map_type::create({{1, 1.0}, {2, 2.0}}));
+    auto size = buffer.size() * 8;
+
+    // another value type
+    REQUIRE_THROWS_AS(
+            (rw::pdata::map_snapshot<uint64_t, float>::view(buffer.data(),
+                    size)),
+            std::runtime_error);
+
+    // truncated
+    REQUIRE_THROWS_AS(snapshot_type::view(buffer.data(), size - 8),
+            std::runtime_error);
+    REQUIRE_THROWS_AS(snapshot_type::view(buffer.data(), 8),
+            std::runtime_error);
+
+    // corrupt
+    buffer[0] ^= 1;
+    REQUIRE_THROWS_AS(snapshot_type::view(buffer.data(), size),
+            std::runtime_error);
+}
+
+TEST_CASE("map_journal versions")
+{
+    using journal_type = rw::pdata::map_journal<uint64_t, double>;
+
+    // constant seed for random
+    std::mt19937_64 gen(30317ull);
+
+    std::unordered_map<uint64_t, double> expected;
+    std::vector<uint64_t> keys;
+    for (int i = 0; i < 20000; i++) {
+        keys.push_back(gen());
+        expected[keys.back()] = i;
+    }
+    auto m = map_type::create(expected.begin(), expected.end());
+
+    std::ostringstream out;
+    rw::pdata::map_journal_writer<uint64_t, double> writer{out};
+    writer.checkpoint(*m);
+    auto full = writer.size();
+
+    // versions with a few changes each, keeping only the latest, so
+    // nodes are freed and their memory reused between checkpoints
+    std::vector<std::unordered_map<uint64_t, double>> versions{expected};
+    for (int v = 0; v < 200; v++) {
+        auto t = m->transient();
+        for (int i = 0; i < 20; i++) {
+            auto key = keys[gen() % keys.size()];
+            if (i % 4 == 0) {
+                t->without(key);
+                expected.erase(key);
+            } else {
+                t->assoc(key, v + i * 0.25);
+                expected[key] = v + i * 0.25;
+            }
+        }
+        m = t->persistent();
+
+        auto before = writer.size();
+        writer.checkpoint(*m);
+        versions.push_back(expected);
+
+        // a checkpoint writes the changed paths, not the map
+        REQUIRE(writer.size() - before < full / 10);
+    }
+
+    auto bytes = out.str();
+    std::vector<uint64_t> buffer((bytes.size() + 7) / 8);
+    std::memcpy(buffer.data(), bytes.data(), bytes.size());
+    auto journal = journal_type::view(buffer.data(), bytes.size());
+    REQUIRE(journal->size() == versions.size());
+
+    for (std::size_t v = 0; v < versions.size(); v += 13) {
+        CAPTURE(v);
+        auto s = journal->version(v);
+        REQUIRE(s->size() == versions[v].size());
+        std::size_t matched = 0;
+        s->for_each([&](uint64_t key, double val) {
+            auto found = versions[v].find(key);
+            matched += found != versions[v].end() && found->second == val;
+        });
+        REQUIRE(matched == versions[v].size());
+    }
+    REQUIRE(*journal->latest()->persistent() == *m);
+    REQUIRE_THROWS_AS(journal->version(versions.size()), std::out_of_range);
+
+    // a map_snapshot of a journal reads its last version
+    auto s = snapshot_type::view(buffer.data(), bytes.size());
+    REQUIRE(*s->persistent() == *m);
+}
+
+TEST_SUITE_END();
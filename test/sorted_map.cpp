@@ -0,0 +1,263 @@
+#include "doctest.h"
+#include "rw/pdata/sorted_map.h"
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+using map_type = rw::pdata::persistent_sorted_map<int, int>;
+
+// checks m against expected, iterating forwards and backwards
+bool same(const map_type& m, const std::map<int, int>& expected)
+{
+    if (m.size() != expected.size()) {
+        return false;
+    }
+    auto pairEq = [](const auto& a, const auto& b) {
+        return a.first == b.first && a.second == b.second;
+    };
+    return std::equal(m.begin(), m.end(), expected.begin(), expected.end(),
+                   pairEq) &&
+           std::equal(std::make_reverse_iterator(m.end()),
+                   std::make_reverse_iterator(m.begin()), expected.rbegin(),
+                   expected.rend(), pairEq);
+}
+
+} // namespace
+
+TEST_SUITE_BEGIN("persistent-data");
+
+TEST_CASE("persistent_sorted_map assoc and without")
+{
+    // constant seed for random
+    std::mt19937 gen(662913ull);
+    std::uniform_int_distribution<int> dis(0, 50000);
+
+    auto m = std::make_shared<map_type>();
+    std::map<int, int> expected;
+    std::vector<std::pair<std::shared_ptr<map_type>, std::map<int, int>>>
+            versions;
+
+    for (int i = 0; i < 20000; i++) {
+        auto key = dis(gen);
+        m = m->assoc(key, i);
+        expected[key] = i;
+        if (i % 2500 == 0) {
+            versions.emplace_back(m, expected);
+        }
+    }
+    REQUIRE(same(*m, expected));
+
+    for (int i = 0; i < 40000; i++) {
+        auto key = dis(gen);
+        m = m->without(key);
+        expected.erase(key);
+        if (i % 5000 == 0) {
+            versions.emplace_back(m, expected);
+        }
+    }
+    REQUIRE(same(*m, expected));
+
+    // older versions are unchanged
+    for (const auto& [version, keys] : versions) {
+        REQUIRE(same(*version, keys));
+    }
+
+    // then empty it
+    for (auto [key, val] : expected) {
+        m = m->without(key);
+    }
+    REQUIRE(m->empty());
+    REQUIRE(m->begin() == m->end());
+}
+
+TEST_CASE("persistent_sorted_map find")
+{
+    auto m = map_type::create({{5, 50}, {1, 10}, {3, 30}, {1, 11}});
+    REQUIRE(m->size() == 3);
+    REQUIRE(m->find(1) == 11);
+    REQUIRE(m->find(3) == 30);
+    REQUIRE(!m->find(2));
+    REQUIRE(m->contains(5));
+    REQUIRE(!m->contains(6));
+    REQUIRE(*m->find_ptr(5) == 50);
+    REQUIRE(m->find_ptr(4) == nullptr);
+
+    // an equal value leaves the map as it is
+    REQUIRE(m->assoc(3, 30).get() == m.get());
+    REQUIRE(m->without(4).get() == m.get());
+}
+
+TEST_CASE("persistent_sorted_map lower_bound and upper_bound")
+{
+    // every other key
+    std::map<int, int> expected;
+    for (int i = 0; i < 20000; i += 2) {
+        expected[i] = -i;
+    }
+    auto m = map_type::create(expected.begin(), expected.end());
+    REQUIRE(same(*m, expected));
+
+    for (int key : {-1, 0, 1, 2, 63, 64, 65, 1023, 1024, 19997, 19998, 19999,
+                 30000}) {
+        CAPTURE(key);
+
+        auto lower = m->lower_bound(key);
+        auto expectedLower = expected.lower_bound(key);
+        if (expectedLower == expected.end()) {
+            REQUIRE(lower == m->end());
+        } else {
+            REQUIRE(lower->first == expectedLower->first);
+        }
+
+        auto upper = m->upper_bound(key);
+        auto expectedUpper = expected.upper_bound(key);
+        REQUIRE(std::distance(lower, upper) ==
+                std::distance(expectedLower, expectedUpper));
+        REQUIRE(std::distance(upper, m->end()) ==
+                std::distance(expectedUpper, expected.end()));
+    }
+
+    // a range, walked backwards from its end
+    auto it = m->upper_bound(15000);
+    for (int key = 15000; key >= 5000; key -= 2) {
+        REQUIRE((--it)->first == key);
+    }
+    REQUIRE(it == m->lower_bound(4999));
+}
+
+TEST_CASE("persistent_sorted_map with increasing keys")
+{
+    // as a time series index grows
+    auto t = std::make_shared<map_type>()->transient();
+    std::map<int, int> expected;
+    for (int i = 0; i < 50000; i++) {
+        t->assoc(i * 3, i);
+        expected[i * 3] = i;
+    }
+    auto m = t->persistent();
+    REQUIRE(same(*m, expected));
+
+    // dropping the oldest
+    for (int i = 0; i < 30000; i++) {
+        m = m->without(i * 3);
+        expected.erase(i * 3);
+    }
+    REQUIRE(same(*m, expected));
+
+    // and newest, in a transient
+    t = m->transient();
+    for (int i = 49999; i >= 40000; i--) {
+        t->without(i * 3);
+        expected.erase(i * 3);
+    }
+    REQUIRE(same(*t->persistent(), expected));
+}
+
+TEST_CASE("transient_sorted_map")
+{
+    std::map<int, int> expected;
+    for (int i = 0; i < 5000; i++) {
+        expected[i * 7 % 5003] = i;
+    }
+    auto m = map_type::create(expected.begin(), expected.end());
+
+    auto t = m->transient();
+    auto changed = expected;
+    for (int i = 0; i < 5003; i += 3) {
+        t->without(i);
+        changed.erase(i);
+    }
+    for (int i = 0; i < 3000; i++) {
+        t->assoc(10000 + i, i)->assoc(i * 2, -i);
+        changed[10000 + i] = i;
+        changed[i * 2] = -i;
+    }
+    REQUIRE(t->size() == changed.size());
+    REQUIRE(t->find(4) == -2);
+    auto m2 = t->persistent();
+
+    REQUIRE(same(*m, expected));
+    REQUIRE(same(*m2, changed));
+    REQUIRE_THROWS_AS(t->assoc(1, 1), std::logic_error);
+    REQUIRE_THROWS_AS(t->find(1), std::logic_error);
+    REQUIRE_THROWS_AS(t->begin(), std::logic_error);
+}
+
+TEST_CASE("persistent_sorted_map random operations")
+{
+    // constant seed for random
+    std::mt19937 gen(5150ull);
+    auto pick = [&](int n) {
+        return std::uniform_int_distribution<int>(0, n)(gen);
+    };
+
+    auto m = std::make_shared<map_type>();
+    std::map<int, int> expected;
+
+    for (int step = 0; step < 300; step++) {
+        // runs of nearby keys, to fill and empty particular nodes
+        auto start = pick(100000);
+        auto len = pick(500);
+        auto t = m->transient();
+        for (int i = 0; i < len; i++) {
+            auto key = start + pick(2 * len);
+            if (pick(2)) {
+                t->assoc(key, step);
+                expected[key] = step;
+            } else {
+                t->without(key);
+                expected.erase(key);
+            }
+        }
+        m = t->persistent();
+
+        CAPTURE(step);
+        REQUIRE(same(*m, expected));
+    }
+}
+
+TEST_CASE("persistent_sorted_map equality")
+{
+    std::vector<std::pair<int, int>> pairs;
+    for (int i = 0; i < 3000; i++) {
+        pairs.emplace_back(i, i);
+    }
+    auto m1 = map_type::create(pairs.begin(), pairs.end());
+
+    // same values, different tree
+    auto m2 = std::make_shared<map_type>();
+    for (int i = 2999; i >= 0; i--) {
+        m2 = m2->assoc(i, i);
+    }
+    REQUIRE(*m1 == *m2);
+    REQUIRE(*m1 != *m2->assoc(5, 6));
+    REQUIRE(*m1 != *m2->without(5));
+}
+
+TEST_CASE("persistent_sorted_map transparent lookup")
+{
+    using string_map = rw::pdata::persistent_sorted_map<std::string, int,
+            std::less<>>;
+
+    std::vector<std::pair<std::string, int>> pairs;
+    for (int i = 0; i < 1000; i++) {
+        pairs.emplace_back("key" + std::to_string(i), i);
+    }
+    auto m = string_map::create(pairs.begin(), pairs.end());
+
+    REQUIRE(m->find(std::string_view{"key10"}) == 10);
+    REQUIRE(m->contains("key999"));
+    REQUIRE(!m->contains("key1000"));
+    REQUIRE(m->lower_bound(std::string_view{"key5"})->first == "key5");
+    REQUIRE(m->upper_bound("key5")->first == "key50");
+}
+
+TEST_SUITE_END();
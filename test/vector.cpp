@@ -0,0 +1,294 @@
+#include "doctest.h"
+#include "rw/pdata/vector.h"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+using vector_type = rw::pdata::persistent_vector<int>;
+
+std::shared_ptr<vector_type> iota(int first, int count)
+{
+    std::vector<int> values(count);
+    std::iota(values.begin(), values.end(), first);
+    return vector_type::create(values.begin(), values.end());
+}
+
+// checks v against expected by index, and by iterating forwards and
+// backwards
+bool same(const vector_type& v, const std::vector<int>& expected)
+{
+    if (v.size() != expected.size()) {
+        return false;
+    }
+    for (std::size_t i = 0; i < expected.size(); i++) {
+        if (v[i] != expected[i]) {
+            return false;
+        }
+    }
+    return std::equal(v.begin(), v.end(), expected.begin()) &&
+           std::equal(std::make_reverse_iterator(v.end()),
+                   std::make_reverse_iterator(v.begin()), expected.rbegin());
+}
+
+} // namespace
+
+TEST_SUITE_BEGIN("persistent-data");
+
+TEST_CASE("persistent_vector push_back and pop_back")
+{
+    auto v = std::make_shared<vector_type>();
+    std::vector<std::shared_ptr<vector_type>> versions;
+    std::vector<int> expected;
+
+    // enough for three levels of branches
+    for (int i = 0; i < 40000; i++) {
+        v = v->push_back(i);
+        expected.push_back(i);
+        if (i % 997 == 0) {
+            versions.push_back(v);
+        }
+    }
+    REQUIRE(same(*v, expected));
+
+    // older versions are unchanged
+    for (std::size_t n = 0; n < versions.size(); n++) {
+        REQUIRE(versions[n]->size() == n * 997 + 1);
+        REQUIRE(versions[n]->back() == int(n * 997));
+    }
+
+    while (!v->empty()) {
+        v = v->pop_back();
+        expected.pop_back();
+        if (expected.size() % 1001 == 0) {
+            REQUIRE(same(*v, expected));
+        }
+    }
+    REQUIRE_THROWS_AS(v->pop_back(), std::out_of_range);
+}
+
+TEST_CASE("persistent_vector set")
+{
+    auto v1 = iota(0, 5000);
+    auto v2 = v1;
+    for (int i = 0; i < 5000; i += 7) {
+        v2 = v2->set(i, -i);
+    }
+
+    for (int i = 0; i < 5000; i++) {
+        REQUIRE(v1->at(i) == i);
+        REQUIRE(v2->at(i) == (i % 7 ? i : -i));
+    }
+    REQUIRE_THROWS_AS(v1->at(5000), std::out_of_range);
+    REQUIRE_THROWS_AS(v1->set(5000, 0), std::out_of_range);
+}
+
+TEST_CASE("transient_vector")
+{
+    auto v = iota(0, 3000);
+    auto t = v->transient();
+    for (int i = 3000; i < 10000; i++) {
+        t->push_back(i);
+    }
+    for (int i = 0; i < 10000; i += 3) {
+        t->set(i, -i);
+    }
+    for (int i = 0; i < 500; i++) {
+        t->pop_back();
+    }
+    auto v2 = t->persistent();
+
+    REQUIRE(v->size() == 3000);
+    REQUIRE(same(*v, [] {
+        std::vector<int> values(3000);
+        std::iota(values.begin(), values.end(), 0);
+        return values;
+    }()));
+
+    REQUIRE(v2->size() == 9500);
+    for (int i = 0; i < 9500; i++) {
+        REQUIRE(v2->at(i) == (i % 3 ? i : -i));
+    }
+
+    REQUIRE_THROWS_AS(t->push_back(1), std::logic_error);
+    REQUIRE_THROWS_AS(t->at(0), std::logic_error);
+    REQUIRE_THROWS_AS(t->persistent(), std::logic_error);
+
+    // a new transient copies rather than changing v2
+    auto t2 = v2->transient();
+    t2->set(1, 0);
+    REQUIRE(v2->at(1) == 1);
+}
+
+TEST_CASE("persistent_vector take, drop and slice")
+{
+    std::vector<int> expected(20000);
+    std::iota(expected.begin(), expected.end(), 0);
+    auto v = vector_type::create(expected.begin(), expected.end());
+
+    for (std::size_t n : {0, 1, 31, 32, 33, 1023, 1024, 1025, 1056, 19990,
+                 20000}) {
+        CAPTURE(n);
+        REQUIRE(same(*v->take(n), {expected.begin(), expected.begin() + n}));
+        REQUIRE(same(*v->drop(n), {expected.begin() + n, expected.end()}));
+    }
+
+    REQUIRE(same(*v->slice(100, 15000),
+            {expected.begin() + 100, expected.begin() + 15000}));
+    REQUIRE(v->slice(500, 100)->empty());
+
+    // dropped vectors can still grow and shrink
+    auto d = v->drop(1000);
+    std::vector<int> rest{expected.begin() + 1000, expected.end()};
+    for (int i = 0; i < 2000; i++) {
+        d = d->push_back(-i);
+        rest.push_back(-i);
+    }
+    REQUIRE(same(*d, rest));
+    for (int i = 0; i < 15000; i++) {
+        d = d->pop_back();
+        rest.pop_back();
+    }
+    REQUIRE(same(*d, rest));
+}
+
+TEST_CASE("persistent_vector concat")
+{
+    for (int left : {0, 1, 32, 33, 100, 1057, 5000}) {
+        for (int right : {0, 1, 31, 64, 999, 4000}) {
+            CAPTURE(left);
+            CAPTURE(right);
+            auto v = iota(0, left)->concat(*iota(left, right));
+
+            std::vector<int> expected(left + right);
+            std::iota(expected.begin(), expected.end(), 0);
+            REQUIRE(same(*v, expected));
+        }
+    }
+}
+
+TEST_CASE("persistent_vector random operations")
+{
+    // constant seed for random
+    std::mt19937 gen(48157ull);
+    auto pick = [&](std::size_t n) {
+        return std::uniform_int_distribution<std::size_t>(0, n)(gen);
+    };
+
+    auto v = std::make_shared<vector_type>();
+    std::vector<int> expected;
+    int next = 0;
+
+    for (int step = 0; step < 2000; step++) {
+        switch (pick(5)) {
+        case 0: {
+            for (auto n = pick(100); n > 0; n--) {
+                v = v->push_back(next);
+                expected.push_back(next++);
+            }
+            break;
+        }
+        case 1: {
+            auto n = std::min(pick(50), expected.size());
+            for (std::size_t i = 0; i < n; i++) {
+                v = v->pop_back();
+                expected.pop_back();
+            }
+            break;
+        }
+        case 2: {
+            // another vector that was itself sliced and concatenated
+            auto count = pick(2000);
+            auto other = iota(next, count)->drop(count / 3);
+            other = other->concat(*other->take(count / 5));
+            v = v->concat(*other);
+            for (std::size_t i = 0; i < other->size(); i++) {
+                expected.push_back((*other)[i]);
+            }
+            next += count;
+            break;
+        }
+        case 3: {
+            auto n = pick(expected.size() / 4);
+            v = v->drop(n);
+            expected.erase(expected.begin(), expected.begin() + n);
+            break;
+        }
+        case 4: {
+            auto n = expected.size() - pick(expected.size() / 4);
+            v = v->take(n);
+            expected.resize(n);
+            break;
+        }
+        default: {
+            if (!expected.empty()) {
+                auto i = pick(expected.size() - 1);
+                v = v->set(i, -1);
+                expected[i] = -1;
+            }
+            break;
+        }
+        }
+
+        // keep it from growing without bound
+        if (expected.size() > 50000) {
+            v = v->drop(25000);
+            expected.erase(expected.begin(), expected.begin() + 25000);
+        }
+
+        CAPTURE(step);
+        REQUIRE(same(*v, expected));
+    }
+}
+
+TEST_CASE("persistent_vector equality")
+{
+    auto v1 = iota(0, 3000);
+    auto v2 = iota(0, 1000)->concat(*iota(1000, 2000));
+    REQUIRE(*v1 == *v2);
+    REQUIRE(*v1 != *v2->set(2999, 0));
+    REQUIRE(*v1 != *v2->pop_back());
+}
+
+TEST_CASE("persistent_vector with non-trivial values")
+{
+    using string_vector = rw::pdata::persistent_vector<std::string,
+            rw::pdata::pool_policy<rw::pdata::local_policy>>;
+
+    std::vector<std::string> expected;
+    for (int i = 0; i < 3000; i++) {
+        expected.push_back(std::string(40, 'x') + std::to_string(i));
+    }
+
+    auto v = string_vector::create(expected.begin(), expected.end());
+    v = v->drop(100)->concat(*v->take(100));
+    std::rotate(expected.begin(), expected.begin() + 100, expected.end());
+    REQUIRE(std::equal(v->begin(), v->end(), expected.begin()));
+}
+
+TEST_CASE("persistent_vector with deferred_policy")
+{
+    using deferred_vector = rw::pdata::persistent_vector<int,
+            rw::pdata::deferred_policy<>>;
+
+    std::vector<int> values(5000);
+    std::iota(values.begin(), values.end(), 0);
+    auto v1 = deferred_vector::create(values.begin(), values.end());
+    auto v2 = v1->set(10, -1);
+
+    v1.reset();
+    REQUIRE(rw::pdata::reclaim() > 0);
+    REQUIRE(v2->size() == 5000);
+    REQUIRE(v2->at(4999) == 4999);
+
+    v2.reset();
+    REQUIRE(rw::pdata::reclaim() > 0);
+    REQUIRE(rw::pdata::pending_reclaim() == 0);
+}
+
+TEST_SUITE_END();